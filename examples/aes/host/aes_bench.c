@@ -0,0 +1,1056 @@
+/**
+ * AES TA throughput benchmark
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+#include <aes_ta.h>
+
+#include "aes_envelope.h"
+#include "aes_parallel.h"
+#include "aes_stream.h"
+
+#define BENCH_BYTES		(16 * 1024 * 1024)	/* per measurement */
+#define BENCH_MIN_ITERATIONS	8
+#define BENCH_MAX_SIZE		(1024 * 1024)
+
+#define STREAM_BYTES		(32 * 1024 * 1024)	/* file size */
+
+#define SWEEP_MIN_US		100000	/* per sweep measurement */
+#define SWEEP_MIN_SIZE		16
+#define SWEEP_SIZES		9	/* SWEEP_MIN_SIZE * 4^n to 1 MiB */
+
+#define PACKETS_MAX		256	/* packets per CIPHER_PACKETS request */
+
+#define ENVELOPE_KEK_ID		"aes-bench-kek"
+
+#define AE_NONCE_SIZE		12
+#define AE_TAG_SIZE		16
+
+/* IV and largest MAC around an ENCRYPT_THEN_MAC cipher text */
+#define ETM_OVERHEAD		(TA_AES_BLOCK_SIZE + TA_AES_MAC_MAX_SIZE)
+
+struct bench_ctx {
+	TEEC_Context ctx;
+	TEEC_Session gcm;	/* GCM operation */
+	TEEC_Session ctr;	/* CTR operation for the payload */
+	TEEC_Session mac;	/* CMAC pass, encrypt-then-MAC contexts */
+	TEEC_Session xts;	/* XTS operation for sector batches */
+	TEEC_Session env;	/* user login, data keys of envelopes */
+	TEEC_Session sweep;	/* ECB, CBC and CTR of the sweep */
+	struct aes_envelope_header env_hdr;
+	uint8_t env_key[AES_ENVELOPE_KEY_SIZE];
+	char key[TA_AES_SIZE_128BIT];
+	char iv[TA_AES_BLOCK_SIZE];
+	char *in;
+	char *out;
+	char *scratch;
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void invoke(TEEC_Session *sess, uint32_t cmd, TEEC_Operation *op,
+		   const char *name)
+{
+	uint32_t origin;
+	TEEC_Result res;
+
+	res = TEEC_InvokeCommand(sess, cmd, op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(%s) failed 0x%x origin 0x%x",
+		     name, res, origin);
+}
+
+static void open_session(struct bench_ctx *b, TEEC_Session *sess,
+			 uint32_t login)
+{
+	TEEC_UUID uuid = TA_AES_UUID;
+	uint32_t origin;
+	TEEC_Result res;
+
+	res = TEEC_OpenSession(&b->ctx, sess, &uuid, login, NULL, NULL,
+			       &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x",
+		     res, origin);
+}
+
+/* PREPARE and SET_KEY for an AE session, done once outside the timing */
+static void prepare_gcm(struct bench_ctx *b)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE);
+	op.params[0].value.a = TA_AES_ALGO_GCM;
+	op.params[1].value.a = sizeof(b->key);
+	op.params[2].value.a = TA_AES_MODE_ENCODE;
+	invoke(&b->gcm, TA_AES_CMD_PREPARE, &op, "PREPARE");
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = b->key;
+	op.params[0].tmpref.size = sizeof(b->key);
+	invoke(&b->gcm, TA_AES_CMD_SET_KEY, &op, "SET_KEY");
+}
+
+/* One GCM message: AE_INIT then AE_ENCRYPT_FINAL over the whole buffer */
+static void run_gcm(struct bench_ctx *b, size_t len)
+{
+	char nonce[AE_NONCE_SIZE] = { 0 };
+	char tag[AE_TAG_SIZE];
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = nonce;
+	op.params[0].tmpref.size = sizeof(nonce);
+	op.params[1].value.a = sizeof(tag);
+	invoke(&b->gcm, TA_AES_CMD_AE_INIT, &op, "AE_INIT");
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE);
+	op.params[0].tmpref.buffer = b->in;
+	op.params[0].tmpref.size = len;
+	op.params[1].tmpref.buffer = b->out;
+	op.params[1].tmpref.size = len;
+	op.params[2].tmpref.buffer = tag;
+	op.params[2].tmpref.size = sizeof(tag);
+	invoke(&b->gcm, TA_AES_CMD_AE_ENCRYPT_FINAL, &op, "AE_ENCRYPT_FINAL");
+}
+
+static void oneshot(struct bench_ctx *b, TEEC_Session *sess, int algo,
+		    char *in, char *out, size_t len)
+{
+	char key_iv[TA_AES_SIZE_128BIT + TA_AES_BLOCK_SIZE];
+	TEEC_Operation op;
+
+	memcpy(key_iv, b->key, sizeof(b->key));
+	memcpy(key_iv + sizeof(b->key), b->iv, sizeof(b->iv));
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT);
+	op.params[0].value.a = algo;
+	op.params[0].value.b = TA_AES_MODE_ENCODE;
+	op.params[1].tmpref.buffer = key_iv;
+	op.params[1].tmpref.size = sizeof(key_iv);
+	op.params[2].tmpref.buffer = in;
+	op.params[2].tmpref.size = len;
+	op.params[3].tmpref.buffer = out;
+	op.params[3].tmpref.size = len;
+	invoke(sess, TA_AES_CMD_ONESHOT, &op, "ONESHOT");
+}
+
+/* Contexts of the MAC session */
+#define MAC_CTX_CMAC		0	/* MAC pass */
+#define MAC_CTX_ETM_CMAC	1	/* CTR then CMAC */
+#define MAC_CTX_ETM_HMAC	2	/* CTR then HMAC-SHA256 */
+
+/* MAC key and, for encrypt-then-MAC, CTR encode operation of a context */
+static void prepare_mac(struct bench_ctx *b, uint32_t index, int mac_algo,
+			int etm)
+{
+	char mac_key[TA_AES_SIZE_256BIT];
+	TEEC_Operation op;
+
+	memset(mac_key, 0x3c, sizeof(mac_key)); /* Load some dummy value */
+
+	if (etm) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INPUT);
+		op.params[0].value.a = TA_AES_ALGO_CTR;
+		op.params[1].value.a = sizeof(b->key);
+		op.params[2].value.a = TA_AES_MODE_ENCODE;
+		op.params[3].value.a = index;
+		invoke(&b->mac, TA_AES_CMD_PREPARE, &op, "PREPARE");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_NONE, TEEC_NONE,
+						 TEEC_VALUE_INPUT);
+		op.params[0].tmpref.buffer = b->key;
+		op.params[0].tmpref.size = sizeof(b->key);
+		op.params[3].value.a = index;
+		invoke(&b->mac, TA_AES_CMD_SET_KEY, &op, "SET_KEY");
+	}
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].value.a = mac_algo;
+	op.params[1].tmpref.buffer = mac_key;
+	op.params[1].tmpref.size = mac_algo == TA_AES_MAC_CMAC ?
+				   TA_AES_SIZE_128BIT : sizeof(mac_key);
+	op.params[3].value.a = index;
+	invoke(&b->mac, TA_AES_CMD_MAC_SET_KEY, &op, "MAC_SET_KEY");
+}
+
+/*
+ * CTR followed by a separate CMAC pass over the cipher text. Each kind of
+ * operation has its own session so that the one-shot command never
+ * reallocates.
+ */
+static void run_ctr_mac(struct bench_ctx *b, size_t len)
+{
+	char mac[TA_AES_CMAC_SIZE];
+	TEEC_Operation op;
+
+	oneshot(b, &b->ctr, TA_AES_ALGO_CTR, b->in, b->out, len);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = b->out;
+	op.params[0].tmpref.size = len;
+	op.params[1].tmpref.buffer = mac;
+	op.params[1].tmpref.size = sizeof(mac);
+	op.params[3].value.a = MAC_CTX_CMAC;
+	invoke(&b->mac, TA_AES_CMD_MAC_ONESHOT, &op, "MAC_ONESHOT");
+}
+
+/* CTR and MAC in one ENCRYPT_THEN_MAC request over the buffers */
+static void run_etm(struct bench_ctx *b, uint32_t index, size_t len)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = b->in;
+	op.params[0].tmpref.size = len;
+	op.params[1].tmpref.buffer = b->scratch;
+	op.params[1].tmpref.size = len + ETM_OVERHEAD;
+	op.params[3].value.a = index;
+	invoke(&b->mac, TA_AES_CMD_ENCRYPT_THEN_MAC, &op, "ENCRYPT_THEN_MAC");
+}
+
+static void run_etm_cmac(struct bench_ctx *b, size_t len)
+{
+	run_etm(b, MAC_CTX_ETM_CMAC, len);
+}
+
+static void run_etm_hmac(struct bench_ctx *b, size_t len)
+{
+	run_etm(b, MAC_CTX_ETM_HMAC, len);
+}
+
+struct bench_variant {
+	const char *name;
+	void (*run)(struct bench_ctx *b, size_t len);
+};
+
+/* MB/s of payload over BENCH_BYTES bytes in len sized messages */
+static double bench(struct bench_ctx *b, const struct bench_variant *variant,
+		    size_t len)
+{
+	size_t iterations = BENCH_BYTES / len;
+	double start;
+	size_t i;
+
+	if (iterations < BENCH_MIN_ITERATIONS)
+		iterations = BENCH_MIN_ITERATIONS;
+
+	/* Warm up: first call allocates the operation and loads the key */
+	variant->run(b, len);
+
+	start = now_us();
+	for (i = 0; i < iterations; i++)
+		variant->run(b, len);
+
+	return (double)iterations * len / (now_us() - start);
+}
+
+static void bench_ae(struct bench_ctx *b)
+{
+	static const size_t sizes[] = {
+		1024, 4096, 16384, 65536, 262144, BENCH_MAX_SIZE
+	};
+	const struct bench_variant variants[] = {
+		{ "GCM", run_gcm },
+		{ "CTR + CMAC", run_ctr_mac },
+		{ "EtM CTR+CMAC", run_etm_cmac },
+		{ "EtM CTR+HMAC", run_etm_hmac },
+	};
+	const size_t num_variants = sizeof(variants) / sizeof(variants[0]);
+	size_t s;
+	size_t v;
+
+	prepare_gcm(b);
+	prepare_mac(b, MAC_CTX_CMAC, TA_AES_MAC_CMAC, 0);
+	prepare_mac(b, MAC_CTX_ETM_CMAC, TA_AES_MAC_CMAC, 1);
+	prepare_mac(b, MAC_CTX_ETM_HMAC, TA_AES_MAC_HMAC_SHA256, 1);
+
+	printf("authenticated encryption, 128 bit key\n%-8s", "bytes");
+	for (v = 0; v < num_variants; v++)
+		printf(" %-14s", variants[v].name);
+	printf("   [MB/s]\n");
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		printf("%-8zu", sizes[s]);
+		for (v = 0; v < num_variants; v++)
+			printf(" %-14.1f", bench(b, &variants[v], sizes[s]));
+		printf("\n");
+	}
+	printf("\n");
+}
+
+/* PREPARE, SET_KEY and SET_IV of the CTR session for a new stream */
+static void prepare_stream(struct bench_ctx *b)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE);
+	op.params[0].value.a = TA_AES_ALGO_CTR;
+	op.params[1].value.a = sizeof(b->key);
+	op.params[2].value.a = TA_AES_MODE_ENCODE;
+	invoke(&b->ctr, TA_AES_CMD_PREPARE, &op, "PREPARE");
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = b->key;
+	op.params[0].tmpref.size = sizeof(b->key);
+	invoke(&b->ctr, TA_AES_CMD_SET_KEY, &op, "SET_KEY");
+
+	op.params[0].tmpref.buffer = b->iv;
+	op.params[0].tmpref.size = sizeof(b->iv);
+	invoke(&b->ctr, TA_AES_CMD_SET_IV, &op, "SET_IV");
+}
+
+static int temp_file(void)
+{
+	const char *dir = getenv("TMPDIR");
+	char path[256];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/aes_bench.XXXXXX", dir ? dir : "/tmp");
+	fd = mkstemp(path);
+	if (fd < 0)
+		err(1, "%s", path);
+	unlink(path);
+
+	return fd;
+}
+
+/* File to file CTR streaming over chunk size and number of buffers */
+static void bench_stream(struct bench_ctx *b)
+{
+	static const size_t chunks[] = {
+		4096, 16384, 65536, 262144, 1024 * 1024
+	};
+	static const size_t buffers[] = { 1, 2, 3, 4 };
+	TEEC_Result res;
+	double start;
+	size_t done;
+	size_t c;
+	size_t n;
+	int in_fd;
+	int out_fd;
+
+	in_fd = temp_file();
+	out_fd = temp_file();
+
+	for (done = 0; done < STREAM_BYTES; done += BENCH_MAX_SIZE)
+		if (write(in_fd, b->in, BENCH_MAX_SIZE) != BENCH_MAX_SIZE)
+			err(1, "write");
+
+	printf("file streaming, %d MiB, AES-CTR 128 bit key\n%-8s",
+	       STREAM_BYTES >> 20, "chunk");
+	for (n = 0; n < sizeof(buffers) / sizeof(buffers[0]); n++)
+		printf(" %zu buffer%-7s", buffers[n], buffers[n] > 1 ? "s" : "");
+	printf("   [MB/s]\n");
+
+	for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+		printf("%-8zu", chunks[c]);
+		for (n = 0; n < sizeof(buffers) / sizeof(buffers[0]); n++) {
+			if (lseek(in_fd, 0, SEEK_SET) || ftruncate(out_fd, 0) ||
+			    lseek(out_fd, 0, SEEK_SET))
+				err(1, "rewind");
+
+			prepare_stream(b);
+
+			start = now_us();
+			res = aes_stream(&b->ctx, &b->ctr, in_fd, out_fd,
+					 chunks[c], buffers[n]);
+			if (res == TEEC_ERROR_GENERIC)
+				err(1, "aes_stream");
+			if (res != TEEC_SUCCESS)
+				errx(1, "aes_stream failed 0x%x", res);
+
+			printf(" %-15.1f", STREAM_BYTES / (now_us() - start));
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	close(out_fd);
+	close(in_fd);
+}
+
+/* File to file CTR over the number of threads, one session each */
+static void bench_parallel(struct bench_ctx *b)
+{
+	static const size_t threads[] = { 1, 2, 3, 4, 6, 8 };
+	struct aes_parallel_job job;
+	TEEC_Result res;
+	double single = 0;
+	double mbps;
+	double start;
+	size_t done;
+	size_t n;
+
+	memset(&job, 0, sizeof(job));
+	job.key = b->key;
+	job.key_size = sizeof(b->key);
+	job.iv = (const uint8_t *)b->iv;
+	job.encode = TA_AES_MODE_ENCODE;
+	job.chunk_size = AES_STREAM_CHUNK_SIZE;
+	job.in_fd = temp_file();
+	job.out_fd = temp_file();
+
+	for (done = 0; done < STREAM_BYTES; done += BENCH_MAX_SIZE)
+		if (write(job.in_fd, b->in, BENCH_MAX_SIZE) != BENCH_MAX_SIZE)
+			err(1, "write");
+
+	printf("parallel file CTR, %d MiB, %d KiB chunks, 128 bit key\n",
+	       STREAM_BYTES >> 20, AES_STREAM_CHUNK_SIZE >> 10);
+	printf("%-8s %-15s %-15s\n", "threads", "[MB/s]", "speedup");
+
+	for (n = 0; n < sizeof(threads) / sizeof(threads[0]); n++) {
+		start = now_us();
+		res = aes_ctr_parallel(&b->ctx, &job, threads[n]);
+		if (res == TEEC_ERROR_GENERIC)
+			err(1, "aes_ctr_parallel");
+		if (res != TEEC_SUCCESS)
+			errx(1, "aes_ctr_parallel failed 0x%x", res);
+
+		mbps = STREAM_BYTES / (now_us() - start);
+		if (!single)
+			single = mbps;
+		printf("%-8zu %-15.1f %-15.2f\n", threads[n], mbps,
+		       mbps / single);
+	}
+	printf("\n");
+
+	close(job.out_fd);
+	close(job.in_fd);
+}
+
+/*
+ * MB/s of CTR over BENCH_BYTES in packets of packet_size bytes, each with
+ * its own counter: one ONESHOT request per packet when batch is 0, else
+ * one in place CIPHER_PACKETS request per batch packets.
+ */
+static double bench_packet_batch(struct bench_ctx *b,
+				 struct ta_aes_packet *packets,
+				 size_t packet_size, size_t batch)
+{
+	size_t per_request = batch ? batch : 1;
+	size_t len = packet_size * per_request;
+	size_t iterations = BENCH_BYTES / len;
+	TEEC_Operation op;
+	double start;
+	size_t i;
+
+	if (iterations < BENCH_MIN_ITERATIONS)
+		iterations = BENCH_MIN_ITERATIONS;
+
+	for (i = 0; i < per_request; i++) {
+		packets[i].offset = i * packet_size;
+		packets[i].length = packet_size;
+		memcpy(packets[i].iv, b->iv, sizeof(b->iv));
+		packets[i].iv[0] = i;
+	}
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		if (!batch) {
+			oneshot(b, &b->ctr, TA_AES_ALGO_CTR, b->in, b->out,
+				packet_size);
+			continue;
+		}
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_MEMREF_TEMP_INOUT,
+						 TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = packets;
+		op.params[0].tmpref.size = batch * sizeof(*packets);
+		op.params[1].tmpref.buffer = b->out;
+		op.params[1].tmpref.size = len;
+		invoke(&b->ctr, TA_AES_CMD_CIPHER_PACKETS, &op,
+		       "CIPHER_PACKETS");
+	}
+
+	return (double)iterations * len / (now_us() - start);
+}
+
+static void bench_packets(struct bench_ctx *b)
+{
+	static const size_t packet_sizes[] = { 64, 256, 1500 };
+	static const size_t batches[] = { 0, 4, 16, 64, PACKETS_MAX };
+	struct ta_aes_packet *packets;
+	char label[32];
+	size_t s;
+	size_t n;
+
+	packets = calloc(PACKETS_MAX, sizeof(*packets));
+	if (!packets)
+		err(1, "calloc");
+
+	prepare_stream(b);
+
+	printf("CTR packets with their own counter, 128 bit key\n%-8s",
+	       "packet");
+	for (n = 0; n < sizeof(batches) / sizeof(batches[0]); n++) {
+		if (batches[n])
+			snprintf(label, sizeof(label), "batch %zu", batches[n]);
+		else
+			snprintf(label, sizeof(label), "one by one");
+		printf(" %-12s", label);
+	}
+	printf("   [MB/s]\n");
+
+	for (s = 0; s < sizeof(packet_sizes) / sizeof(packet_sizes[0]); s++) {
+		snprintf(label, sizeof(label), "%zu B", packet_sizes[s]);
+		printf("%-8s", label);
+		for (n = 0; n < sizeof(batches) / sizeof(batches[0]); n++)
+			printf(" %-12.1f",
+			       bench_packet_batch(b, packets, packet_sizes[s],
+						  batches[n]));
+		printf("\n");
+	}
+	printf("\n");
+
+	free(packets);
+}
+
+/* One AES-256-GCM message on the host CPU with the envelope data key */
+static void run_host_gcm(struct bench_ctx *b, size_t len)
+{
+	uint8_t tag[AES_ENVELOPE_TAG_SIZE];
+	EVP_CIPHER_CTX *gcm;
+	int out_len;
+
+	gcm = EVP_CIPHER_CTX_new();
+	if (!gcm ||
+	    EVP_EncryptInit_ex(gcm, EVP_aes_256_gcm(), NULL, b->env_key,
+			       b->env_hdr.nonce) != 1 ||
+	    EVP_EncryptUpdate(gcm, (uint8_t *)b->out, &out_len,
+			      (uint8_t *)b->in, len) != 1 ||
+	    EVP_EncryptFinal_ex(gcm, (uint8_t *)b->out + out_len,
+				&out_len) != 1 ||
+	    EVP_CIPHER_CTX_ctrl(gcm, EVP_CTRL_GCM_GET_TAG, sizeof(tag),
+				tag) != 1)
+		errx(1, "host AES-GCM failed");
+	EVP_CIPHER_CTX_free(gcm);
+}
+
+/* Unwrap the data key from the header as for a new file, then the GCM */
+static void run_unwrap_gcm(struct bench_ctx *b, size_t len)
+{
+	TEEC_Result res;
+
+	res = aes_envelope_get_key(&b->env, &b->env_hdr, b->env_key);
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_envelope_get_key failed 0x%x", res);
+
+	run_host_gcm(b, len);
+}
+
+static void bench_envelope(struct bench_ctx *b)
+{
+	static const size_t sizes[] = {
+		1024, 4096, 16384, 65536, 262144, BENCH_MAX_SIZE
+	};
+	const struct bench_variant variants[] = {
+		{ "TA GCM", run_gcm },
+		{ "unwrap + host", run_unwrap_gcm },
+		{ "host GCM", run_host_gcm },
+	};
+	const size_t num_variants = sizeof(variants) / sizeof(variants[0]);
+	TEEC_Operation op;
+	TEEC_Result res;
+	double start;
+	size_t done;
+	size_t s;
+	size_t v;
+	int in_fd;
+	int out_fd;
+
+	/* KEK generated once, data key as for one envelope */
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = ENVELOPE_KEK_ID;
+	op.params[0].tmpref.size = strlen(ENVELOPE_KEK_ID);
+	op.params[1].value.a = TA_AES_SIZE_256BIT;
+	invoke(&b->env, TA_AES_CMD_KEY_GENERATE, &op, "KEY_GENERATE");
+
+	res = aes_envelope_new_key(&b->env, ENVELOPE_KEK_ID, &b->env_hdr,
+				   b->env_key);
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_envelope_new_key failed 0x%x", res);
+
+	prepare_gcm(b);
+
+	printf("envelope encryption against GCM in the TA (128 bit key), "
+	       "host GCM 256 bit key\n%-8s", "bytes");
+	for (v = 0; v < num_variants; v++)
+		printf(" %-14s", variants[v].name);
+	printf("   [MB/s]\n");
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		printf("%-8zu", sizes[s]);
+		for (v = 0; v < num_variants; v++)
+			printf(" %-14.1f", bench(b, &variants[v], sizes[s]));
+		printf("\n");
+	}
+
+	in_fd = temp_file();
+	out_fd = temp_file();
+
+	for (done = 0; done < STREAM_BYTES; done += BENCH_MAX_SIZE)
+		if (write(in_fd, b->in, BENCH_MAX_SIZE) != BENCH_MAX_SIZE)
+			err(1, "write");
+
+	printf("file, %d MiB: ", STREAM_BYTES >> 20);
+
+	prepare_stream(b);
+	start = now_us();
+	res = aes_stream(&b->ctx, &b->ctr, in_fd, out_fd, BENCH_MAX_SIZE,
+			 AES_STREAM_BUFFERS);
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "aes_stream");
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_stream failed 0x%x", res);
+	printf("TA CTR stream %.1f MB/s, ", STREAM_BYTES / (now_us() - start));
+
+	if (lseek(in_fd, 0, SEEK_SET) || ftruncate(out_fd, 0) ||
+	    lseek(out_fd, 0, SEEK_SET))
+		err(1, "rewind");
+
+	start = now_us();
+	res = aes_envelope_encrypt(&b->env, ENVELOPE_KEK_ID, in_fd, out_fd);
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "aes_envelope_encrypt");
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_envelope_encrypt failed 0x%x", res);
+	printf("envelope %.1f MB/s\n\n", STREAM_BYTES / (now_us() - start));
+
+	memset(b->env_key, 0, sizeof(b->env_key));
+	close(out_fd);
+	close(in_fd);
+}
+
+/* PREPARE and SET_KEY of the XTS session, two 128 bit keys */
+static void prepare_xts(struct bench_ctx *b)
+{
+	char xts_key[2 * TA_AES_SIZE_128BIT];
+	TEEC_Operation op;
+
+	memset(xts_key, 0xa5, sizeof(xts_key) / 2); /* Load some dummy value */
+	memset(xts_key + sizeof(xts_key) / 2, 0x5a, sizeof(xts_key) / 2);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE);
+	op.params[0].value.a = TA_AES_ALGO_XTS;
+	op.params[1].value.a = TA_AES_SIZE_128BIT;
+	op.params[2].value.a = TA_AES_MODE_ENCODE;
+	invoke(&b->xts, TA_AES_CMD_PREPARE, &op, "PREPARE");
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = xts_key;
+	op.params[0].tmpref.size = sizeof(xts_key);
+	invoke(&b->xts, TA_AES_CMD_SET_KEY, &op, "SET_KEY");
+}
+
+/* MB/s of in place XTS over BENCH_BYTES in batches of sectors */
+static double bench_xts_batch(struct bench_ctx *b, size_t sector_size,
+			      size_t batch)
+{
+	size_t len = sector_size * batch;
+	size_t iterations = BENCH_BYTES / len;
+	uint64_t sector = 0;
+	TEEC_Operation op;
+	double start;
+	size_t i;
+
+	if (iterations < BENCH_MIN_ITERATIONS)
+		iterations = BENCH_MIN_ITERATIONS;
+
+	start = now_us();
+	for (i = 0; i < iterations; i++, sector += batch) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_MEMREF_TEMP_INOUT,
+						 TEEC_NONE);
+		op.params[0].value.a = sector;
+		op.params[0].value.b = sector >> 32;
+		op.params[1].value.a = sector_size;
+		op.params[2].tmpref.buffer = b->out;
+		op.params[2].tmpref.size = len;
+		invoke(&b->xts, TA_AES_CMD_XTS_SECTORS, &op, "XTS_SECTORS");
+	}
+
+	return (double)iterations * len / (now_us() - start);
+}
+
+static void bench_xts(struct bench_ctx *b)
+{
+	static const size_t sector_sizes[] = { 512, 4096 };
+	static const size_t batches[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+	char label[16];
+	size_t s;
+	size_t n;
+
+	prepare_xts(b);
+
+	printf("XTS sector batches, in place, 2 x 128 bit keys\n%-8s",
+	       "batch");
+	for (s = 0; s < sizeof(sector_sizes) / sizeof(sector_sizes[0]); s++) {
+		snprintf(label, sizeof(label), "%zu B sectors", sector_sizes[s]);
+		printf(" %-15s", label);
+	}
+	printf("   [MB/s]\n");
+
+	for (n = 0; n < sizeof(batches) / sizeof(batches[0]); n++) {
+		printf("%-8zu", batches[n]);
+		for (s = 0; s < sizeof(sector_sizes) / sizeof(sector_sizes[0]);
+		     s++)
+			printf(" %-15.1f",
+			       bench_xts_batch(b, sector_sizes[s], batches[n]));
+		printf("\n");
+	}
+	printf("\n");
+}
+
+/* PREPARE, SET_KEY and SET_IV (but for ECB) of the sweep session */
+static void prepare_sweep(struct bench_ctx *b, uint32_t algo,
+			  size_t key_size)
+{
+	char key[TA_AES_SIZE_256BIT];
+	TEEC_Operation op;
+
+	memset(key, 0xa5, sizeof(key)); /* Load some dummy value */
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE);
+	op.params[0].value.a = algo;
+	op.params[1].value.a = key_size;
+	op.params[2].value.a = TA_AES_MODE_ENCODE;
+	invoke(&b->sweep, TA_AES_CMD_PREPARE, &op, "PREPARE");
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = key;
+	op.params[0].tmpref.size = key_size;
+	invoke(&b->sweep, TA_AES_CMD_SET_KEY, &op, "SET_KEY");
+
+	if (algo == TA_AES_ALGO_ECB)
+		return;
+
+	op.params[0].tmpref.buffer = b->iv;
+	op.params[0].tmpref.size = sizeof(b->iv);
+	invoke(&b->sweep, TA_AES_CMD_SET_IV, &op, "SET_IV");
+}
+
+/*
+ * Microseconds per in place CIPHER of len bytes, from a temporary
+ * reference when shm is NULL, else from the shared memory, measured over
+ * at least SWEEP_MIN_US.
+ */
+static double sweep_invoke_us(struct bench_ctx *b, TEEC_SharedMemory *shm,
+			      size_t len)
+{
+	TEEC_Operation op;
+	size_t iterations = 0;
+	double elapsed;
+	double start;
+
+	memset(&op, 0, sizeof(op));
+	if (shm) {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INOUT,
+						 TEEC_NONE, TEEC_NONE,
+						 TEEC_NONE);
+		op.params[0].memref.parent = shm;
+	} else {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INOUT,
+						 TEEC_NONE, TEEC_NONE,
+						 TEEC_NONE);
+		op.params[0].tmpref.buffer = b->out;
+	}
+
+	/* Warm up, then time */
+	op.params[0].tmpref.size = len;
+	op.params[0].memref.size = len;
+	invoke(&b->sweep, TA_AES_CMD_CIPHER, &op, "CIPHER");
+
+	start = now_us();
+	do {
+		if (shm)
+			op.params[0].memref.size = len;
+		else
+			op.params[0].tmpref.size = len;
+		invoke(&b->sweep, TA_AES_CMD_CIPHER, &op, "CIPHER");
+		iterations++;
+		elapsed = now_us() - start;
+	} while (iterations < BENCH_MIN_ITERATIONS || elapsed < SWEEP_MIN_US);
+
+	return elapsed / iterations;
+}
+
+/*
+ * Intercept of the least squares fit of us against len, the cost of an
+ * empty invoke. Weighted by 1 / us^2 since the timing noise is relative,
+ * else the noise of the large buffers would swamp the small intercept.
+ */
+static double fit_intercept(const size_t *len, const double *us, size_t n)
+{
+	double s = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	double slope;
+	double w;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		w = 1 / (us[i] * us[i]);
+		s += w;
+		sx += w * len[i];
+		sy += w * us[i];
+		sxx += w * len[i] * len[i];
+		sxy += w * len[i] * us[i];
+	}
+
+	slope = (s * sxy - sx * sy) / (s * sxx - sx * sx);
+	return (sy - slope * sx) / s;
+}
+
+/* CSV rows of the sweep session as prepared, shm NULL for temporary */
+static void sweep_rows(struct bench_ctx *b, TEEC_SharedMemory *shm,
+		       const char *prefix, const char *shm_name)
+{
+	size_t len[SWEEP_SIZES];
+	double us[SWEEP_SIZES];
+	double overhead_us;
+	size_t n;
+
+	for (n = 0; n < SWEEP_SIZES; n++) {
+		len[n] = (size_t)SWEEP_MIN_SIZE << (2 * n);
+		us[n] = sweep_invoke_us(b, shm, len[n]);
+	}
+
+	overhead_us = fit_intercept(len, us, SWEEP_SIZES);
+
+	for (n = 0; n < SWEEP_SIZES; n++)
+		printf("%s,%zu,%s,%.2f,%.1f,%.2f\n", prefix, len[n], shm_name,
+		       us[n], len[n] / us[n], overhead_us);
+}
+
+/*
+ * CSV of CIPHER over algorithm, key size, buffer size and kind of shared
+ * memory. overhead_us is the per invoke cost of the configuration, the
+ * intercept of a fit of its time against its buffer size.
+ */
+static void bench_sweep(struct bench_ctx *b)
+{
+	static const uint32_t algos[] = {
+		TA_AES_ALGO_ECB, TA_AES_ALGO_CBC, TA_AES_ALGO_CTR
+	};
+	static const char *const algo_names[] = { "ECB", "CBC", "CTR" };
+	static const size_t key_sizes[] = {
+		TA_AES_SIZE_128BIT, TA_AES_SIZE_256BIT
+	};
+	const char *shm_name = "registered";
+	TEEC_SharedMemory shm;
+	TEEC_Result res;
+	char prefix[16];
+	size_t a;
+	size_t k;
+
+	memset(&shm, 0, sizeof(shm));
+	shm.buffer = b->out;
+	shm.size = BENCH_MAX_SIZE;
+	shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	res = TEEC_RegisterSharedMemory(&b->ctx, &shm);
+	if (res != TEEC_SUCCESS) {
+		/* No dynamic shared memory, use the reserved pool */
+		memset(&shm, 0, sizeof(shm));
+		shm.size = BENCH_MAX_SIZE;
+		shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+		res = TEEC_AllocateSharedMemory(&b->ctx, &shm);
+		if (res != TEEC_SUCCESS)
+			errx(1, "TEEC_AllocateSharedMemory failed 0x%x", res);
+		shm_name = "allocated";
+	}
+
+	printf("algo,key_bits,bytes,shm,us_per_invoke,mb_per_s,overhead_us\n");
+
+	for (a = 0; a < sizeof(algos) / sizeof(algos[0]); a++) {
+		for (k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+			prepare_sweep(b, algos[a], key_sizes[k]);
+
+			snprintf(prefix, sizeof(prefix), "%s,%zu",
+				 algo_names[a], key_sizes[k] * 8);
+			sweep_rows(b, NULL, prefix, "temporary");
+			sweep_rows(b, &shm, prefix, shm_name);
+		}
+	}
+	printf("\n");
+
+	TEEC_ReleaseSharedMemory(&shm);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [ae] [stream] [parallel] [packets] [xts]"
+		" [envelope]"
+		" [sweep]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int run_ae = argc == 1;
+	int run_stream = argc == 1;
+	int run_parallel = argc == 1;
+	int run_packets = argc == 1;
+	int run_xts = argc == 1;
+	int run_envelope = argc == 1;
+	int run_sweep = 0;	/* CSV, on request only */
+	struct bench_ctx b;
+	TEEC_Result res;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "ae"))
+			run_ae = 1;
+		else if (!strcmp(argv[i], "stream"))
+			run_stream = 1;
+		else if (!strcmp(argv[i], "parallel"))
+			run_parallel = 1;
+		else if (!strcmp(argv[i], "packets"))
+			run_packets = 1;
+		else if (!strcmp(argv[i], "xts"))
+			run_xts = 1;
+		else if (!strcmp(argv[i], "envelope"))
+			run_envelope = 1;
+		else if (!strcmp(argv[i], "sweep"))
+			run_sweep = 1;
+		else
+			usage(argv[0]);
+	}
+
+	memset(&b, 0, sizeof(b));
+	memset(b.key, 0xa5, sizeof(b.key)); /* Load some dummy value */
+
+	b.in = malloc(BENCH_MAX_SIZE);
+	b.out = malloc(BENCH_MAX_SIZE);
+	b.scratch = malloc(BENCH_MAX_SIZE + ETM_OVERHEAD);
+	if (!b.in || !b.out || !b.scratch)
+		err(1, "malloc");
+	memset(b.in, 0x5a, BENCH_MAX_SIZE);
+
+	res = TEEC_InitializeContext(NULL, &b.ctx);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	open_session(&b, &b.gcm, TEEC_LOGIN_PUBLIC);
+	open_session(&b, &b.ctr, TEEC_LOGIN_PUBLIC);
+	open_session(&b, &b.mac, TEEC_LOGIN_PUBLIC);
+	open_session(&b, &b.xts, TEEC_LOGIN_PUBLIC);
+	open_session(&b, &b.env, TEEC_LOGIN_USER);
+	open_session(&b, &b.sweep, TEEC_LOGIN_PUBLIC);
+
+	if (run_ae)
+		bench_ae(&b);
+	if (run_stream)
+		bench_stream(&b);
+	if (run_parallel)
+		bench_parallel(&b);
+	if (run_packets)
+		bench_packets(&b);
+	if (run_xts)
+		bench_xts(&b);
+	if (run_envelope)
+		bench_envelope(&b);
+	if (run_sweep)
+		bench_sweep(&b);
+
+	TEEC_CloseSession(&b.sweep);
+	TEEC_CloseSession(&b.env);
+	TEEC_CloseSession(&b.xts);
+	TEEC_CloseSession(&b.mac);
+	TEEC_CloseSession(&b.ctr);
+	TEEC_CloseSession(&b.gcm);
+	TEEC_FinalizeContext(&b.ctx);
+	free(b.scratch);
+	free(b.out);
+	free(b.in);
+	return 0;
+}
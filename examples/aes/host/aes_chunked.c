@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aes_chunked.h"
+
+static uint64_t get_le(const uint8_t *p, size_t size)
+{
+	uint64_t v = 0;
+
+	while (size--)
+		v = (v << 8) | p[size];
+
+	return v;
+}
+
+static void put_le(uint8_t *p, size_t size, uint64_t v)
+{
+	size_t n;
+
+	for (n = 0; n < size; n++, v >>= 8)
+		p[n] = v;
+}
+
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, (char *)buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		if (!n)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *pos = buf;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, pos, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static TEEC_Result invoke(TEEC_Session *sess, uint32_t cmd,
+			  TEEC_Operation *op)
+{
+	uint32_t origin;
+
+	return TEEC_InvokeCommand(sess, cmd, op, &origin);
+}
+
+/* PREPARE context 0 for GCM with the stored key */
+static TEEC_Result prepare_gcm(TEEC_Session *sess, const uint8_t *key_id,
+			       size_t key_id_len, uint32_t mode)
+{
+	TEEC_Operation op;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE);
+	op.params[0].value.a = TA_AES_ALGO_GCM;
+	op.params[1].value.a = AES_CHUNKED_KEY_SIZE;
+	op.params[2].value.a = mode;
+	res = invoke(sess, TA_AES_CMD_PREPARE, &op);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)key_id;
+	op.params[0].tmpref.size = key_id_len;
+	return invoke(sess, TA_AES_CMD_SET_KEY_ID, &op);
+}
+
+/*
+ * AE_INIT, AE_UPDATE_AAD and AE_xxx_FINAL of chunk n. The tag follows
+ * the cipher text in cipher.
+ */
+static TEEC_Result cipher_chunk(TEEC_Session *sess, int encode,
+				const struct aes_chunked_header *hdr,
+				const struct aes_chunked_entry *entry,
+				uint32_t n, void *clear, void *cipher)
+{
+	uint8_t aad[sizeof(*hdr) + sizeof(*entry)];
+	uint8_t nonce[AES_CHUNKED_NONCE_SIZE];
+	size_t len = get_le(entry->length, sizeof(entry->length));
+	TEEC_Operation op;
+	TEEC_Result res;
+
+	memcpy(nonce, hdr->file_id, sizeof(hdr->file_id));
+	nonce[8] = n >> 24;
+	nonce[9] = n >> 16;
+	nonce[10] = n >> 8;
+	nonce[11] = n;
+
+	memcpy(aad, hdr, sizeof(*hdr));
+	memcpy(aad + sizeof(*hdr), entry, sizeof(*entry));
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = nonce;
+	op.params[0].tmpref.size = sizeof(nonce);
+	op.params[1].value.a = AES_CHUNKED_TAG_SIZE;
+	op.params[1].value.b = sizeof(aad);
+	op.params[2].value.a = len;
+	res = invoke(sess, TA_AES_CMD_AE_INIT, &op);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = aad;
+	op.params[0].tmpref.size = sizeof(aad);
+	res = invoke(sess, TA_AES_CMD_AE_UPDATE_AAD, &op);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 encode ? TEEC_MEMREF_TEMP_OUTPUT :
+						  TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = encode ? clear : cipher;
+	op.params[0].tmpref.size = len;
+	op.params[1].tmpref.buffer = encode ? cipher : clear;
+	op.params[1].tmpref.size = len;
+	op.params[2].tmpref.buffer = (uint8_t *)cipher + len;
+	op.params[2].tmpref.size = AES_CHUNKED_TAG_SIZE;
+	return invoke(sess, encode ? TA_AES_CMD_AE_ENCRYPT_FINAL :
+				     TA_AES_CMD_AE_DECRYPT_FINAL, &op);
+}
+
+TEEC_Result aes_chunked_encrypt(TEEC_Session *sess, const char *key_id,
+				size_t chunk_size, int in_fd, int out_fd)
+{
+	size_t key_id_len = strlen(key_id);
+	struct aes_chunked_entry *index = NULL;
+	struct aes_chunked_header hdr;
+	TEEC_Result res;
+	uint8_t *clear = NULL;
+	uint8_t *cipher = NULL;
+	uint64_t count;
+	uint64_t offset;
+	struct stat st;
+	uint32_t n;
+	size_t len;
+	ssize_t r;
+
+	if (!chunk_size || chunk_size > AES_CHUNKED_MAX_CHUNK ||
+	    !key_id_len || key_id_len > TA_AES_KEY_ID_MAX_SIZE)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	if (fstat(in_fd, &st))
+		return TEEC_ERROR_GENERIC;
+
+	count = ((uint64_t)st.st_size + chunk_size - 1) / chunk_size;
+	if (count > UINT32_MAX)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, AES_CHUNKED_MAGIC, sizeof(hdr.magic));
+	put_le(hdr.chunk_size, sizeof(hdr.chunk_size), chunk_size);
+	put_le(hdr.chunk_count, sizeof(hdr.chunk_count), count);
+	put_le(hdr.clear_size, sizeof(hdr.clear_size), st.st_size);
+	memcpy(hdr.key_id, key_id, key_id_len);
+	hdr.key_id_len = key_id_len;
+
+	/* Only the pair of file ID and chunk number shall be unique */
+	if (getentropy(hdr.file_id, sizeof(hdr.file_id)))
+		return TEEC_ERROR_GENERIC;
+
+	res = prepare_gcm(sess, hdr.key_id, key_id_len, TA_AES_MODE_ENCODE);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	res = TEEC_ERROR_OUT_OF_MEMORY;
+	index = calloc(count ? count : 1, sizeof(*index));
+	clear = malloc(chunk_size);
+	cipher = malloc(chunk_size + AES_CHUNKED_TAG_SIZE);
+	if (!index || !clear || !cipher)
+		goto out;
+
+	offset = sizeof(hdr) + count * sizeof(*index);
+	for (n = 0; n < count; n++) {
+		len = chunk_size;
+		if (n == count - 1)
+			len = st.st_size - (uint64_t)n * chunk_size;
+		put_le(index[n].offset, sizeof(index[n].offset), offset);
+		put_le(index[n].length, sizeof(index[n].length), len);
+		offset += len + AES_CHUNKED_TAG_SIZE;
+	}
+
+	res = TEEC_ERROR_GENERIC;
+	if (write_full(out_fd, &hdr, sizeof(hdr)) ||
+	    write_full(out_fd, index, count * sizeof(*index)))
+		goto out;
+
+	for (n = 0; n < count; n++) {
+		len = get_le(index[n].length, sizeof(index[n].length));
+		r = read_full(in_fd, clear, len);
+		if (r >= 0 && (size_t)r != len)
+			errno = EIO;	/* the file shrank since fstat() */
+		if ((size_t)r != len) {
+			res = TEEC_ERROR_GENERIC;
+			goto out;
+		}
+
+		res = cipher_chunk(sess, 1, &hdr, &index[n], n, clear, cipher);
+		if (res != TEEC_SUCCESS)
+			goto out;
+
+		res = TEEC_ERROR_GENERIC;
+		if (write_full(out_fd, cipher, len + AES_CHUNKED_TAG_SIZE))
+			goto out;
+	}
+
+	res = TEEC_SUCCESS;
+out:
+	free(cipher);
+	free(clear);
+	free(index);
+	return res;
+}
+
+TEEC_Result aes_chunked_open(struct aes_chunked *f, TEEC_Session *sess,
+			     int fd)
+{
+	TEEC_Result res = TEEC_ERROR_BAD_FORMAT;
+	size_t index_size;
+	ssize_t n;
+
+	memset(f, 0, sizeof(*f));
+	f->sess = sess;
+	f->fd = fd;
+
+	n = pread(fd, &f->hdr, sizeof(f->hdr), 0);
+	if (n < 0)
+		return TEEC_ERROR_GENERIC;
+
+	f->chunk_size = get_le(f->hdr.chunk_size, sizeof(f->hdr.chunk_size));
+	f->chunk_count = get_le(f->hdr.chunk_count,
+				sizeof(f->hdr.chunk_count));
+	f->clear_size = get_le(f->hdr.clear_size, sizeof(f->hdr.clear_size));
+
+	if (n != sizeof(f->hdr) ||
+	    memcmp(f->hdr.magic, AES_CHUNKED_MAGIC, sizeof(f->hdr.magic)) ||
+	    !f->chunk_size || f->chunk_size > AES_CHUNKED_MAX_CHUNK ||
+	    f->clear_size > (uint64_t)f->chunk_count * f->chunk_size ||
+	    !f->hdr.key_id_len || f->hdr.key_id_len > TA_AES_KEY_ID_MAX_SIZE)
+		return TEEC_ERROR_BAD_FORMAT;
+
+	index_size = (size_t)f->chunk_count * sizeof(*f->index);
+	f->index = malloc(index_size ? index_size : 1);
+	f->buf = malloc(f->chunk_size + AES_CHUNKED_TAG_SIZE);
+	if (!f->index || !f->buf) {
+		res = TEEC_ERROR_OUT_OF_MEMORY;
+		goto err;
+	}
+
+	n = pread(fd, f->index, index_size, sizeof(f->hdr));
+	if (n < 0) {
+		res = TEEC_ERROR_GENERIC;
+		goto err;
+	}
+	if ((size_t)n != index_size)
+		goto err;
+
+	res = prepare_gcm(sess, f->hdr.key_id, f->hdr.key_id_len,
+			  TA_AES_MODE_DECODE);
+	if (res != TEEC_SUCCESS)
+		goto err;
+
+	return TEEC_SUCCESS;
+err:
+	aes_chunked_close(f);
+	return res;
+}
+
+TEEC_Result aes_chunked_read_chunk(struct aes_chunked *f, uint32_t n,
+				   void *buf, size_t *len)
+{
+	const struct aes_chunked_entry *entry;
+	uint64_t offset;
+	size_t cipher_len;
+	TEEC_Result res;
+	ssize_t r;
+
+	if (n >= f->chunk_count)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	/* Entries are authenticated with their chunk, check bounds only */
+	entry = &f->index[n];
+	offset = get_le(entry->offset, sizeof(entry->offset));
+	*len = get_le(entry->length, sizeof(entry->length));
+	if (*len > f->chunk_size)
+		return TEEC_ERROR_BAD_FORMAT;
+
+	cipher_len = *len + AES_CHUNKED_TAG_SIZE;
+	r = pread(f->fd, f->buf, cipher_len, offset);
+	if (r < 0)
+		return TEEC_ERROR_GENERIC;
+	if ((size_t)r != cipher_len)
+		return TEEC_ERROR_BAD_FORMAT;
+
+	res = cipher_chunk(f->sess, 0, &f->hdr, entry, n, buf, f->buf);
+	if (res != TEEC_SUCCESS)
+		*len = 0;
+
+	return res;
+}
+
+TEEC_Result aes_chunked_pread(struct aes_chunked *f, void *buf, size_t len,
+			      uint64_t offset, size_t *read_len)
+{
+	uint8_t *clear = NULL;
+	uint8_t *dst = buf;
+	TEEC_Result res;
+	size_t chunk_len;
+	size_t skip;
+	size_t part;
+	uint32_t n;
+
+	*read_len = 0;
+	if (offset >= f->clear_size)
+		return TEEC_SUCCESS;
+	if (len > f->clear_size - offset)
+		len = f->clear_size - offset;
+
+	clear = malloc(f->chunk_size);
+	if (!clear)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	n = offset / f->chunk_size;
+	skip = offset % f->chunk_size;
+	while (*read_len < len) {
+		res = aes_chunked_read_chunk(f, n++, clear, &chunk_len);
+		if (res != TEEC_SUCCESS)
+			goto out;
+		if (chunk_len <= skip) {
+			res = TEEC_ERROR_BAD_FORMAT;
+			goto out;
+		}
+
+		part = chunk_len - skip;
+		if (part > len - *read_len)
+			part = len - *read_len;
+		memcpy(dst + *read_len, clear + skip, part);
+		*read_len += part;
+		skip = 0;
+	}
+
+	res = TEEC_SUCCESS;
+out:
+	free(clear);
+	return res;
+}
+
+void aes_chunked_close(struct aes_chunked *f)
+{
+	free(f->buf);
+	free(f->index);
+	f->buf = NULL;
+	f->index = NULL;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AES_CHUNKED_H
+#define AES_CHUNKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tee_client_api.h>
+
+#include <aes_ta.h>
+
+/*
+ * Chunked AES-GCM container for random access: the clear text is cut in
+ * chunks of chunk_size bytes (the last one shorter), each encrypted by the
+ * TA on its own with a key of the TA key store. Layout:
+ *
+ *   struct aes_chunked_header
+ *   struct aes_chunked_entry[chunk_count]	index
+ *   chunk 0: cipher text || tag
+ *   ...
+ *
+ * The nonce of chunk i is the file ID followed by i (32 bit big endian),
+ * so chunks cannot be swapped. The AAD of chunk i is the header followed
+ * by its index entry: the header and the entry are authenticated with
+ * every chunk, a truncated or extended file fails on the chunk count.
+ */
+#define AES_CHUNKED_MAGIC	"OPTEEAC1"
+#define AES_CHUNKED_KEY_SIZE	TA_AES_SIZE_256BIT
+#define AES_CHUNKED_NONCE_SIZE	12
+#define AES_CHUNKED_TAG_SIZE	16
+#define AES_CHUNKED_CHUNK_SIZE	(64 * 1024)
+#define AES_CHUNKED_MAX_CHUNK	(1024 * 1024)
+
+/* Byte fields only, integers little endian */
+struct aes_chunked_header {
+	char magic[8];			/* AES_CHUNKED_MAGIC */
+	uint8_t chunk_size[4];		/* clear bytes per chunk */
+	uint8_t chunk_count[4];
+	uint8_t clear_size[8];
+	uint8_t file_id[8];		/* random, nonce prefix */
+	uint8_t key_id_len;
+	uint8_t reserved[3];		/* zero */
+	uint8_t key_id[TA_AES_KEY_ID_MAX_SIZE];
+};
+
+struct aes_chunked_entry {
+	uint8_t offset[8];		/* of the cipher text in the file */
+	uint8_t length[4];		/* clear bytes, tag excluded */
+};
+
+/* Container opened for reading */
+struct aes_chunked {
+	TEEC_Session *sess;
+	int fd;
+	struct aes_chunked_header hdr;
+	struct aes_chunked_entry *index;
+	uint32_t chunk_size;
+	uint32_t chunk_count;
+	uint64_t clear_size;
+	uint8_t *buf;			/* one chunk of cipher text and tag */
+};
+
+/*
+ * Encrypt the regular file in_fd into a container written to out_fd
+ * with the stored key key_id of AES_CHUNKED_KEY_SIZE bytes. Uses context
+ * 0 of the session. Nothing is read or written before the key is set, the
+ * call can be repeated on TEEC_ERROR_ITEM_NOT_FOUND (no such key) once the
+ * key is created.
+ *
+ * Returns TEEC_SUCCESS, the TA error, TEEC_ERROR_BAD_PARAMETERS for a bad
+ * chunk size or too many chunks, or TEEC_ERROR_GENERIC on I/O error
+ * (errno set).
+ */
+TEEC_Result aes_chunked_encrypt(TEEC_Session *sess, const char *key_id,
+				size_t chunk_size, int in_fd, int out_fd);
+
+/*
+ * Read the header and index of the container in fd and prepare context
+ * 0 of the session for decrypting its chunks in any order.
+ *
+ * Returns TEEC_SUCCESS, the TA error, TEEC_ERROR_BAD_FORMAT or
+ * TEEC_ERROR_GENERIC on I/O error (errno set).
+ */
+TEEC_Result aes_chunked_open(struct aes_chunked *f, TEEC_Session *sess,
+			     int fd);
+
+/*
+ * Decrypt chunk n into buf of f->chunk_size bytes, *len set to its clear
+ * size. Only this chunk is read. Returns TEEC_ERROR_MAC_INVALID if the
+ * chunk, its index entry or the header was altered.
+ */
+TEEC_Result aes_chunked_read_chunk(struct aes_chunked *f, uint32_t n,
+				   void *buf, size_t *len);
+
+/*
+ * Decrypt len bytes of clear text from offset, reading only the chunks
+ * covering them. *read_len is short at the end of the clear text.
+ */
+TEEC_Result aes_chunked_pread(struct aes_chunked *f, void *buf, size_t len,
+			      uint64_t offset, size_t *read_len);
+
+void aes_chunked_close(struct aes_chunked *f);
+
+#endif /* AES_CHUNKED_H */
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include "aes_envelope.h"
+
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, (char *)buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		if (!n)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *pos = buf;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, pos, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+TEEC_Result aes_envelope_new_key(TEEC_Session *sess, const char *kek_id,
+				 struct aes_envelope_header *hdr,
+				 uint8_t key[AES_ENVELOPE_KEY_SIZE])
+{
+	size_t kek_id_len = strlen(kek_id);
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	if (!kek_id_len || kek_id_len > TA_AES_KEY_ID_MAX_SIZE)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, AES_ENVELOPE_MAGIC, sizeof(hdr->magic));
+	memcpy(hdr->kek_id, kek_id, kek_id_len);
+	hdr->kek_id_len = kek_id_len;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT);
+	op.params[0].tmpref.buffer = hdr->kek_id;
+	op.params[0].tmpref.size = kek_id_len;
+	op.params[1].value.a = AES_ENVELOPE_KEY_SIZE;
+	op.params[2].tmpref.buffer = key;
+	op.params[2].tmpref.size = AES_ENVELOPE_KEY_SIZE;
+	op.params[3].tmpref.buffer = hdr->wrapped;
+	op.params[3].tmpref.size = sizeof(hdr->wrapped);
+
+	res = TEEC_InvokeCommand(sess, TA_AES_CMD_DATA_KEY_GENERATE, &op,
+				 &origin);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	hdr->wrapped_len = op.params[3].tmpref.size;
+
+	if (RAND_bytes(hdr->nonce, sizeof(hdr->nonce)) != 1)
+		return TEEC_ERROR_GENERIC;
+
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result aes_envelope_get_key(TEEC_Session *sess,
+				 const struct aes_envelope_header *hdr,
+				 uint8_t key[AES_ENVELOPE_KEY_SIZE])
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	if (memcmp(hdr->magic, AES_ENVELOPE_MAGIC, sizeof(hdr->magic)) ||
+	    !hdr->kek_id_len || hdr->kek_id_len > sizeof(hdr->kek_id) ||
+	    hdr->wrapped_len != sizeof(hdr->wrapped))
+		return TEEC_ERROR_BAD_FORMAT;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)hdr->kek_id;
+	op.params[0].tmpref.size = hdr->kek_id_len;
+	op.params[1].tmpref.buffer = (void *)hdr->wrapped;
+	op.params[1].tmpref.size = hdr->wrapped_len;
+	op.params[2].tmpref.buffer = key;
+	op.params[2].tmpref.size = AES_ENVELOPE_KEY_SIZE;
+
+	res = TEEC_InvokeCommand(sess, TA_AES_CMD_DATA_KEY_UNWRAP, &op,
+				 &origin);
+	if (res == TEEC_SUCCESS &&
+	    op.params[2].tmpref.size != AES_ENVELOPE_KEY_SIZE)
+		res = TEEC_ERROR_BAD_FORMAT;
+
+	return res;
+}
+
+/* AES-256-GCM context for a container, the header as AAD */
+static EVP_CIPHER_CTX *gcm_init(int encrypt, const uint8_t *key,
+				const struct aes_envelope_header *hdr)
+{
+	EVP_CIPHER_CTX *gcm;
+	int len;
+
+	gcm = EVP_CIPHER_CTX_new();
+	if (!gcm)
+		return NULL;
+
+	if (EVP_CipherInit_ex(gcm, EVP_aes_256_gcm(), NULL, key, hdr->nonce,
+			      encrypt) != 1 ||
+	    EVP_CipherUpdate(gcm, NULL, &len, (const uint8_t *)hdr,
+			     sizeof(*hdr)) != 1) {
+		EVP_CIPHER_CTX_free(gcm);
+		return NULL;
+	}
+
+	return gcm;
+}
+
+TEEC_Result aes_envelope_encrypt(TEEC_Session *sess, const char *kek_id,
+				 int in_fd, int out_fd)
+{
+	uint8_t tag[AES_ENVELOPE_TAG_SIZE];
+	uint8_t key[AES_ENVELOPE_KEY_SIZE];
+	struct aes_envelope_header hdr;
+	TEEC_Result res = TEEC_ERROR_GENERIC;
+	EVP_CIPHER_CTX *gcm = NULL;
+	uint8_t *buf;
+	ssize_t n;
+	int len;
+
+	buf = malloc(AES_ENVELOPE_CHUNK_SIZE);
+	if (!buf)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	res = aes_envelope_new_key(sess, kek_id, &hdr, key);
+	if (res != TEEC_SUCCESS)
+		goto out;
+
+	gcm = gcm_init(1, key, &hdr);
+	OPENSSL_cleanse(key, sizeof(key));
+	if (!gcm) {
+		res = TEEC_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	res = TEEC_ERROR_GENERIC;
+	if (write_full(out_fd, &hdr, sizeof(hdr)))
+		goto out;
+
+	do {
+		n = read_full(in_fd, buf, AES_ENVELOPE_CHUNK_SIZE);
+		if (n < 0)
+			goto out;
+
+		/* GCM cipher text is as long as the clear text */
+		if (EVP_EncryptUpdate(gcm, buf, &len, buf, n) != 1 ||
+		    write_full(out_fd, buf, len))
+			goto out;
+	} while (n == AES_ENVELOPE_CHUNK_SIZE);
+
+	if (EVP_EncryptFinal_ex(gcm, buf, &len) != 1 ||
+	    EVP_CIPHER_CTX_ctrl(gcm, EVP_CTRL_GCM_GET_TAG, sizeof(tag),
+				tag) != 1 ||
+	    write_full(out_fd, tag, sizeof(tag)))
+		goto out;
+
+	res = TEEC_SUCCESS;
+out:
+	EVP_CIPHER_CTX_free(gcm);
+	free(buf);
+	return res;
+}
+
+TEEC_Result aes_envelope_decrypt(TEEC_Session *sess, int in_fd, int out_fd)
+{
+	uint8_t key[AES_ENVELOPE_KEY_SIZE];
+	struct aes_envelope_header hdr;
+	TEEC_Result res = TEEC_ERROR_GENERIC;
+	EVP_CIPHER_CTX *gcm = NULL;
+	size_t held = 0;
+	uint8_t *buf;
+	size_t total;
+	ssize_t n;
+	int len;
+
+	/* The last AES_ENVELOPE_TAG_SIZE bytes read are held back as tag */
+	buf = malloc(AES_ENVELOPE_CHUNK_SIZE + AES_ENVELOPE_TAG_SIZE);
+	if (!buf)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	n = read_full(in_fd, &hdr, sizeof(hdr));
+	if (n < 0)
+		goto out;
+	if (n != sizeof(hdr)) {
+		res = TEEC_ERROR_BAD_FORMAT;
+		goto out;
+	}
+
+	res = aes_envelope_get_key(sess, &hdr, key);
+	if (res != TEEC_SUCCESS)
+		goto out;
+
+	gcm = gcm_init(0, key, &hdr);
+	OPENSSL_cleanse(key, sizeof(key));
+	if (!gcm) {
+		res = TEEC_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	res = TEEC_ERROR_GENERIC;
+	do {
+		n = read_full(in_fd, buf + held, AES_ENVELOPE_CHUNK_SIZE);
+		if (n < 0)
+			goto out;
+
+		total = held + n;
+		if (total < AES_ENVELOPE_TAG_SIZE) {
+			res = TEEC_ERROR_BAD_FORMAT;
+			goto out;
+		}
+
+		if (EVP_DecryptUpdate(gcm, buf, &len, buf,
+				      total - AES_ENVELOPE_TAG_SIZE) != 1 ||
+		    write_full(out_fd, buf, len))
+			goto out;
+
+		memmove(buf, buf + total - AES_ENVELOPE_TAG_SIZE,
+			AES_ENVELOPE_TAG_SIZE);
+		held = AES_ENVELOPE_TAG_SIZE;
+	} while (n == AES_ENVELOPE_CHUNK_SIZE);
+
+	if (EVP_CIPHER_CTX_ctrl(gcm, EVP_CTRL_GCM_SET_TAG,
+				AES_ENVELOPE_TAG_SIZE, buf) != 1)
+		goto out;
+
+	if (EVP_DecryptFinal_ex(gcm, buf, &len) != 1) {
+		if (ftruncate(out_fd, 0))
+			goto out;
+		res = TEEC_ERROR_MAC_INVALID;
+		goto out;
+	}
+
+	res = TEEC_SUCCESS;
+out:
+	EVP_CIPHER_CTX_free(gcm);
+	free(buf);
+	return res;
+}
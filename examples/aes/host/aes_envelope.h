@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AES_ENVELOPE_H
+#define AES_ENVELOPE_H
+
+#include <stdint.h>
+
+#include <tee_client_api.h>
+
+#include <aes_ta.h>
+
+/*
+ * Envelope encryption: the bulk data is ciphered by the host CPU with
+ * AES-256-GCM (OpenSSL, using the CPU AES instructions) under a data key
+ * of its own. The TA generates the data key and keeps it only wrapped
+ * under a key encryption key (KEK) of its key store; the wrapped key is
+ * stored in the container header and unwrapped by the TA on decryption.
+ *
+ * Container: struct aes_envelope_header || cipher text || tag. The header
+ * is the additional authenticated data of the GCM encryption.
+ */
+#define AES_ENVELOPE_MAGIC	"OPTEEAE1"
+#define AES_ENVELOPE_KEY_SIZE	TA_AES_SIZE_256BIT
+#define AES_ENVELOPE_NONCE_SIZE	12
+#define AES_ENVELOPE_TAG_SIZE	16
+#define AES_ENVELOPE_CHUNK_SIZE	(1024 * 1024)
+
+/* Byte fields only, the layout is the same on all hosts */
+struct aes_envelope_header {
+	char magic[8];			/* AES_ENVELOPE_MAGIC */
+	uint8_t kek_id_len;
+	uint8_t wrapped_len;
+	uint8_t reserved[2];		/* zero */
+	uint8_t kek_id[TA_AES_KEY_ID_MAX_SIZE];
+	uint8_t wrapped[TA_AES_WRAPPED_KEY_SIZE(AES_ENVELOPE_KEY_SIZE)];
+	uint8_t nonce[AES_ENVELOPE_NONCE_SIZE];
+};
+
+/*
+ * Get a new data key from the TA for a container under the KEK kek_id
+ * and fill the header with it and a random nonce. The session shall be
+ * opened with a login other than TEEC_LOGIN_PUBLIC.
+ */
+TEEC_Result aes_envelope_new_key(TEEC_Session *sess, const char *kek_id,
+				 struct aes_envelope_header *hdr,
+				 uint8_t key[AES_ENVELOPE_KEY_SIZE]);
+
+/*
+ * Get the data key of a container header from the TA. Returns
+ * TEEC_ERROR_BAD_FORMAT if hdr is no container header.
+ */
+TEEC_Result aes_envelope_get_key(TEEC_Session *sess,
+				 const struct aes_envelope_header *hdr,
+				 uint8_t key[AES_ENVELOPE_KEY_SIZE]);
+
+/*
+ * Encrypt everything read from in_fd into a container written to out_fd.
+ * Nothing is read or written before the TA returned the data key, the
+ * call can be repeated on TEEC_ERROR_ITEM_NOT_FOUND (no such KEK) once the
+ * KEK is created.
+ *
+ * Returns TEEC_SUCCESS, the TA error, or TEEC_ERROR_GENERIC on I/O error
+ * (errno set).
+ */
+TEEC_Result aes_envelope_encrypt(TEEC_Session *sess, const char *kek_id,
+				 int in_fd, int out_fd);
+
+/*
+ * Decrypt the container read from in_fd into out_fd. The clear text is
+ * written before the tag at the end of the container is checked, on
+ * TEEC_ERROR_MAC_INVALID out_fd is truncated to 0.
+ *
+ * Returns TEEC_SUCCESS, the TA error, TEEC_ERROR_BAD_FORMAT,
+ * TEEC_ERROR_MAC_INVALID or TEEC_ERROR_GENERIC on I/O error (errno set).
+ */
+TEEC_Result aes_envelope_decrypt(TEEC_Session *sess, int in_fd, int out_fd);
+
+#endif /* AES_ENVELOPE_H */
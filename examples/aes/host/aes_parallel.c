@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <aes_ta.h>
+
+#include "aes_parallel.h"
+
+struct ctr_worker {
+	pthread_t thread;
+	TEEC_Context *ctx;
+	const struct aes_parallel_job *job;
+	uint64_t start;		/* byte range [start, end) of the file */
+	uint64_t end;
+	TEEC_Result res;
+	int io_errno;
+};
+
+/* Counter block of block index: big endian 128 bit addition to the IV */
+static void ctr_block(const uint8_t *iv, uint64_t index,
+		      uint8_t counter[TA_AES_BLOCK_SIZE])
+{
+	unsigned int sum;
+	int n;
+
+	for (n = TA_AES_BLOCK_SIZE - 1; n >= 0; n--) {
+		sum = iv[n] + (index & 0xff);
+		counter[n] = sum;
+		index = (index >> 8) + (sum >> 8);
+	}
+}
+
+static TEEC_Result invoke(TEEC_Session *sess, uint32_t cmd, TEEC_Operation *op)
+{
+	uint32_t origin;
+
+	return TEEC_InvokeCommand(sess, cmd, op, &origin);
+}
+
+/* PREPARE, SET_KEY and SET_IV for the first block of the range */
+static TEEC_Result prepare_worker(struct ctr_worker *w, TEEC_Session *sess)
+{
+	uint8_t counter[TA_AES_BLOCK_SIZE];
+	TEEC_Operation op;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT, TEEC_NONE);
+	op.params[0].value.a = TA_AES_ALGO_CTR;
+	op.params[1].value.a = w->job->key_size;
+	op.params[2].value.a = w->job->encode;
+	res = invoke(sess, TA_AES_CMD_PREPARE, &op);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)w->job->key;
+	op.params[0].tmpref.size = w->job->key_size;
+	res = invoke(sess, TA_AES_CMD_SET_KEY, &op);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	ctr_block(w->job->iv, w->start / TA_AES_BLOCK_SIZE, counter);
+	op.params[0].tmpref.buffer = counter;
+	op.params[0].tmpref.size = sizeof(counter);
+	return invoke(sess, TA_AES_CMD_SET_IV, &op);
+}
+
+static void *ctr_worker(void *arg)
+{
+	struct ctr_worker *w = arg;
+	const struct aes_parallel_job *job = w->job;
+	TEEC_UUID uuid = TA_AES_UUID;
+	TEEC_SharedMemory shm;
+	TEEC_Session sess;
+	TEEC_Operation op;
+	uint64_t pos;
+	uint32_t origin;
+	ssize_t len;
+	size_t want;
+
+	w->res = TEEC_OpenSession(w->ctx, &sess, &uuid, TEEC_LOGIN_PUBLIC,
+				  NULL, NULL, &origin);
+	if (w->res != TEEC_SUCCESS)
+		return NULL;
+
+	memset(&shm, 0, sizeof(shm));
+	shm.size = job->chunk_size;
+	shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	w->res = TEEC_AllocateSharedMemory(w->ctx, &shm);
+	if (w->res != TEEC_SUCCESS)
+		goto close;
+
+	w->res = prepare_worker(w, &sess);
+
+	for (pos = w->start; w->res == TEEC_SUCCESS && pos < w->end;
+	     pos += len) {
+		want = job->chunk_size;
+		if (want > w->end - pos)
+			want = w->end - pos;
+
+		len = pread(job->in_fd, shm.buffer, want, pos);
+		if (len <= 0) {
+			/* A file shrinking underneath is an error too */
+			w->io_errno = len ? errno : EIO;
+			w->res = TEEC_ERROR_GENERIC;
+			break;
+		}
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INOUT,
+						 TEEC_NONE, TEEC_NONE,
+						 TEEC_NONE);
+		op.params[0].memref.parent = &shm;
+		op.params[0].memref.offset = 0;
+		op.params[0].memref.size = len;
+		w->res = invoke(&sess, TA_AES_CMD_CIPHER, &op);
+		if (w->res != TEEC_SUCCESS)
+			break;
+
+		/*
+		 * Short reads only happen at the end of the range, the
+		 * counter stays block aligned for all others
+		 */
+		if (pwrite(job->out_fd, shm.buffer, len, pos) != len) {
+			w->io_errno = errno;
+			w->res = TEEC_ERROR_GENERIC;
+		}
+	}
+
+	TEEC_ReleaseSharedMemory(&shm);
+close:
+	TEEC_CloseSession(&sess);
+	return NULL;
+}
+
+TEEC_Result aes_ctr_parallel(TEEC_Context *ctx,
+			     const struct aes_parallel_job *job,
+			     size_t num_threads)
+{
+	struct ctr_worker workers[AES_PARALLEL_MAX_THREADS];
+	TEEC_Result res = TEEC_SUCCESS;
+	uint64_t blocks_per_thread;
+	uint64_t blocks;
+	int io_errno = 0;
+	struct stat st;
+	size_t started;
+	size_t n;
+
+	if (!num_threads || num_threads > AES_PARALLEL_MAX_THREADS ||
+	    !job->chunk_size || job->chunk_size % TA_AES_BLOCK_SIZE)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	if (fstat(job->in_fd, &st) || ftruncate(job->out_fd, st.st_size))
+		return TEEC_ERROR_GENERIC;
+
+	/* Block aligned ranges, the last one takes the partial block */
+	blocks = (st.st_size + TA_AES_BLOCK_SIZE - 1) / TA_AES_BLOCK_SIZE;
+	blocks_per_thread = (blocks + num_threads - 1) / num_threads;
+
+	memset(workers, 0, sizeof(workers));
+	for (started = 0; started < num_threads; started++) {
+		struct ctr_worker *w = &workers[started];
+
+		w->ctx = ctx;
+		w->job = job;
+		w->start = started * blocks_per_thread * TA_AES_BLOCK_SIZE;
+		w->end = w->start + blocks_per_thread * TA_AES_BLOCK_SIZE;
+		if (w->start >= (uint64_t)st.st_size)
+			break;
+		if (w->end > (uint64_t)st.st_size)
+			w->end = st.st_size;
+
+		if (pthread_create(&w->thread, NULL, ctr_worker, w)) {
+			res = TEEC_ERROR_OUT_OF_MEMORY;
+			break;
+		}
+	}
+
+	for (n = 0; n < started; n++) {
+		pthread_join(workers[n].thread, NULL);
+
+		if (res == TEEC_SUCCESS && workers[n].res != TEEC_SUCCESS) {
+			res = workers[n].res;
+			io_errno = workers[n].io_errno;
+		}
+	}
+
+	if (io_errno)
+		errno = io_errno;
+
+	return res;
+}
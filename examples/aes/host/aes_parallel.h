@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef AES_PARALLEL_H
+#define AES_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tee_client_api.h>
+
+#define AES_PARALLEL_THREADS	4
+#define AES_PARALLEL_MAX_THREADS	64
+
+/* AES-CTR job over a whole file */
+struct aes_parallel_job {
+	const char *key;	/* raw key, TA_AES_SIZE_128BIT/_256BIT bytes */
+	size_t key_size;
+	const uint8_t *iv;	/* initial counter block, TA_AES_BLOCK_SIZE */
+	int encode;		/* TA_AES_MODE_ENCODE/_DECODE */
+	int in_fd;
+	int out_fd;		/* truncated to the input size */
+	size_t chunk_size;	/* bytes per TA request, block multiple */
+};
+
+/*
+ * Cipher in_fd into out_fd with AES-CTR on num_threads threads. The file
+ * is split into block aligned ranges, one per thread. Each thread opens
+ * its own session, so the TA instances run on separate cores. Each
+ * thread starts at the counter block of its range's first block,
+ * reads with pread and writes with pwrite at the same offsets.
+ *
+ * Returns TEEC_SUCCESS, the first TA error, or TEEC_ERROR_GENERIC on I/O
+ * error (errno set).
+ */
+TEEC_Result aes_ctr_parallel(TEEC_Context *ctx,
+			     const struct aes_parallel_job *job,
+			     size_t num_threads);
+
+#endif /* AES_PARALLEL_H */
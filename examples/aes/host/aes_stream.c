@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <aes_ta.h>
+
+#include "aes_stream.h"
+
+enum slot_state {
+	SLOT_EMPTY,		/* nothing to write, ready to be refilled */
+	SLOT_FULL,		/* input loaded, waits for the TA */
+	SLOT_CIPHERED,		/* output waits to be written */
+};
+
+/* Each chunk is ciphered in place in its shared memory buffer */
+struct stream_slot {
+	TEEC_SharedMemory shm;
+	size_t len;		/* input bytes, 0 at end of stream */
+	size_t out_len;		/* output bytes */
+	enum slot_state state;
+};
+
+struct stream {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct stream_slot slots[AES_STREAM_MAX_BUFFERS];
+	size_t num_slots;
+	size_t chunk_size;
+	int in_fd;
+	int out_fd;
+	int io_errno;		/* first I/O error, 0 if none */
+	int abort;		/* stop both sides */
+};
+
+static ssize_t read_full(int fd, char *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		if (!n)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Wait until slot leaves state, false if the stream was aborted */
+static int wait_slot(struct stream *st, struct stream_slot *slot,
+		     enum slot_state state)
+{
+	while (!st->abort && slot->state == state)
+		pthread_cond_wait(&st->cond, &st->lock);
+
+	return !st->abort;
+}
+
+static void fail(struct stream *st, int error)
+{
+	pthread_mutex_lock(&st->lock);
+	if (!st->io_errno)
+		st->io_errno = error;
+	st->abort = 1;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->lock);
+}
+
+static int flush_slot(struct stream *st, struct stream_slot *slot)
+{
+	if (slot->state != SLOT_CIPHERED)
+		return 0;
+
+	return write_full(st->out_fd, slot->shm.buffer, slot->out_len);
+}
+
+/*
+ * Host side: write the result of a slot and refill it, in slot order,
+ * while the caller thread ciphers the other slots.
+ */
+static void *stream_io(void *arg)
+{
+	struct stream *st = arg;
+	struct stream_slot *slot;
+	ssize_t len;
+	size_t i;
+	size_t j;
+
+	for (i = 0; ; i++) {
+		slot = &st->slots[i % st->num_slots];
+
+		pthread_mutex_lock(&st->lock);
+		if (!wait_slot(st, slot, SLOT_FULL)) {
+			pthread_mutex_unlock(&st->lock);
+			return NULL;
+		}
+		pthread_mutex_unlock(&st->lock);
+
+		/* The slot is ours until marked full again */
+		if (flush_slot(st, slot)) {
+			fail(st, errno);
+			return NULL;
+		}
+
+		len = read_full(st->in_fd, slot->shm.buffer, st->chunk_size);
+		if (len < 0) {
+			fail(st, errno);
+			return NULL;
+		}
+
+		pthread_mutex_lock(&st->lock);
+		slot->len = len;
+		slot->state = SLOT_FULL;
+		pthread_cond_broadcast(&st->cond);
+		pthread_mutex_unlock(&st->lock);
+
+		if (!len)
+			break;
+	}
+
+	/* End of input at slot i: the other slots hold the last results */
+	for (j = 1; j < st->num_slots; j++) {
+		slot = &st->slots[(i + j) % st->num_slots];
+
+		pthread_mutex_lock(&st->lock);
+		if (!wait_slot(st, slot, SLOT_FULL)) {
+			pthread_mutex_unlock(&st->lock);
+			return NULL;
+		}
+		pthread_mutex_unlock(&st->lock);
+
+		if (flush_slot(st, slot)) {
+			fail(st, errno);
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+/* TA side: cipher the slots in order until the end of stream marker */
+static TEEC_Result stream_cipher(struct stream *st, TEEC_Session *sess)
+{
+	struct stream_slot *slot;
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+	size_t i;
+
+	for (i = 0; ; i++) {
+		slot = &st->slots[i % st->num_slots];
+
+		pthread_mutex_lock(&st->lock);
+		while (!st->abort && slot->state != SLOT_FULL)
+			pthread_cond_wait(&st->cond, &st->lock);
+		pthread_mutex_unlock(&st->lock);
+
+		if (st->abort)
+			return TEEC_ERROR_GENERIC;
+		if (!slot->len)
+			return TEEC_SUCCESS;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INOUT,
+						 TEEC_NONE, TEEC_NONE,
+						 TEEC_NONE);
+		op.params[0].memref.parent = &slot->shm;
+		op.params[0].memref.offset = 0;
+		op.params[0].memref.size = slot->len;
+
+		res = TEEC_InvokeCommand(sess, TA_AES_CMD_CIPHER, &op, &origin);
+		if (res != TEEC_SUCCESS) {
+			pthread_mutex_lock(&st->lock);
+			st->abort = 1;
+			pthread_cond_broadcast(&st->cond);
+			pthread_mutex_unlock(&st->lock);
+			return res;
+		}
+
+		pthread_mutex_lock(&st->lock);
+		slot->out_len = op.params[0].memref.size;
+		slot->state = SLOT_CIPHERED;
+		pthread_cond_broadcast(&st->cond);
+		pthread_mutex_unlock(&st->lock);
+	}
+}
+
+TEEC_Result aes_stream(TEEC_Context *ctx, TEEC_Session *sess, int in_fd,
+		       int out_fd, size_t chunk_size, size_t num_buffers)
+{
+	struct stream st;
+	int io_errno = 0;
+	pthread_t io;
+	TEEC_Result res;
+	size_t n;
+
+	if (!chunk_size || chunk_size % TA_AES_BLOCK_SIZE ||
+	    !num_buffers || num_buffers > AES_STREAM_MAX_BUFFERS)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	memset(&st, 0, sizeof(st));
+	st.num_slots = num_buffers;
+	st.chunk_size = chunk_size;
+	st.in_fd = in_fd;
+	st.out_fd = out_fd;
+
+	/* Shared memory is allocated once, not per request as with tmpref */
+	for (n = 0; n < num_buffers; n++) {
+		st.slots[n].shm.size = chunk_size;
+		st.slots[n].shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+		res = TEEC_AllocateSharedMemory(ctx, &st.slots[n].shm);
+		if (res != TEEC_SUCCESS)
+			goto out;
+	}
+
+	pthread_mutex_init(&st.lock, NULL);
+	pthread_cond_init(&st.cond, NULL);
+
+	if (pthread_create(&io, NULL, stream_io, &st)) {
+		res = TEEC_ERROR_OUT_OF_MEMORY;
+	} else {
+		res = stream_cipher(&st, sess);
+		pthread_join(io, NULL);
+
+		/* An I/O error also aborts the TA side */
+		io_errno = st.io_errno;
+		if (io_errno)
+			res = TEEC_ERROR_GENERIC;
+	}
+
+	pthread_cond_destroy(&st.cond);
+	pthread_mutex_destroy(&st.lock);
+out:
+	while (n--)
+		TEEC_ReleaseSharedMemory(&st.slots[n].shm);
+
+	if (io_errno)
+		errno = io_errno;
+
+	return res;
+}
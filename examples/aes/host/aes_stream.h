@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AES_STREAM_H
+#define AES_STREAM_H
+
+#include <stddef.h>
+
+#include <tee_client_api.h>
+
+/* Defaults of the streaming mode */
+#define AES_STREAM_CHUNK_SIZE	(64 * 1024)
+#define AES_STREAM_BUFFERS	2
+#define AES_STREAM_MAX_BUFFERS	8
+
+/*
+ * Cipher everything read from in_fd into out_fd through TA_AES_CMD_CIPHER,
+ * chunk_size bytes per request. The session shall be prepared, keyed and
+ * have its IV set. Each of the num_buffers shared memory buffers of
+ * chunk_size bytes is allocated once and ciphered in place; while the TA
+ * ciphers one of them, a host thread writes the previous result of the
+ * next one and refills it. One buffer gives the plain sequential
+ * read/cipher/write loop.
+ *
+ * chunk_size shall be a multiple of TA_AES_BLOCK_SIZE. ECB and CBC also
+ * need the input size to be a multiple of it, CTR ciphers any size.
+ *
+ * Returns TEEC_SUCCESS, the TA error, or TEEC_ERROR_GENERIC on I/O error
+ * (errno set).
+ */
+TEEC_Result aes_stream(TEEC_Context *ctx, TEEC_Session *sess, int in_fd,
+		       int out_fd, size_t chunk_size, size_t num_buffers);
+
+#endif /* AES_STREAM_H */
@@ -26,8 +26,12 @@
  */
 
 #include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /* OP-TEE TEE client API (built by optee_client) */
 #include <tee_client_api.h>
@@ -35,10 +39,30 @@
 /* To the the UUID (found the the TA's h-file(s)) */
 #include <aes_ta.h>
 
+#include "aes_chunked.h"
+#include "aes_envelope.h"
+#include "aes_parallel.h"
+#include "aes_stream.h"
+
 #define AES_TEST_BUFFER_SIZE	4096
 #define AES_TEST_KEY_SIZE	16
 #define AES_BLOCK_SIZE		16
 
+#define AES_AE_NONCE_SIZE	12
+#define AES_AE_AAD_SIZE		20
+#define AES_AE_TAG_SIZE		16
+
+#define AES_KEY_ID_IMPORTED	"aes-example-imported"
+#define AES_KEY_ID_GENERATED	"aes-example-generated"
+#define AES_KEY_ID_KEK		"aes-example-kek"
+#define AES_KEY_ID_CHUNKED	"aes-example-chunked"
+
+#define AES_XTS_SECTOR_SIZE	512
+#define AES_XTS_FIRST_SECTOR	0x100000000ULL	/* above 32 bits */
+
+#define AES_PACKETS		24	/* packets of the scatter-gather demo */
+#define AES_MAC_MESSAGES	4	/* messages of the MAC batch demo */
+
 #define DECODE			0
 #define ENCODE			1
 
@@ -46,14 +70,17 @@
 struct test_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
+	uint32_t cipher;	/* ciphering context of the session in use */
 };
 
-void prepare_tee_session(struct test_ctx *ctx)
+void prepare_tee_session(struct test_ctx *ctx, uint32_t login)
 {
 	TEEC_UUID uuid = TA_AES_UUID;
 	uint32_t origin;
 	TEEC_Result res;
 
+	ctx->cipher = 0;
+
 	/* Initialize a context connecting us to the TEE */
 	res = TEEC_InitializeContext(NULL, &ctx->ctx);
 	if (res != TEEC_SUCCESS)
@@ -61,7 +88,7 @@ void prepare_tee_session(struct test_ctx *ctx)
 
 	/* Open a session with the TA */
 	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
-			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+			       login, NULL, NULL, &origin);
 	if (res != TEEC_SUCCESS)
 		errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x",
 			res, origin);
@@ -73,7 +100,7 @@ void terminate_tee_session(struct test_ctx *ctx)
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
-void prepare_aes(struct test_ctx *ctx, int encode)
+void prepare_aes(struct test_ctx *ctx, int algo, int encode)
 {
 	TEEC_Operation op;
 	uint32_t origin;
@@ -83,12 +110,13 @@ void prepare_aes(struct test_ctx *ctx, int encode)
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
 					 TEEC_VALUE_INPUT,
 					 TEEC_VALUE_INPUT,
-					 TEEC_NONE);
+					 TEEC_VALUE_INPUT);
 
-	op.params[0].value.a = TA_AES_ALGO_CTR;
+	op.params[0].value.a = algo;
 	op.params[1].value.a = TA_AES_SIZE_128BIT;
 	op.params[2].value.a = encode ? TA_AES_MODE_ENCODE :
 					TA_AES_MODE_DECODE;
+	op.params[3].value.a = ctx->cipher;
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_PREPARE,
 				 &op, &origin);
@@ -105,10 +133,11 @@ void set_key(struct test_ctx *ctx, char *key, size_t key_sz)
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_NONE, TEEC_NONE, TEEC_NONE);
+					 TEEC_NONE, TEEC_NONE, TEEC_VALUE_INPUT);
 
 	op.params[0].tmpref.buffer = key;
 	op.params[0].tmpref.size = key_sz;
+	op.params[3].value.a = ctx->cipher;
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_SET_KEY,
 				 &op, &origin);
@@ -117,6 +146,78 @@ void set_key(struct test_ctx *ctx, char *key, size_t key_sz)
 			res, origin);
 }
 
+/* Store a key under an ID, generated in the TA if key is NULL */
+void store_key(struct test_ctx *ctx, const char *id, char *key, size_t key_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.params[0].tmpref.buffer = (void *)id;
+	op.params[0].tmpref.size = strlen(id);
+
+	if (key) {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_NONE, TEEC_NONE);
+		op.params[1].tmpref.buffer = key;
+		op.params[1].tmpref.size = key_sz;
+	} else {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_NONE, TEEC_NONE);
+		op.params[1].value.a = key_sz;
+	}
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 key ? TA_AES_CMD_KEY_IMPORT :
+				       TA_AES_CMD_KEY_GENERATE,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(KEY_%s) failed 0x%x origin 0x%x",
+			key ? "IMPORT" : "GENERATE", res, origin);
+}
+
+void delete_key(struct test_ctx *ctx, const char *id)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)id;
+	op.params[0].tmpref.size = strlen(id);
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_KEY_DELETE,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(KEY_DELETE) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+void set_key_id(struct test_ctx *ctx, const char *id)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_NONE, TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = (void *)id;
+	op.params[0].tmpref.size = strlen(id);
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_SET_KEY_ID,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(SET_KEY_ID) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
 void set_iv(struct test_ctx *ctx, char *iv, size_t iv_sz)
 {
 	TEEC_Operation op;
@@ -125,9 +226,10 @@ void set_iv(struct test_ctx *ctx, char *iv, size_t iv_sz)
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					  TEEC_NONE, TEEC_NONE, TEEC_NONE);
+					  TEEC_NONE, TEEC_NONE, TEEC_VALUE_INPUT);
 	op.params[0].tmpref.buffer = iv;
 	op.params[0].tmpref.size = iv_sz;
+	op.params[3].value.a = ctx->cipher;
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_SET_IV,
 				 &op, &origin);
@@ -145,11 +247,12 @@ void cipher_buffer(struct test_ctx *ctx, char *in, char *out, size_t sz)
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
 					 TEEC_MEMREF_TEMP_OUTPUT,
-					 TEEC_NONE, TEEC_NONE);
+					 TEEC_NONE, TEEC_VALUE_INPUT);
 	op.params[0].tmpref.buffer = in;
 	op.params[0].tmpref.size = sz;
 	op.params[1].tmpref.buffer = out;
 	op.params[1].tmpref.size = sz;
+	op.params[3].value.a = ctx->cipher;
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_CIPHER,
 				 &op, &origin);
@@ -158,7 +261,1031 @@ void cipher_buffer(struct test_ctx *ctx, char *in, char *out, size_t sz)
 			res, origin);
 }
 
-int main(void)
+/* Cipher buf in place, no second buffer of the same size is needed */
+void cipher_buffer_inplace(struct test_ctx *ctx, char *buf, size_t sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INOUT,
+					 TEEC_NONE, TEEC_NONE,
+					 TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = buf;
+	op.params[0].tmpref.size = sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_CIPHER,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(CIPHER) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+void cipher_oneshot(struct test_ctx *ctx, int encode, char *key,
+		    size_t key_sz, char *iv, char *in, char *out, size_t sz)
+{
+	char key_iv[TA_AES_SIZE_256BIT + AES_BLOCK_SIZE];
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	if (key_sz > TA_AES_SIZE_256BIT)
+		errx(1, "Key size %zu not supported", key_sz);
+
+	/* Key and IV travel in a single memref */
+	memcpy(key_iv, key, key_sz);
+	memcpy(key_iv + key_sz, iv, AES_BLOCK_SIZE);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT);
+	op.params[0].value.a = TA_AES_ALGO_CTR;
+	op.params[0].value.b = encode ? TA_AES_MODE_ENCODE :
+					TA_AES_MODE_DECODE;
+	op.params[1].tmpref.buffer = key_iv;
+	op.params[1].tmpref.size = key_sz + AES_BLOCK_SIZE;
+	op.params[2].tmpref.buffer = in;
+	op.params[2].tmpref.size = sz;
+	op.params[3].tmpref.buffer = out;
+	op.params[3].tmpref.size = sz;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_ONESHOT,
+				 &op, &origin);
+	memset(key_iv, 0, sizeof(key_iv));
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(ONESHOT) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+void ae_init(struct test_ctx *ctx, char *nonce, size_t nonce_sz,
+	     size_t tag_sz, size_t aad_sz, size_t payload_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = nonce;
+	op.params[0].tmpref.size = nonce_sz;
+	op.params[1].value.a = tag_sz;
+	op.params[1].value.b = aad_sz;
+	op.params[2].value.a = payload_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_AE_INIT,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(AE_INIT) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+void ae_update_aad(struct test_ctx *ctx, char *aad, size_t aad_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_NONE, TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = aad;
+	op.params[0].tmpref.size = aad_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_AE_UPDATE_AAD,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(AE_UPDATE_AAD) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+/* Returns TEEC_ERROR_MAC_INVALID when decoding with a wrong tag */
+TEEC_Result ae_final(struct test_ctx *ctx, int encode, char *in, char *out,
+		     size_t sz, char *tag, size_t tag_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 encode ? TEEC_MEMREF_TEMP_OUTPUT :
+						  TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = in;
+	op.params[0].tmpref.size = sz;
+	op.params[1].tmpref.buffer = out;
+	op.params[1].tmpref.size = sz;
+	op.params[2].tmpref.buffer = tag;
+	op.params[2].tmpref.size = tag_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 encode ? TA_AES_CMD_AE_ENCRYPT_FINAL :
+					  TA_AES_CMD_AE_DECRYPT_FINAL,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS &&
+	    (res != TEEC_ERROR_MAC_INVALID || origin != TEEC_ORIGIN_TRUSTED_APP))
+		errx(1, "TEEC_InvokeCommand(AE_FINAL) failed 0x%x origin 0x%x",
+			res, origin);
+
+	return res;
+}
+
+/* Authenticated encode and decode of a buffer, then decode with a bad tag */
+void test_aead(struct test_ctx *ctx, int algo, char *key, char *clear,
+	       char *ciph, char *temp, size_t sz)
+{
+	char nonce[AES_AE_NONCE_SIZE];
+	char aad[AES_AE_AAD_SIZE];
+	char tag[AES_AE_TAG_SIZE];
+
+	memset(nonce, 0x3c, sizeof(nonce)); /* Load some dummy value */
+	memset(aad, 0xc3, sizeof(aad)); /* Load some dummy value */
+
+	prepare_aes(ctx, algo, ENCODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	ae_init(ctx, nonce, sizeof(nonce), sizeof(tag), sizeof(aad), sz);
+	ae_update_aad(ctx, aad, sizeof(aad));
+	ae_final(ctx, ENCODE, clear, ciph, sz, tag, sizeof(tag));
+
+	prepare_aes(ctx, algo, DECODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	ae_init(ctx, nonce, sizeof(nonce), sizeof(tag), sizeof(aad), sz);
+	ae_update_aad(ctx, aad, sizeof(aad));
+	if (ae_final(ctx, DECODE, ciph, temp, sz, tag, sizeof(tag)) ||
+	    memcmp(clear, temp, sz))
+		printf("Clear text and authenticated decoded text differ => ERROR\n");
+	else
+		printf("Clear text and authenticated decoded text match\n");
+
+	tag[0] ^= 1;
+	ae_init(ctx, nonce, sizeof(nonce), sizeof(tag), sizeof(aad), sz);
+	ae_update_aad(ctx, aad, sizeof(aad));
+	if (ae_final(ctx, DECODE, ciph, temp, sz, tag, sizeof(tag)) !=
+	    TEEC_ERROR_MAC_INVALID)
+		printf("Corrupted tag not detected => ERROR\n");
+	else
+		printf("Corrupted tag detected\n");
+}
+
+/* Returns the cipher text size, the IV or nonce size in iv_sz */
+size_t encrypt_auto_iv(struct test_ctx *ctx, char *in, size_t sz, char *out,
+		       size_t out_sz, char *iv, size_t *iv_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = in;
+	op.params[0].tmpref.size = sz;
+	op.params[1].tmpref.buffer = out;
+	op.params[1].tmpref.size = out_sz;
+	op.params[2].tmpref.buffer = iv;
+	op.params[2].tmpref.size = *iv_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_ENCRYPT_AUTO_IV,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(ENCRYPT_AUTO_IV) failed 0x%x origin 0x%x",
+			res, origin);
+
+	*iv_sz = op.params[2].tmpref.size;
+	return op.params[1].tmpref.size;
+}
+
+/*
+ * Encode two messages with IVs chosen by the TA, then decode each with
+ * the IV returned next to its cipher text. GCM cipher texts carry the
+ * tag at their end.
+ */
+void test_auto_iv(struct test_ctx *ctx, int algo, char *key, char *clear,
+		  char *ciph, char *temp, size_t sz)
+{
+	char iv[2][AES_BLOCK_SIZE];
+	size_t iv_sz[2];
+	size_t msg_sz = sz / 4;
+	char *msg_ciph;
+	int ok = 1;
+	int n;
+
+	ctx->cipher = 8;
+	prepare_aes(ctx, algo, ENCODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	for (n = 0; n < 2; n++) {
+		iv_sz[n] = sizeof(iv[n]);
+		encrypt_auto_iv(ctx, clear + n * msg_sz, msg_sz,
+				ciph + n * sz / 2, sz / 2, iv[n], &iv_sz[n]);
+	}
+
+	if (!memcmp(iv[0], iv[1], iv_sz[0]))
+		ok = 0;
+
+	ctx->cipher = 9;
+	prepare_aes(ctx, algo, DECODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	for (n = 0; n < 2; n++) {
+		msg_ciph = ciph + n * sz / 2;
+		if (algo == TA_AES_ALGO_GCM) {
+			ae_init(ctx, iv[n], iv_sz[n], TA_AES_TAG_MAX_SIZE, 0,
+				msg_sz);
+			if (ae_final(ctx, DECODE, msg_ciph, temp, msg_sz,
+				     msg_ciph + msg_sz, TA_AES_TAG_MAX_SIZE))
+				ok = 0;
+		} else {
+			set_iv(ctx, iv[n], iv_sz[n]);
+			cipher_buffer(ctx, msg_ciph, temp, msg_sz);
+		}
+		if (memcmp(clear + n * msg_sz, temp, msg_sz))
+			ok = 0;
+	}
+
+	ctx->cipher = 0;
+
+	if (!ok)
+		printf("Messages decoded with the TA chosen IVs differ => ERROR\n");
+	else
+		printf("Messages decoded with the TA chosen IVs match\n");
+}
+
+void set_mac_key(struct test_ctx *ctx, int algo, const char *key,
+		 size_t key_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].value.a = algo;
+	op.params[1].tmpref.buffer = (void *)key;
+	op.params[1].tmpref.size = key_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_MAC_SET_KEY,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(MAC_SET_KEY) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+/* TA_AES_CMD_MAC_INIT without data, TA_AES_CMD_MAC_UPDATE with data */
+void mac_update(struct test_ctx *ctx, const char *in, size_t sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(in ? TEEC_MEMREF_TEMP_INPUT :
+					      TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE,
+					 TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = (void *)in;
+	op.params[0].tmpref.size = sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, in ? TA_AES_CMD_MAC_UPDATE :
+						  TA_AES_CMD_MAC_INIT,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(MAC_%s) failed 0x%x origin 0x%x",
+			in ? "UPDATE" : "INIT", res, origin);
+}
+
+/*
+ * TA_AES_CMD_MAC_FINAL or TA_AES_CMD_MAC_ONESHOT, verify mac_sz bytes of
+ * mac when verify is set, else compute them. Returns the TA result.
+ */
+TEEC_Result mac_final(struct test_ctx *ctx, uint32_t cmd, int verify,
+		      const char *in, size_t sz, char *mac, size_t mac_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 verify ? TEEC_MEMREF_TEMP_INPUT :
+						  TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = (void *)in;
+	op.params[0].tmpref.size = sz;
+	op.params[1].tmpref.buffer = mac;
+	op.params[1].tmpref.size = mac_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, cmd, &op, &origin);
+	if (res != TEEC_SUCCESS && res != TEEC_ERROR_MAC_INVALID)
+		errx(1, "TEEC_InvokeCommand(MAC_FINAL) failed 0x%x origin 0x%x",
+			res, origin);
+
+	return res;
+}
+
+void mac_batch(struct test_ctx *ctx, struct ta_aes_span *spans,
+	       size_t count, const char *data, size_t sz, char *macs,
+	       size_t macs_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = spans;
+	op.params[0].tmpref.size = count * sizeof(*spans);
+	op.params[1].tmpref.buffer = (void *)data;
+	op.params[1].tmpref.size = sz;
+	op.params[2].tmpref.buffer = macs;
+	op.params[2].tmpref.size = macs_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_MAC_BATCH,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(MAC_BATCH) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+/*
+ * Check AES-CMAC (RFC 4493 example 4) and HMAC-SHA256 (RFC 4231 test
+ * case 4) against their test vectors, in one request and streamed, then
+ * a corrupted MAC and a batch against one-shot MACs.
+ */
+void test_mac(struct test_ctx *ctx, char *clear, size_t sz)
+{
+	static const char cmac_key[] =
+		"\x2b\x7e\x15\x16\x28\xae\xd2\xa6"
+		"\xab\xf7\x15\x88\x09\xcf\x4f\x3c";
+	static const char cmac_msg[] =
+		"\x6b\xc1\xbe\xe2\x2e\x40\x9f\x96\xe9\x3d\x7e\x11\x73\x93\x17\x2a"
+		"\xae\x2d\x8a\x57\x1e\x03\xac\x9c\x9e\xb7\x6f\xac\x45\xaf\x8e\x51"
+		"\x30\xc8\x1c\x46\xa3\x5c\xe4\x11\xe5\xfb\xc1\x19\x1a\x0a\x52\xef"
+		"\xf6\x9f\x24\x45\xdf\x4f\x9b\x17\xad\x2b\x41\x7b\xe6\x6c\x37\x10";
+	static const char cmac_expected[] =
+		"\x51\xf0\xbe\xbf\x7e\x3b\x9d\x92"
+		"\xfc\x49\x74\x17\x79\x36\x3c\xfe";
+	static const char hmac_expected[] =
+		"\x82\x55\x8a\x38\x9a\x44\x3c\x0e\xa4\xcc\x81\x98\x99\xf2\x08\x3a"
+		"\x85\xf0\xfa\xa3\xe5\x78\xf8\x07\x7a\x2e\x3f\xf4\x67\x29\x66\x5b";
+	struct ta_aes_span spans[AES_MAC_MESSAGES];
+	char macs[AES_MAC_MESSAGES][TA_AES_CMAC_SIZE];
+	char mac[TA_AES_MAC_MAX_SIZE];
+	char hmac_key[25];
+	char hmac_msg[50];
+	size_t msg_sz = sz / AES_MAC_MESSAGES;
+	int ok = 1;
+	size_t n;
+
+	ctx->cipher = 10;
+	set_mac_key(ctx, TA_AES_MAC_CMAC, cmac_key, TA_AES_SIZE_128BIT);
+	mac_final(ctx, TA_AES_CMD_MAC_ONESHOT, 0, cmac_msg, 64, mac,
+		  TA_AES_CMAC_SIZE);
+	if (memcmp(mac, cmac_expected, TA_AES_CMAC_SIZE))
+		ok = 0;
+
+	mac_update(ctx, NULL, 0);
+	mac_update(ctx, cmac_msg, 20);
+	mac_update(ctx, cmac_msg + 20, 20);
+	mac_final(ctx, TA_AES_CMD_MAC_FINAL, 0, cmac_msg + 40, 24, mac,
+		  TA_AES_CMAC_SIZE);
+	if (memcmp(mac, cmac_expected, TA_AES_CMAC_SIZE))
+		ok = 0;
+
+	for (n = 0; n < sizeof(hmac_key); n++)
+		hmac_key[n] = n + 1;
+	memset(hmac_msg, 0xcd, sizeof(hmac_msg));
+	set_mac_key(ctx, TA_AES_MAC_HMAC_SHA256, hmac_key, sizeof(hmac_key));
+	mac_final(ctx, TA_AES_CMD_MAC_ONESHOT, 0, hmac_msg, sizeof(hmac_msg),
+		  mac, TA_AES_HMAC_SHA256_SIZE);
+	if (memcmp(mac, hmac_expected, TA_AES_HMAC_SHA256_SIZE))
+		ok = 0;
+
+	if (!ok)
+		printf("MACs and test vectors differ => ERROR\n");
+	else
+		printf("MACs and test vectors match\n");
+
+	mac[0] ^= 1;
+	if (mac_final(ctx, TA_AES_CMD_MAC_ONESHOT, 1, hmac_msg,
+		      sizeof(hmac_msg), mac, TA_AES_HMAC_SHA256_SIZE) !=
+	    TEEC_ERROR_MAC_INVALID)
+		printf("Corrupted MAC not detected => ERROR\n");
+	else
+		printf("Corrupted MAC detected\n");
+
+	/* Messages of growing sizes, the last one empty */
+	set_mac_key(ctx, TA_AES_MAC_CMAC, cmac_key, TA_AES_SIZE_128BIT);
+	for (n = 0; n < AES_MAC_MESSAGES; n++) {
+		spans[n].offset = n * msg_sz;
+		spans[n].length = (AES_MAC_MESSAGES - 1 - n) * msg_sz / 3;
+	}
+	mac_batch(ctx, spans, AES_MAC_MESSAGES, clear, sz, macs[0],
+		  sizeof(macs));
+
+	ok = 1;
+	for (n = 0; n < AES_MAC_MESSAGES; n++) {
+		mac_final(ctx, TA_AES_CMD_MAC_ONESHOT, 0,
+			  clear + spans[n].offset, spans[n].length, mac,
+			  TA_AES_CMAC_SIZE);
+		if (memcmp(mac, macs[n], TA_AES_CMAC_SIZE))
+			ok = 0;
+	}
+
+	ctx->cipher = 0;
+
+	if (!ok)
+		printf("Batched and one-shot MACs differ => ERROR\n");
+	else
+		printf("Batched and one-shot MACs match\n");
+}
+
+/* Returns the output size of TA_AES_CMD_ENCRYPT_THEN_MAC, 0 on MAC error */
+size_t encrypt_then_mac(struct test_ctx *ctx, char *in, size_t sz,
+			char *out, size_t out_sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = in;
+	op.params[0].tmpref.size = sz;
+	op.params[1].tmpref.buffer = out;
+	op.params[1].tmpref.size = out_sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_ENCRYPT_THEN_MAC,
+				 &op, &origin);
+	if (res == TEEC_ERROR_MAC_INVALID)
+		return 0;
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(ENCRYPT_THEN_MAC) failed 0x%x origin 0x%x",
+			res, origin);
+
+	return op.params[1].tmpref.size;
+}
+
+/*
+ * Encode a message with AES-CTR then HMAC-SHA256 in one request, decode
+ * it, then decode it again with a cipher text byte flipped.
+ */
+void test_encrypt_then_mac(struct test_ctx *ctx, char *key, char *clear,
+			   char *ciph, char *temp, size_t sz)
+{
+	char mac_key[TA_AES_SIZE_256BIT];
+	size_t msg_sz = sz / 2;
+	size_t ciph_sz;
+
+	memset(mac_key, 0x3c, sizeof(mac_key)); /* Load some dummy value */
+
+	ctx->cipher = 11;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, ENCODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	set_mac_key(ctx, TA_AES_MAC_HMAC_SHA256, mac_key, sizeof(mac_key));
+	ciph_sz = encrypt_then_mac(ctx, clear, msg_sz, ciph, sz);
+
+	ctx->cipher = 12;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, DECODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	set_mac_key(ctx, TA_AES_MAC_HMAC_SHA256, mac_key, sizeof(mac_key));
+	if (encrypt_then_mac(ctx, ciph, ciph_sz, temp, sz) != msg_sz ||
+	    memcmp(clear, temp, msg_sz))
+		printf("Clear text and encrypt-then-MAC decoded text differ => ERROR\n");
+	else
+		printf("Clear text and encrypt-then-MAC decoded text match\n");
+
+	ciph[TA_AES_BLOCK_SIZE + 1] ^= 1;
+	if (encrypt_then_mac(ctx, ciph, ciph_sz, temp, sz))
+		printf("Corrupted cipher text not detected => ERROR\n");
+	else
+		printf("Corrupted cipher text detected\n");
+
+	ctx->cipher = 0;
+}
+
+/*
+ * Keep an encode and a decode operation live in two contexts of the
+ * session and alternate between them chunk by chunk, without any
+ * PREPARE/SET_KEY/SET_IV on the switches.
+ */
+void test_contexts(struct test_ctx *ctx, char *key, char *iv, char *clear,
+		   char *ciph, char *temp, size_t sz)
+{
+	size_t chunk = sz / 4;
+	size_t pos;
+
+	ctx->cipher = 1;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, ENCODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	set_iv(ctx, iv, AES_BLOCK_SIZE);
+
+	ctx->cipher = 2;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, DECODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	set_iv(ctx, iv, AES_BLOCK_SIZE);
+
+	for (pos = 0; pos < sz; pos += chunk) {
+		ctx->cipher = 1;
+		cipher_buffer(ctx, clear + pos, ciph + pos, chunk);
+		ctx->cipher = 2;
+		cipher_buffer(ctx, ciph + pos, temp + pos, chunk);
+	}
+
+	ctx->cipher = 0;
+
+	if (memcmp(clear, temp, sz))
+		printf("Clear text and interleaved decoded text differ => ERROR\n");
+	else
+		printf("Clear text and interleaved decoded text match\n");
+}
+
+/* Cipher sectors in place, sector numbers give the XTS tweaks */
+void cipher_sectors(struct test_ctx *ctx, uint64_t sector, char *buf,
+		    size_t sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_INOUT,
+					 TEEC_VALUE_INPUT);
+	op.params[0].value.a = sector;
+	op.params[0].value.b = sector >> 32;
+	op.params[1].value.a = AES_XTS_SECTOR_SIZE;
+	op.params[2].tmpref.buffer = buf;
+	op.params[2].tmpref.size = sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_XTS_SECTORS,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(XTS_SECTORS) failed 0x%x origin 0x%x",
+			res, origin);
+}
+
+/* Returns TEEC_ERROR_BAD_PARAMETERS for a rejected packet table */
+TEEC_Result cipher_packets(struct test_ctx *ctx,
+			   struct ta_aes_packet *packets, size_t count,
+			   char *buf, size_t sz)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_INOUT,
+					 TEEC_NONE, TEEC_VALUE_INPUT);
+	op.params[0].tmpref.buffer = packets;
+	op.params[0].tmpref.size = count * sizeof(*packets);
+	op.params[1].tmpref.buffer = buf;
+	op.params[1].tmpref.size = sz;
+	op.params[3].value.a = ctx->cipher;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CMD_CIPHER_PACKETS,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS && res != TEEC_ERROR_BAD_PARAMETERS)
+		errx(1, "TEEC_InvokeCommand(CIPHER_PACKETS) failed 0x%x origin 0x%x",
+			res, origin);
+
+	return res;
+}
+
+/*
+ * Encode packets of various sizes packed in a buffer, each with its own
+ * initial counter, in one request. Every packet shall match the packet
+ * encoded alone.
+ */
+void test_packets(struct test_ctx *ctx, char *key, char *clear, char *temp,
+		  size_t sz)
+{
+	struct ta_aes_packet packets[AES_PACKETS];
+	char out[AES_TEST_BUFFER_SIZE];
+	uint32_t offset = 0;
+	size_t n;
+
+	memset(packets, 0, sizeof(packets));
+	for (n = 0; n < AES_PACKETS; n++) {
+		packets[n].offset = offset;
+		packets[n].length = 1 + n * 11;	/* CTR, any length */
+		packets[n].iv[0] = n;		/* Load some dummy value */
+		offset += packets[n].length;
+	}
+	if (offset > sz)
+		errx(1, "Packets exceed test buffer");
+
+	ctx->cipher = 7;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, ENCODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	memcpy(temp, clear, sz);
+	if (cipher_packets(ctx, packets, AES_PACKETS, temp, offset))
+		errx(1, "CIPHER_PACKETS rejected the packets");
+	ctx->cipher = 0;
+
+	for (n = 0; n < AES_PACKETS; n++) {
+		cipher_oneshot(ctx, ENCODE, key, AES_TEST_KEY_SIZE,
+			       (char *)packets[n].iv, clear + packets[n].offset,
+			       out, packets[n].length);
+		if (memcmp(out, temp + packets[n].offset, packets[n].length))
+			break;
+	}
+
+	if (n < AES_PACKETS)
+		printf("Packet %zu differs from its single encoding => ERROR\n",
+		       n);
+	else
+		printf("Packets encoded in one request match\n");
+
+	/* CBC has no partial blocks, a 17 bytes packet is refused */
+	ctx->cipher = 7;
+	prepare_aes(ctx, TA_AES_ALGO_CBC, ENCODE);
+	set_key(ctx, key, AES_TEST_KEY_SIZE);
+	packets[0].offset = 0;
+	packets[0].length = AES_BLOCK_SIZE + 1;
+	if (cipher_packets(ctx, packets, 1, temp, sz) !=
+	    TEEC_ERROR_BAD_PARAMETERS)
+		printf("Misaligned CBC packet not rejected => ERROR\n");
+	else
+		printf("Misaligned CBC packet rejected\n");
+	ctx->cipher = 0;
+}
+
+/*
+ * Encode all sectors of a buffer in one request, then decode them one
+ * by one: each sector only depends on its own number.
+ */
+void test_xts(struct test_ctx *ctx, char *clear, char *temp, size_t sz)
+{
+	char xts_key[2 * AES_TEST_KEY_SIZE];
+	size_t pos;
+
+	memset(xts_key, 0xa5, AES_TEST_KEY_SIZE); /* Load some dummy value */
+	memset(xts_key + AES_TEST_KEY_SIZE, 0x5a, AES_TEST_KEY_SIZE);
+
+	ctx->cipher = 5;
+	prepare_aes(ctx, TA_AES_ALGO_XTS, ENCODE);
+	set_key(ctx, xts_key, sizeof(xts_key));
+	memcpy(temp, clear, sz);
+	cipher_sectors(ctx, AES_XTS_FIRST_SECTOR, temp, sz);
+
+	ctx->cipher = 6;
+	prepare_aes(ctx, TA_AES_ALGO_XTS, DECODE);
+	set_key(ctx, xts_key, sizeof(xts_key));
+	for (pos = 0; pos < sz; pos += AES_XTS_SECTOR_SIZE)
+		cipher_sectors(ctx,
+			       AES_XTS_FIRST_SECTOR + pos / AES_XTS_SECTOR_SIZE,
+			       temp + pos, AES_XTS_SECTOR_SIZE);
+
+	ctx->cipher = 0;
+
+	if (memcmp(clear, temp, sz))
+		printf("Clear text and XTS decoded sectors differ => ERROR\n");
+	else
+		printf("Clear text and XTS decoded sectors match\n");
+}
+
+/*
+ * Cipher with keys referenced by ID: an imported copy of the example key
+ * shall give the same cipher text, a key generated in the TA never shows
+ * up in normal world memory.
+ */
+void test_key_store(struct test_ctx *ctx, char *key, char *iv, char *clear,
+		    char *ciph, char *temp, size_t sz)
+{
+	char *ciph2 = temp + sz / 2;
+
+	store_key(ctx, AES_KEY_ID_IMPORTED, key, AES_TEST_KEY_SIZE);
+
+	ctx->cipher = 3;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, ENCODE);
+	set_key_id(ctx, AES_KEY_ID_IMPORTED);
+	set_iv(ctx, iv, AES_BLOCK_SIZE);
+	cipher_buffer(ctx, clear, temp, sz);
+
+	if (memcmp(ciph, temp, sz))
+		printf("Raw key and stored key cipher texts differ => ERROR\n");
+	else
+		printf("Raw key and stored key cipher texts match\n");
+
+	store_key(ctx, AES_KEY_ID_GENERATED, NULL, AES_TEST_KEY_SIZE);
+
+	set_key_id(ctx, AES_KEY_ID_GENERATED);
+	set_iv(ctx, iv, AES_BLOCK_SIZE);
+	cipher_buffer(ctx, clear, ciph2, sz / 2);
+
+	ctx->cipher = 4;
+	prepare_aes(ctx, TA_AES_ALGO_CTR, DECODE);
+	set_key_id(ctx, AES_KEY_ID_GENERATED);
+	set_iv(ctx, iv, AES_BLOCK_SIZE);
+	cipher_buffer_inplace(ctx, ciph2, sz / 2);
+
+	if (memcmp(clear, ciph2, sz / 2))
+		printf("Clear text and generated key decoded text differ => ERROR\n");
+	else
+		printf("Clear text and generated key decoded text match\n");
+
+	ctx->cipher = 0;
+	delete_key(ctx, AES_KEY_ID_IMPORTED);
+	delete_key(ctx, AES_KEY_ID_GENERATED);
+}
+
+/*
+ * Cipher a file with AES-CTR in chunks through shared memory buffers,
+ * using the dummy key and IV of the example
+ */
+int stream_file(int encode, const char *in_path, const char *out_path,
+		size_t chunk_size, size_t buffers)
+{
+	struct test_ctx ctx;
+	char key[AES_TEST_KEY_SIZE];
+	char iv[AES_BLOCK_SIZE];
+	TEEC_Result res;
+	int in_fd;
+	int out_fd;
+
+	in_fd = open(in_path, O_RDONLY);
+	if (in_fd < 0)
+		err(1, "%s", in_path);
+
+	out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (out_fd < 0)
+		err(1, "%s", out_path);
+
+	prepare_tee_session(&ctx, TEEC_LOGIN_PUBLIC);
+	prepare_aes(&ctx, TA_AES_ALGO_CTR, encode);
+
+	memset(key, 0xa5, sizeof(key)); /* Load some dummy value */
+	set_key(&ctx, key, AES_TEST_KEY_SIZE);
+
+	memset(iv, 0, sizeof(iv)); /* Load some dummy value */
+	set_iv(&ctx, iv, AES_BLOCK_SIZE);
+
+	res = aes_stream(&ctx.ctx, &ctx.sess, in_fd, out_fd,
+			 chunk_size, buffers);
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "%s -> %s", in_path, out_path);
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_stream failed 0x%x", res);
+
+	if (close(out_fd))
+		err(1, "%s", out_path);
+	close(in_fd);
+
+	terminate_tee_session(&ctx);
+	return 0;
+}
+
+/*
+ * Cipher a file with AES-CTR on several threads, each with its own
+ * session, using the dummy key and IV of the example. The output is
+ * identical to stream_file().
+ */
+int parallel_file(int encode, const char *in_path, const char *out_path,
+		  size_t threads, size_t chunk_size)
+{
+	struct aes_parallel_job job;
+	char key[AES_TEST_KEY_SIZE];
+	uint8_t iv[AES_BLOCK_SIZE];
+	TEEC_Context teec;
+	TEEC_Result res;
+
+	memset(key, 0xa5, sizeof(key)); /* Load some dummy value */
+	memset(iv, 0, sizeof(iv)); /* Load some dummy value */
+
+	memset(&job, 0, sizeof(job));
+	job.key = key;
+	job.key_size = sizeof(key);
+	job.iv = iv;
+	job.encode = encode ? TA_AES_MODE_ENCODE : TA_AES_MODE_DECODE;
+	job.chunk_size = chunk_size;
+
+	job.in_fd = open(in_path, O_RDONLY);
+	if (job.in_fd < 0)
+		err(1, "%s", in_path);
+
+	job.out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (job.out_fd < 0)
+		err(1, "%s", out_path);
+
+	res = TEEC_InitializeContext(NULL, &teec);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	res = aes_ctr_parallel(&teec, &job, threads);
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "%s -> %s", in_path, out_path);
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_ctr_parallel failed 0x%x", res);
+
+	if (close(job.out_fd))
+		err(1, "%s", out_path);
+	close(job.in_fd);
+
+	TEEC_FinalizeContext(&teec);
+	return 0;
+}
+
+/*
+ * Encrypt a file into an envelope container, or decrypt it. The TA only
+ * handles the data key, wrapped under AES_KEY_ID_KEK which is generated
+ * on first use; the host ciphers the data. Data keys are bound to the
+ * client identity, hence the user login.
+ */
+int envelope_file(int encode, const char *in_path, const char *out_path)
+{
+	struct test_ctx ctx;
+	TEEC_Result res;
+	int in_fd;
+	int out_fd;
+
+	in_fd = open(in_path, O_RDONLY);
+	if (in_fd < 0)
+		err(1, "%s", in_path);
+
+	out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (out_fd < 0)
+		err(1, "%s", out_path);
+
+	prepare_tee_session(&ctx, TEEC_LOGIN_USER);
+
+	if (encode) {
+		res = aes_envelope_encrypt(&ctx.sess, AES_KEY_ID_KEK, in_fd,
+					   out_fd);
+		if (res == TEEC_ERROR_ITEM_NOT_FOUND) {
+			store_key(&ctx, AES_KEY_ID_KEK, NULL,
+				  TA_AES_SIZE_256BIT);
+			res = aes_envelope_encrypt(&ctx.sess, AES_KEY_ID_KEK,
+						   in_fd, out_fd);
+		}
+	} else {
+		res = aes_envelope_decrypt(&ctx.sess, in_fd, out_fd);
+	}
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "%s -> %s", in_path, out_path);
+	if (res == TEEC_ERROR_MAC_INVALID)
+		errx(1, "%s: authentication failed", in_path);
+	if (res != TEEC_SUCCESS)
+		errx(1, "envelope failed 0x%x", res);
+
+	if (close(out_fd))
+		err(1, "%s", out_path);
+	close(in_fd);
+
+	terminate_tee_session(&ctx);
+	return 0;
+}
+
+/*
+ * Encrypt a file into a chunked container with the stored key
+ * AES_KEY_ID_CHUNKED. The key is generated on first use and the TA only
+ * manages keys for clients with a login, hence the user login. The key
+ * itself is not bound to an identity.
+ */
+int chunked_encode(const char *in_path, const char *out_path,
+		   size_t chunk_size)
+{
+	struct test_ctx ctx;
+	TEEC_Result res;
+	int in_fd;
+	int out_fd;
+
+	in_fd = open(in_path, O_RDONLY);
+	if (in_fd < 0)
+		err(1, "%s", in_path);
+
+	out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (out_fd < 0)
+		err(1, "%s", out_path);
+
+	prepare_tee_session(&ctx, TEEC_LOGIN_USER);
+
+	res = aes_chunked_encrypt(&ctx.sess, AES_KEY_ID_CHUNKED, chunk_size,
+				  in_fd, out_fd);
+	if (res == TEEC_ERROR_ITEM_NOT_FOUND) {
+		store_key(&ctx, AES_KEY_ID_CHUNKED, NULL, AES_CHUNKED_KEY_SIZE);
+		res = aes_chunked_encrypt(&ctx.sess, AES_KEY_ID_CHUNKED,
+					  chunk_size, in_fd, out_fd);
+	}
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "%s -> %s", in_path, out_path);
+	if (res != TEEC_SUCCESS)
+		errx(1, "aes_chunked_encrypt failed 0x%x", res);
+
+	if (close(out_fd))
+		err(1, "%s", out_path);
+	close(in_fd);
+
+	terminate_tee_session(&ctx);
+	return 0;
+}
+
+/*
+ * Decrypt length bytes from offset of a chunked container to out_fd,
+ * only the chunks covering the range are read and decrypted. Using a
+ * stored key needs no login, unlike generating it in chunked_encode().
+ */
+int chunked_read(const char *in_path, int out_fd, uint64_t offset,
+		 uint64_t length)
+{
+	struct aes_chunked file;
+	struct test_ctx ctx;
+	TEEC_Result res;
+	size_t done;
+	char *buf;
+	int in_fd;
+
+	in_fd = open(in_path, O_RDONLY);
+	if (in_fd < 0)
+		err(1, "%s", in_path);
+
+	prepare_tee_session(&ctx, TEEC_LOGIN_PUBLIC);
+
+	res = aes_chunked_open(&file, &ctx.sess, in_fd);
+	if (res == TEEC_ERROR_GENERIC)
+		err(1, "%s", in_path);
+	if (res != TEEC_SUCCESS)
+		errx(1, "%s: aes_chunked_open failed 0x%x", in_path, res);
+
+	buf = malloc(file.chunk_size);
+	if (!buf)
+		err(1, "malloc");
+
+	while (length) {
+		res = aes_chunked_pread(&file, buf,
+					length < file.chunk_size ?
+					length : file.chunk_size,
+					offset, &done);
+		if (res == TEEC_ERROR_MAC_INVALID)
+			errx(1, "%s: authentication failed at %" PRIu64,
+			     in_path, offset);
+		if (res == TEEC_ERROR_GENERIC)
+			err(1, "%s", in_path);
+		if (res != TEEC_SUCCESS)
+			errx(1, "aes_chunked_pread failed 0x%x", res);
+		if (!done)
+			break;
+
+		if (write(out_fd, buf, done) != (ssize_t)done)
+			err(1, "write");
+		offset += done;
+		length -= done;
+	}
+
+	free(buf);
+	aes_chunked_close(&file);
+	close(in_fd);
+
+	terminate_tee_session(&ctx);
+	return 0;
+}
+
+static void __attribute__((noreturn)) usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s\n"
+		"       %s encode|decode <in> <out> [chunk_size [buffers]]\n"
+		"       %s parallel-encode|parallel-decode <in> <out> [threads [chunk_size]]\n"
+		"       %s envelope-encode|envelope-decode <in> <out>\n"
+		"       %s chunked-encode <in> <out> [chunk_size]\n"
+		"       %s chunked-read <in> [offset [length]]\n"
+		"  chunk_size  bytes per TA request, multiple of %d (default %d)\n"
+		"  buffers     shared memory buffers, 1 to %d (default %d)\n"
+		"  threads     threads with their own session, 1 to %d (default %d)\n",
+		prog, prog, prog, prog, prog, prog, TA_AES_BLOCK_SIZE, AES_STREAM_CHUNK_SIZE,
+		AES_STREAM_MAX_BUFFERS, AES_STREAM_BUFFERS,
+		AES_PARALLEL_MAX_THREADS, AES_PARALLEL_THREADS);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
 {
 	struct test_ctx ctx;
 	char key[AES_TEST_KEY_SIZE];
@@ -167,11 +1294,74 @@ int main(void)
 	char ciph[AES_TEST_BUFFER_SIZE];
 	char temp[AES_TEST_BUFFER_SIZE];
 
+	if (argc == 4 && !strcmp(argv[1], "envelope-encode"))
+		return envelope_file(ENCODE, argv[2], argv[3]);
+	if (argc == 4 && !strcmp(argv[1], "envelope-decode"))
+		return envelope_file(DECODE, argv[2], argv[3]);
+
+	if ((argc == 4 || argc == 5) && !strcmp(argv[1], "chunked-encode"))
+		return chunked_encode(argv[2], argv[3], argc > 4 ?
+				      strtoul(argv[4], NULL, 0) :
+				      AES_CHUNKED_CHUNK_SIZE);
+	if (argc >= 3 && argc <= 5 && !strcmp(argv[1], "chunked-read"))
+		return chunked_read(argv[2], STDOUT_FILENO,
+				    argc > 3 ? strtoull(argv[3], NULL, 0) : 0,
+				    argc > 4 ? strtoull(argv[4], NULL, 0) :
+					       UINT64_MAX);
+
+	if (argc > 1 && !strncmp(argv[1], "parallel-", 9)) {
+		size_t chunk_size = AES_STREAM_CHUNK_SIZE;
+		size_t threads = AES_PARALLEL_THREADS;
+		int encode;
+
+		if (argc < 4 || argc > 6)
+			usage(argv[0]);
+
+		if (!strcmp(argv[1] + 9, "encode"))
+			encode = ENCODE;
+		else if (!strcmp(argv[1] + 9, "decode"))
+			encode = DECODE;
+		else
+			usage(argv[0]);
+
+		if (argc > 4)
+			threads = strtoul(argv[4], NULL, 0);
+		if (argc > 5)
+			chunk_size = strtoul(argv[5], NULL, 0);
+
+		return parallel_file(encode, argv[2], argv[3], threads,
+				     chunk_size);
+	}
+
+	if (argc > 1) {
+		size_t chunk_size = AES_STREAM_CHUNK_SIZE;
+		size_t buffers = AES_STREAM_BUFFERS;
+		int encode;
+
+		if (argc < 4 || argc > 6)
+			usage(argv[0]);
+
+		if (!strcmp(argv[1], "encode"))
+			encode = ENCODE;
+		else if (!strcmp(argv[1], "decode"))
+			encode = DECODE;
+		else
+			usage(argv[0]);
+
+		if (argc > 4)
+			chunk_size = strtoul(argv[4], NULL, 0);
+		if (argc > 5)
+			buffers = strtoul(argv[5], NULL, 0);
+
+		return stream_file(encode, argv[2], argv[3], chunk_size,
+				   buffers);
+	}
+
 	printf("Prepare session with the TA\n");
-	prepare_tee_session(&ctx);
+	prepare_tee_session(&ctx, TEEC_LOGIN_USER);
 
 	printf("Prepare encode operation\n");
-	prepare_aes(&ctx, ENCODE);
+	prepare_aes(&ctx, TA_AES_ALGO_CTR, ENCODE);
 
 	printf("Load key in TA\n");
 	memset(key, 0xa5, sizeof(key)); /* Load some dummy value */
@@ -186,7 +1376,7 @@ int main(void)
 	cipher_buffer(&ctx, clear, ciph, AES_TEST_BUFFER_SIZE);
 
 	printf("Prepare decode operation\n");
-	prepare_aes(&ctx, DECODE);
+	prepare_aes(&ctx, TA_AES_ALGO_CTR, DECODE);
 
 	printf("Load key in TA\n");
 	memset(key, 0xa5, sizeof(key)); /* Load some dummy value */
@@ -205,6 +1395,69 @@ int main(void)
 	else
 		printf("Clear text and decoded text match\n");
 
+	printf("Encode buffer from TA in a single request\n");
+	cipher_oneshot(&ctx, ENCODE, key, AES_TEST_KEY_SIZE, iv,
+		       clear, temp, AES_TEST_BUFFER_SIZE);
+
+	if (memcmp(ciph, temp, AES_TEST_BUFFER_SIZE))
+		printf("One-shot and step-by-step cipher texts differ => ERROR\n");
+	else
+		printf("One-shot and step-by-step cipher texts match\n");
+
+	printf("Decode buffer from TA in a single request\n");
+	cipher_oneshot(&ctx, DECODE, key, AES_TEST_KEY_SIZE, iv,
+		       ciph, temp, AES_TEST_BUFFER_SIZE);
+
+	if (memcmp(clear, temp, AES_TEST_BUFFER_SIZE))
+		printf("Clear text and one-shot decoded text differ => ERROR\n");
+	else
+		printf("Clear text and one-shot decoded text match\n");
+
+	printf("Decode buffer in place from TA\n");
+	memcpy(temp, ciph, AES_TEST_BUFFER_SIZE);
+	set_iv(&ctx, iv, AES_BLOCK_SIZE);
+	cipher_buffer_inplace(&ctx, temp, AES_TEST_BUFFER_SIZE);
+
+	if (memcmp(clear, temp, AES_TEST_BUFFER_SIZE))
+		printf("Clear text and in place decoded text differ => ERROR\n");
+	else
+		printf("Clear text and in place decoded text match\n");
+
+	printf("Interleave encode and decode on two ciphering contexts\n");
+	test_contexts(&ctx, key, iv, clear, ciph, temp, AES_TEST_BUFFER_SIZE);
+
+	printf("Encode and decode buffer with keys stored in the TA\n");
+	test_key_store(&ctx, key, iv, clear, ciph, temp, AES_TEST_BUFFER_SIZE);
+
+	printf("Encode packets of a packed buffer with their own counters\n");
+	test_packets(&ctx, key, clear, temp, AES_TEST_BUFFER_SIZE);
+
+	printf("Encode and decode sectors with AES-XTS\n");
+	test_xts(&ctx, clear, temp, AES_TEST_BUFFER_SIZE);
+
+	printf("Encode messages with IVs chosen by the TA, AES-CTR\n");
+	test_auto_iv(&ctx, TA_AES_ALGO_CTR, key, clear, ciph, temp,
+		     AES_TEST_BUFFER_SIZE);
+
+	printf("Encode messages with nonces chosen by the TA, AES-GCM\n");
+	test_auto_iv(&ctx, TA_AES_ALGO_GCM, key, clear, ciph, temp,
+		     AES_TEST_BUFFER_SIZE);
+
+	printf("Compute MACs with AES-CMAC and HMAC-SHA256\n");
+	test_mac(&ctx, clear, AES_TEST_BUFFER_SIZE);
+
+	printf("Encode and decode buffer with AES-CTR then HMAC-SHA256\n");
+	test_encrypt_then_mac(&ctx, key, clear, ciph, temp,
+			      AES_TEST_BUFFER_SIZE);
+
+	printf("Encode and decode buffer with AES-GCM\n");
+	test_aead(&ctx, TA_AES_ALGO_GCM, key, clear, ciph, temp,
+		  AES_TEST_BUFFER_SIZE);
+
+	printf("Encode and decode buffer with AES-CCM\n");
+	test_aead(&ctx, TA_AES_ALGO_CCM, key, clear, ciph, temp,
+		  AES_TEST_BUFFER_SIZE);
+
 	terminate_tee_session(&ctx);
 	return 0;
 }
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Normal world stand-in for libteec and the AES TA, to run the benchmark
+ * on a development host without a TEE: the TEE client API calls land
+ * here and the AES TA commands are served by OpenSSL. Only the plain
+ * ciphering commands are emulated (PREPARE, SET_KEY, SET_IV, CIPHER,
+ * ONESHOT and RELEASE with ECB, CBC and CTR), others fail with
+ * TEEC_ERROR_NOT_SUPPORTED.
+ *
+ * Temporary memory references are bounced through a copy like the TEE
+ * driver does, registered and allocated shared memory is used in place,
+ * so the two kinds compare as on a board minus the world switch.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+
+#include <tee_client_api.h>
+
+#include <aes_ta.h>
+
+#define STANDIN_MAX_SESSIONS	64
+
+struct standin_cipher {
+	EVP_CIPHER_CTX *evp;
+	uint32_t algo;			/* TA_AES_ALGO_xxx */
+	uint32_t mode;			/* TA_AES_MODE_xxx */
+	uint32_t key_size;
+	uint8_t key[TA_AES_SIZE_256BIT];
+};
+
+struct standin_session {
+	bool used;
+	struct standin_cipher ciphers[TA_AES_MAX_CONTEXTS];
+};
+
+/* Session IDs index this table, each session is used by one thread */
+static struct standin_session sessions[STANDIN_MAX_SESSIONS];
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Buffer and size of a memref parameter, NULL for other types */
+struct standin_memref {
+	uint8_t *buffer;
+	size_t size;
+	uint8_t *bounce;		/* copy of a temporary reference */
+};
+
+TEEC_Result TEEC_InitializeContext(const char *name, TEEC_Context *ctx)
+{
+	(void)name;
+
+	memset(ctx, 0, sizeof(*ctx));
+	return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context *ctx)
+{
+	(void)ctx;
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *ctx, TEEC_Session *session,
+			     const TEEC_UUID *destination,
+			     uint32_t connectionMethod,
+			     const void *connectionData,
+			     TEEC_Operation *operation,
+			     uint32_t *returnOrigin)
+{
+	const TEEC_UUID uuid = TA_AES_UUID;
+	size_t n;
+
+	(void)connectionMethod;
+	(void)connectionData;
+	(void)operation;
+
+	if (returnOrigin)
+		*returnOrigin = TEEC_ORIGIN_TEE;
+
+	if (memcmp(destination, &uuid, sizeof(uuid)))
+		return TEEC_ERROR_ITEM_NOT_FOUND;
+
+	pthread_mutex_lock(&sessions_lock);
+	for (n = 0; n < STANDIN_MAX_SESSIONS; n++)
+		if (!sessions[n].used)
+			break;
+	if (n < STANDIN_MAX_SESSIONS) {
+		memset(&sessions[n], 0, sizeof(sessions[n]));
+		sessions[n].used = true;
+	}
+	pthread_mutex_unlock(&sessions_lock);
+
+	if (n == STANDIN_MAX_SESSIONS)
+		return TEEC_ERROR_BUSY;
+
+	session->ctx = ctx;
+	session->session_id = n;
+	return TEEC_SUCCESS;
+}
+
+static void release_cipher(struct standin_cipher *c)
+{
+	EVP_CIPHER_CTX_free(c->evp);
+	memset(c, 0, sizeof(*c));
+}
+
+void TEEC_CloseSession(TEEC_Session *session)
+{
+	struct standin_session *sess = &sessions[session->session_id];
+	size_t n;
+
+	for (n = 0; n < TA_AES_MAX_CONTEXTS; n++)
+		release_cipher(&sess->ciphers[n]);
+
+	pthread_mutex_lock(&sessions_lock);
+	sess->used = false;
+	pthread_mutex_unlock(&sessions_lock);
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *ctx,
+				      TEEC_SharedMemory *shm)
+{
+	(void)ctx;
+
+	shm->shadow_buffer = NULL;
+	shm->buffer_allocated = false;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *ctx,
+				      TEEC_SharedMemory *shm)
+{
+	(void)ctx;
+
+	shm->buffer = malloc(shm->size ? shm->size : 1);
+	if (!shm->buffer)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	shm->buffer_allocated = true;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *shm)
+{
+	if (shm->buffer_allocated)
+		free(shm->buffer);
+	shm->buffer = NULL;
+	shm->size = 0;
+}
+
+static const EVP_CIPHER *evp_cipher(uint32_t algo, uint32_t key_size)
+{
+	bool aes256 = key_size == TA_AES_SIZE_256BIT;
+
+	switch (algo) {
+	case TA_AES_ALGO_ECB:
+		return aes256 ? EVP_aes_256_ecb() : EVP_aes_128_ecb();
+	case TA_AES_ALGO_CBC:
+		return aes256 ? EVP_aes_256_cbc() : EVP_aes_128_cbc();
+	case TA_AES_ALGO_CTR:
+		return aes256 ? EVP_aes_256_ctr() : EVP_aes_128_ctr();
+	default:
+		return NULL;
+	}
+}
+
+/* (Re)start the cipher with the key and an IV, NULL keeps the IV state */
+static TEEC_Result init_cipher(struct standin_cipher *c, const uint8_t *iv)
+{
+	const EVP_CIPHER *cipher = evp_cipher(c->algo, c->key_size);
+
+	if (!c->evp || !cipher)
+		return TEEC_ERROR_BAD_STATE;
+
+	if (EVP_CipherInit_ex(c->evp, cipher, NULL, c->key, iv,
+			      c->mode == TA_AES_MODE_ENCODE) != 1)
+		return TEEC_ERROR_GENERIC;
+
+	/* The TA uses the NOPAD flavours */
+	EVP_CIPHER_CTX_set_padding(c->evp, 0);
+	return TEEC_SUCCESS;
+}
+
+static TEEC_Result do_cipher(struct standin_cipher *c, const uint8_t *in,
+			     size_t len, uint8_t *out, size_t *out_len)
+{
+	int n;
+
+	if (*out_len < len)
+		return TEEC_ERROR_SHORT_BUFFER;
+	if (c->algo != TA_AES_ALGO_CTR && len % TA_AES_BLOCK_SIZE)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	if (EVP_CipherUpdate(c->evp, out, &n, in, len) != 1)
+		return TEEC_ERROR_GENERIC;
+
+	*out_len = n;
+	return TEEC_SUCCESS;
+}
+
+static void get_memref(TEEC_Operation *op, size_t idx,
+		       struct standin_memref *ref)
+{
+	uint32_t type = (op->paramTypes >> (4 * idx)) & 0xf;
+	TEEC_Parameter *p = &op->params[idx];
+
+	memset(ref, 0, sizeof(*ref));
+
+	switch (type) {
+	case TEEC_MEMREF_TEMP_INPUT:
+	case TEEC_MEMREF_TEMP_OUTPUT:
+	case TEEC_MEMREF_TEMP_INOUT:
+		/* The driver copies temporary references to shared memory */
+		ref->size = p->tmpref.size;
+		ref->bounce = malloc(ref->size ? ref->size : 1);
+		if (ref->bounce && type != TEEC_MEMREF_TEMP_OUTPUT)
+			memcpy(ref->bounce, p->tmpref.buffer, ref->size);
+		ref->buffer = ref->bounce;
+		break;
+	case TEEC_MEMREF_WHOLE:
+		ref->buffer = p->memref.parent->buffer;
+		ref->size = p->memref.parent->size;
+		break;
+	case TEEC_MEMREF_PARTIAL_INPUT:
+	case TEEC_MEMREF_PARTIAL_OUTPUT:
+	case TEEC_MEMREF_PARTIAL_INOUT:
+		ref->buffer = (uint8_t *)p->memref.parent->buffer +
+			      p->memref.offset;
+		ref->size = p->memref.size;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Report the output size and copy temporary outputs back */
+static void put_memref(TEEC_Operation *op, size_t idx,
+		       struct standin_memref *ref, bool output)
+{
+	uint32_t type = (op->paramTypes >> (4 * idx)) & 0xf;
+	TEEC_Parameter *p = &op->params[idx];
+
+	if (output && ref->bounce) {
+		if (ref->size <= p->tmpref.size)
+			memcpy(p->tmpref.buffer, ref->bounce, ref->size);
+		p->tmpref.size = ref->size;
+	} else if (output && type != TEEC_MEMREF_WHOLE) {
+		p->memref.size = ref->size;
+	}
+
+	free(ref->bounce);
+	ref->bounce = NULL;
+}
+
+static TEEC_Result invoke(struct standin_session *sess, uint32_t cmd,
+			  TEEC_Operation *op)
+{
+	uint32_t types = op ? op->paramTypes : 0;
+	struct standin_memref ref[4];
+	struct standin_cipher *c;
+	TEEC_Result res = TEEC_ERROR_NOT_SUPPORTED;
+	size_t out_idx;
+	size_t in_len;
+	uint32_t index = 0;
+	size_t n;
+
+	if (!op)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	/* Context index in param[3] when it is a value, ONESHOT uses 0 */
+	if (((types >> 12) & 0xf) == TEEC_VALUE_INPUT &&
+	    cmd != TA_AES_CMD_ONESHOT)
+		index = op->params[3].value.a;
+	if (index >= TA_AES_MAX_CONTEXTS)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	c = &sess->ciphers[index];
+
+	for (n = 0; n < 4; n++)
+		get_memref(op, n, &ref[n]);
+
+	switch (cmd) {
+	case TA_AES_CMD_PREPARE:
+		release_cipher(c);
+		c->algo = op->params[0].value.a;
+		c->key_size = op->params[1].value.a;
+		c->mode = op->params[2].value.a;
+		c->evp = EVP_CIPHER_CTX_new();
+		res = evp_cipher(c->algo, c->key_size) && c->evp ?
+		      TEEC_SUCCESS : TEEC_ERROR_NOT_SUPPORTED;
+		break;
+	case TA_AES_CMD_SET_KEY:
+		if (ref[0].size != c->key_size) {
+			res = TEEC_ERROR_BAD_PARAMETERS;
+			break;
+		}
+		memcpy(c->key, ref[0].buffer, c->key_size);
+		res = init_cipher(c, NULL);
+		break;
+	case TA_AES_CMD_SET_IV:
+		res = init_cipher(c, ref[0].buffer);
+		break;
+	case TA_AES_CMD_CIPHER:
+		/* In place with param[0] inout, else param[1] is the output */
+		out_idx = ref[1].buffer ? 1 : 0;
+		in_len = ref[0].size;
+		res = do_cipher(c, ref[0].buffer, in_len, ref[out_idx].buffer,
+				&ref[out_idx].size);
+		put_memref(op, out_idx, &ref[out_idx], true);
+		break;
+	case TA_AES_CMD_ONESHOT:
+		if (!c->evp || c->algo != op->params[0].value.a ||
+		    c->mode != op->params[0].value.b) {
+			release_cipher(c);
+			c->algo = op->params[0].value.a;
+			c->mode = op->params[0].value.b;
+			c->evp = EVP_CIPHER_CTX_new();
+		}
+		c->key_size = ref[1].size -
+			      (c->algo == TA_AES_ALGO_ECB ? 0 :
+							    TA_AES_BLOCK_SIZE);
+		if (c->key_size != TA_AES_SIZE_128BIT &&
+		    c->key_size != TA_AES_SIZE_256BIT) {
+			res = TEEC_ERROR_BAD_PARAMETERS;
+			break;
+		}
+		memcpy(c->key, ref[1].buffer, c->key_size);
+		res = init_cipher(c, c->algo == TA_AES_ALGO_ECB ? NULL :
+				  ref[1].buffer + c->key_size);
+		if (res != TEEC_SUCCESS)
+			break;
+		out_idx = ref[3].buffer ? 3 : 2;
+		res = do_cipher(c, ref[2].buffer, ref[2].size,
+				ref[out_idx].buffer, &ref[out_idx].size);
+		put_memref(op, out_idx, &ref[out_idx], true);
+		break;
+	case TA_AES_CMD_RELEASE:
+		release_cipher(c);
+		res = TEEC_SUCCESS;
+		break;
+	default:
+		break;
+	}
+
+	for (n = 0; n < 4; n++)
+		put_memref(op, n, &ref[n], false);
+
+	return res;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID,
+			       TEEC_Operation *operation,
+			       uint32_t *returnOrigin)
+{
+	if (returnOrigin)
+		*returnOrigin = TEEC_ORIGIN_TRUSTED_APP;
+
+	return invoke(&sessions[session->session_id], commandID, operation);
+}
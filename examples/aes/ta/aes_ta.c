@@ -31,13 +31,17 @@
 
 #include <aes_ta.h>
 
+#include "data_key.h"
+#include "key_store.h"
+
 #define AES128_KEY_BIT_SIZE		128
 #define AES128_KEY_BYTE_SIZE		(AES128_KEY_BIT_SIZE / 8)
 #define AES256_KEY_BIT_SIZE		256
 #define AES256_KEY_BYTE_SIZE		(AES256_KEY_BIT_SIZE / 8)
 
 /*
- * Ciphering context: each opened session relates to a cipehring operation.
+ * Ciphering context: each opened session holds TA_AES_MAX_CONTEXTS ciphering
+ * operations, addressed by index from the client.
  * - configure the AES flavour from a command.
  * - load key from a command (here the key is provided by the REE)
  * - reset init vector (here IV is provided by the REE)
@@ -49,8 +53,56 @@ struct aes_cipher {
 	uint32_t key_size;		/* AES key size in byte */
 	TEE_OperationHandle op_handle;	/* AES ciphering operation */
 	TEE_ObjectHandle key_handle;	/* transient object to load the key */
+	TEE_ObjectHandle key2_handle;	/* second key object, XTS only */
+	uint32_t ae_state;		/* AE_STATE_xxx, GCM and CCM only */
+	uint32_t tag_len;		/* AE tag size in byte */
+	uint32_t ccm_aad_left;		/* CCM AAD bytes still due */
+	uint32_t ccm_payload_left;	/* CCM payload bytes still due */
+	/* Key currently loaded by TA_AES_CMD_ONESHOT, 0 if none */
+	uint32_t oneshot_key_size;
+	uint8_t oneshot_key[AES256_KEY_BYTE_SIZE];
+	/* Next IV of TA_AES_CMD_ENCRYPT_AUTO_IV, seeded once per key */
+	bool auto_iv_ready;
+	uint8_t auto_iv[TA_AES_BLOCK_SIZE];
+	/* MAC engine, keyed apart from the cipher, see MAC_SET_KEY */
+	uint32_t mac_algo;		/* TEE_ALG_AES_CMAC or _HMAC_SHA256 */
+	uint32_t mac_key_bits;		/* key size of the MAC handles */
+	TEE_OperationHandle mac_handle;	/* keyed whenever allocated */
+	TEE_ObjectHandle mac_key_handle;
+	bool mac_active;		/* between MAC_INIT and MAC_FINAL */
+};
+
+struct aes_session {
+	struct aes_cipher ciphers[TA_AES_MAX_CONTEXTS];
 };
 
+/* Bytes of a TA_AES_CMD_ENCRYPT_THEN_MAC message ciphered at a time */
+#define ETM_CHUNK_SIZE			4096
+
+/* Progress of an authenticated encryption, GP panics on misordered calls */
+#define AE_STATE_IDLE			0	/* TA_AES_CMD_AE_INIT required */
+#define AE_STATE_AAD			1	/* AAD and payload accepted */
+#define AE_STATE_PAYLOAD		2	/* payload accepted */
+
+static bool is_ae_algo(uint32_t algo)
+{
+	return algo == TEE_ALG_AES_GCM || algo == TEE_ALG_AES_CCM;
+}
+
+/* Nonce and tag sizes GP accepts, TEE_AEInit() panics on anything else */
+static bool ae_sizes_valid(uint32_t algo, uint32_t nonce_len, uint32_t tag_len)
+{
+	if (tag_len > TA_AES_TAG_MAX_SIZE)
+		return false;
+
+	if (algo == TEE_ALG_AES_GCM)
+		return nonce_len && tag_len >= 12;
+
+	/* CCM */
+	return nonce_len >= 7 && nonce_len <= 13 &&
+	       tag_len >= 4 && !(tag_len % 2);
+}
+
 /*
  * Few routines to convert IDs from TA API into IDs from OP-TEE.
  */
@@ -66,6 +118,15 @@ static TEE_Result ta2tee_algo_id(uint32_t param, uint32_t *algo)
 	case TA_AES_ALGO_CTR:
 		*algo = TEE_ALG_AES_CTR;
 		return TEE_SUCCESS;
+	case TA_AES_ALGO_GCM:
+		*algo = TEE_ALG_AES_GCM;
+		return TEE_SUCCESS;
+	case TA_AES_ALGO_CCM:
+		*algo = TEE_ALG_AES_CCM;
+		return TEE_SUCCESS;
+	case TA_AES_ALGO_XTS:
+		*algo = TEE_ALG_AES_XTS;
+		return TEE_SUCCESS;
 	default:
 		EMSG("Invalid algo %u", param);
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -98,6 +159,148 @@ static TEE_Result ta2tee_mode_id(uint32_t param, uint32_t *mode)
 	}
 }
 
+static TEE_Result ta2tee_mac_algo(uint32_t param, uint32_t *algo)
+{
+	switch (param) {
+	case TA_AES_MAC_CMAC:
+		*algo = TEE_ALG_AES_CMAC;
+		return TEE_SUCCESS;
+	case TA_AES_MAC_HMAC_SHA256:
+		*algo = TEE_ALG_HMAC_SHA256;
+		return TEE_SUCCESS;
+	default:
+		EMSG("Invalid MAC algo %u", param);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+}
+
+static TEE_Result prepare_operation(struct aes_cipher *sess);
+
+/*
+ * Check the parameter types and get the addressed ciphering context.
+ * Commands with an unused param[3] accept a context index there, context
+ * 0 is used without it.
+ */
+static TEE_Result get_cipher(void *session, uint32_t param_types,
+			     uint32_t exp_param_types, TEE_Param params[4],
+			     struct aes_cipher **cipher)
+{
+	struct aes_session *sess = (struct aes_session *)session;
+	uint32_t index = 0;
+
+	if (param_types != exp_param_types) {
+		if (TEE_PARAM_TYPE_GET(exp_param_types, 3) !=
+		    TEE_PARAM_TYPE_NONE ||
+		    param_types != (exp_param_types |
+				    TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+						    TEE_PARAM_TYPE_NONE,
+						    TEE_PARAM_TYPE_NONE,
+						    TEE_PARAM_TYPE_VALUE_INPUT)))
+			return TEE_ERROR_BAD_PARAMETERS;
+
+		index = params[3].value.a;
+		if (index >= TA_AES_MAX_CONTEXTS) {
+			EMSG("Invalid context %" PRIu32, index);
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+	}
+
+	*cipher = &sess->ciphers[index];
+	return TEE_SUCCESS;
+}
+
+static void release_mac(struct aes_cipher *sess)
+{
+	if (sess->mac_key_handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(sess->mac_key_handle);
+	if (sess->mac_handle != TEE_HANDLE_NULL)
+		TEE_FreeOperation(sess->mac_handle);
+
+	sess->mac_key_handle = TEE_HANDLE_NULL;
+	sess->mac_handle = TEE_HANDLE_NULL;
+	sess->mac_algo = 0;
+	sess->mac_key_bits = 0;
+	sess->mac_active = false;
+}
+
+static void release_cipher(struct aes_cipher *sess)
+{
+	release_mac(sess);
+
+	if (sess->key_handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(sess->key_handle);
+	if (sess->key2_handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(sess->key2_handle);
+	if (sess->op_handle != TEE_HANDLE_NULL)
+		TEE_FreeOperation(sess->op_handle);
+
+	TEE_MemFill(sess, 0, sizeof(*sess));
+	sess->mac_key_handle = TEE_HANDLE_NULL;
+	sess->mac_handle = TEE_HANDLE_NULL;
+	sess->key_handle = TEE_HANDLE_NULL;
+	sess->key2_handle = TEE_HANDLE_NULL;
+	sess->op_handle = TEE_HANDLE_NULL;
+	sess->ae_state = AE_STATE_IDLE;
+}
+
+/* Bytes of key material expected by SET_KEY, XTS takes key1 || key2 */
+static uint32_t key_material_size(struct aes_cipher *sess)
+{
+	return sess->algo == TEE_ALG_AES_XTS ? 2 * sess->key_size :
+					       sess->key_size;
+}
+
+/*
+ * Populate the key object(s) with key_material_size() bytes and set them
+ * on the operation. The operation is reset first unless it has no key
+ * yet, see set_aes_key().
+ */
+static TEE_Result load_key(struct aes_cipher *sess, const void *key,
+			   bool reset)
+{
+	TEE_Attribute attr;
+	TEE_Result res;
+
+	/* A new key starts a new IV sequence */
+	sess->auto_iv_ready = false;
+
+	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key,
+			     sess->key_size);
+
+	TEE_ResetTransientObject(sess->key_handle);
+	res = TEE_PopulateTransientObject(sess->key_handle, &attr, 1);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_PopulateTransientObject failed, %x", res);
+		return res;
+	}
+
+	if (sess->algo == TEE_ALG_AES_XTS) {
+		TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE,
+				     (const uint8_t *)key + sess->key_size,
+				     sess->key_size);
+
+		TEE_ResetTransientObject(sess->key2_handle);
+		res = TEE_PopulateTransientObject(sess->key2_handle, &attr, 1);
+		if (res != TEE_SUCCESS) {
+			EMSG("TEE_PopulateTransientObject failed, %x", res);
+			return res;
+		}
+	}
+
+	if (reset)
+		TEE_ResetOperation(sess->op_handle);
+
+	if (sess->algo == TEE_ALG_AES_XTS)
+		res = TEE_SetOperationKey2(sess->op_handle, sess->key_handle,
+					   sess->key2_handle);
+	else
+		res = TEE_SetOperationKey(sess->op_handle, sess->key_handle);
+	if (res != TEE_SUCCESS)
+		EMSG("TEE_SetOperationKey failed %x", res);
+
+	return res;
+}
+
 /*
  * Process command TA_AES_CMD_PREPARE. API in aes_ta.h
  *
@@ -116,30 +319,55 @@ static TEE_Result alloc_resources(void *session, uint32_t param_types,
 				TEE_PARAM_TYPE_VALUE_INPUT,
 				TEE_PARAM_TYPE_NONE);
 	struct aes_cipher *sess;
-	TEE_Attribute attr;
+	uint32_t key_size;
+	uint32_t algo;
+	uint32_t mode;
 	TEE_Result res;
-	char *key;
 
-	/* Get ciphering context from session ID */
+	/* Get ciphering context from session ID and parameters */
 	DMSG("Session %p: get ciphering resources", session);
-	sess = (struct aes_cipher *)session;
-
-	/* Safely get the invocation parameters */
-	if (param_types != exp_param_types)
-		return TEE_ERROR_BAD_PARAMETERS;
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	res = ta2tee_algo_id(params[0].value.a, &sess->algo);
+	/* Leave the context as is on invalid parameters */
+	res = ta2tee_algo_id(params[0].value.a, &algo);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = ta2tee_key_size(params[1].value.a, &sess->key_size);
+	res = ta2tee_key_size(params[1].value.a, &key_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = ta2tee_mode_id(params[2].value.a, &sess->mode);
+	res = ta2tee_mode_id(params[2].value.a, &mode);
 	if (res != TEE_SUCCESS)
 		return res;
 
+	sess->algo = algo;
+	sess->key_size = key_size;
+	sess->mode = mode;
+
+	/* Never keep a configuration its handles were not allocated for */
+	res = prepare_operation(sess);
+	if (res != TEE_SUCCESS)
+		release_cipher(sess);
+
+	return res;
+}
+
+/*
+ * Allocate operation and key object for sess->algo, sess->mode and
+ * sess->key_size and load a dummy key into the operation.
+ */
+static TEE_Result prepare_operation(struct aes_cipher *sess)
+{
+	TEE_Result res;
+	char *key;
+
+	/* A loaded one-shot key does not survive a new operation */
+	sess->oneshot_key_size = 0;
+	sess->ae_state = AE_STATE_IDLE;
+
 	/*
 	 * Ready to allocate the resources which are:
 	 * - an operation handle, for an AES ciphering of given configuration
@@ -151,7 +379,7 @@ static TEE_Result alloc_resources(void *session, uint32_t param_types,
 	if (sess->op_handle != TEE_HANDLE_NULL)
 		TEE_FreeOperation(sess->op_handle);
 
-	/* Allocate operation: AES/CTR, mode and size from params */
+	/* Allocate operation: AES flavour, mode and size (per key) from params */
 	res = TEE_AllocateOperation(&sess->op_handle,
 				    sess->algo,
 				    sess->mode,
@@ -176,6 +404,21 @@ static TEE_Result alloc_resources(void *session, uint32_t param_types,
 		goto err;
 	}
 
+	if (sess->key2_handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(sess->key2_handle);
+	sess->key2_handle = TEE_HANDLE_NULL;
+
+	if (sess->algo == TEE_ALG_AES_XTS) {
+		res = TEE_AllocateTransientObject(TEE_TYPE_AES,
+						  sess->key_size * 8,
+						  &sess->key2_handle);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to allocate transient object");
+			sess->key2_handle = TEE_HANDLE_NULL;
+			goto err;
+		}
+	}
+
 	/*
 	 * When loading a key in the cipher session, set_aes_key()
 	 * will reset the operation and load a key. But we cannot
@@ -185,25 +428,20 @@ static TEE_Result alloc_resources(void *session, uint32_t param_types,
 	 * dummy key in the operation so that operation can be reset
 	 * when updating the key.
 	 */
-	key = TEE_Malloc(sess->key_size, 0);
+	key = TEE_Malloc(key_material_size(sess), 0);
 	if (!key) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto err;
 	}
 
-	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, sess->key_size);
-
-	res = TEE_PopulateTransientObject(sess->key_handle, &attr, 1);
-	if (res != TEE_SUCCESS) {
-		EMSG("TEE_PopulateTransientObject failed, %x", res);
-		goto err;
-	}
+	/* The two XTS keys shall differ */
+	if (sess->algo == TEE_ALG_AES_XTS)
+		TEE_MemFill(key + sess->key_size, 0xff, sess->key_size);
 
-	res = TEE_SetOperationKey(sess->op_handle, sess->key_handle);
-	if (res != TEE_SUCCESS) {
-		EMSG("TEE_SetOperationKey failed %x", res);
+	res = load_key(sess, key, false);
+	TEE_Free(key);
+	if (res != TEE_SUCCESS)
 		goto err;
-	}
 
 	return res;
 
@@ -216,6 +454,10 @@ err:
 		TEE_FreeTransientObject(sess->key_handle);
 	sess->key_handle = TEE_HANDLE_NULL;
 
+	if (sess->key2_handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(sess->key2_handle);
+	sess->key2_handle = TEE_HANDLE_NULL;
+
 	return res;
 }
 
@@ -231,25 +473,25 @@ static TEE_Result set_aes_key(void *session, uint32_t param_types,
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
 	struct aes_cipher *sess;
-	TEE_Attribute attr;
 	TEE_Result res;
 	uint32_t key_sz;
 	char *key;
 
-	/* Get ciphering context from session ID */
+	/* Get ciphering context from session ID and parameters */
 	DMSG("Session %p: load key material", session);
-	sess = (struct aes_cipher *)session;
-
-	/* Safely get the invocation parameters */
-	if (param_types != exp_param_types)
-		return TEE_ERROR_BAD_PARAMETERS;
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
 
 	key = params[0].memref.buffer;
 	key_sz = params[0].memref.size;
 
-	if (key_sz != sess->key_size) {
+	if (sess->op_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	if (key_sz != key_material_size(sess)) {
 		EMSG("Wrong key size %" PRIu32 ", expect %" PRIu32 " bytes",
-		     key_sz, sess->key_size);
+		     key_sz, key_material_size(sess));
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
@@ -268,27 +510,119 @@ static TEE_Result set_aes_key(void *session, uint32_t param_types,
 	 * API cannot be used on operation with key(s) not yet set. Hence,
 	 * when allocating the operation handle, we load a dummy key.
 	 * Thus, set_key sequence always reset then set key on operation.
+	 * XTS does the same with two keys and TEE_SetOperationKey2().
 	 */
+	sess->oneshot_key_size = 0;
+	sess->ae_state = AE_STATE_IDLE;
 
-	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_sz);
+	return load_key(sess, key, true);
+}
 
-	TEE_ResetTransientObject(sess->key_handle);
-	res = TEE_PopulateTransientObject(sess->key_handle, &attr, 1);
-	if (res != TEE_SUCCESS) {
-		EMSG("TEE_PopulateTransientObject failed, %x", res);
+/*
+ * Process command TA_AES_CMD_SET_KEY_ID. API in aes_ta.h
+ */
+static TEE_Result set_aes_key_id(void *session, uint32_t param_types,
+				 TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_ObjectHandle key;
+	TEE_Result res;
+	uint32_t key_sz;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: load stored key", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
 		return res;
+
+	if (sess->op_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	/* Stored keys are single AES keys */
+	if (sess->algo == TEE_ALG_AES_XTS)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	res = key_store_get(params[0].memref.buffer, params[0].memref.size,
+			    &key, &key_sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (key_sz != sess->key_size) {
+		EMSG("Wrong key size %" PRIu32 ", expect %" PRIu32 " bytes",
+		     key_sz, sess->key_size);
+		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
+	/* The cached object is already populated, only set it */
+	sess->oneshot_key_size = 0;
+	sess->ae_state = AE_STATE_IDLE;
 	TEE_ResetOperation(sess->op_handle);
-	res = TEE_SetOperationKey(sess->op_handle, sess->key_handle);
-	if (res != TEE_SUCCESS) {
+	res = TEE_SetOperationKey(sess->op_handle, key);
+	if (res != TEE_SUCCESS)
 		EMSG("TEE_SetOperationKey failed %x", res);
-		return res;
-	}
 
 	return res;
 }
 
+/*
+ * Process commands TA_AES_CMD_KEY_GENERATE, TA_AES_CMD_KEY_IMPORT and
+ * TA_AES_CMD_KEY_DELETE. API in aes_ta.h
+ */
+static TEE_Result manage_key(uint32_t cmd, uint32_t param_types,
+			     TEE_Param params[4])
+{
+	uint32_t exp_param_types;
+	void *id = params[0].memref.buffer;
+	uint32_t id_len = params[0].memref.size;
+	TEE_Identity client;
+	TEE_Result res;
+
+	switch (cmd) {
+	case TA_AES_CMD_KEY_GENERATE:
+		exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_VALUE_INPUT,
+						  TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE);
+		break;
+	case TA_AES_CMD_KEY_IMPORT:
+		exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE);
+		break;
+	default:
+		exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE);
+		break;
+	}
+
+	/* Safely get the invocation parameters */
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* Keys, KEKs among them, are not for any normal world process */
+	res = client_identity(&client);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	switch (cmd) {
+	case TA_AES_CMD_KEY_GENERATE:
+		return key_store_generate(id, id_len, params[1].value.a);
+	case TA_AES_CMD_KEY_IMPORT:
+		return key_store_import(id, id_len, params[1].memref.buffer,
+					params[1].memref.size);
+	default:
+		return key_store_delete(id, id_len);
+	}
+}
+
 /*
  * Process command TA_AES_CMD_SET_IV. API in aes_ta.h
  */
@@ -301,16 +635,22 @@ static TEE_Result reset_aes_iv(void *session, uint32_t param_types,
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
 	struct aes_cipher *sess;
+	TEE_Result res;
 	size_t iv_sz;
 	char *iv;
 
-	/* Get ciphering context from session ID */
+	/* Get ciphering context from session ID and parameters */
 	DMSG("Session %p: reset initial vector", session);
-	sess = (struct aes_cipher *)session;
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	/* Safely get the invocation parameters */
-	if (param_types != exp_param_types)
-		return TEE_ERROR_BAD_PARAMETERS;
+	if (sess->op_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	/* GCM and CCM get their nonce from TA_AES_CMD_AE_INIT */
+	if (is_ae_algo(sess->algo))
+		return TEE_ERROR_BAD_STATE;
 
 	iv = params[0].memref.buffer;
 	iv_sz = params[0].memref.size;
@@ -334,81 +674,1236 @@ static TEE_Result cipher_buffer(void *session, uint32_t param_types,
 				TEE_PARAM_TYPE_MEMREF_OUTPUT,
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
+	const uint32_t exp_inplace_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
 	struct aes_cipher *sess;
+	TEE_Param *out = &params[1];
+	TEE_Result res;
+	uint32_t in_sz;
 
-	/* Get ciphering context from session ID */
+	/* Get ciphering context from session ID and parameters */
 	DMSG("Session %p: cipher buffer", session);
-	sess = (struct aes_cipher *)session;
-
-	/* Safely get the invocation parameters */
-	if (param_types != exp_param_types)
-		return TEE_ERROR_BAD_PARAMETERS;
+	if (TEE_PARAM_TYPE_GET(param_types, 0) == TEE_PARAM_TYPE_MEMREF_INOUT) {
+		/* In place, output size is updated in param[0] */
+		res = get_cipher(session, param_types, exp_inplace_types,
+				 params, &sess);
+		out = &params[0];
+	} else {
+		res = get_cipher(session, param_types, exp_param_types,
+				 params, &sess);
+	}
+	if (res != TEE_SUCCESS)
+		return res;
 
-	if (params[1].memref.size < params[0].memref.size) {
-		EMSG("Bad sizes: in %d, out %d", params[0].memref.size,
-						 params[1].memref.size);
+	in_sz = params[0].memref.size;
+	if (out->memref.size < in_sz) {
+		EMSG("Bad sizes: in %d, out %d", in_sz, out->memref.size);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
 	if (sess->op_handle == TEE_HANDLE_NULL)
 		return TEE_ERROR_BAD_STATE;
 
+	if (is_ae_algo(sess->algo)) {
+		if (sess->ae_state == AE_STATE_IDLE)
+			return TEE_ERROR_BAD_STATE;
+
+		/* CCM panics on payload before all AAD or beyond its size */
+		if (sess->algo == TEE_ALG_AES_CCM) {
+			if (sess->ccm_aad_left)
+				return TEE_ERROR_BAD_STATE;
+			if (in_sz > sess->ccm_payload_left)
+				return TEE_ERROR_BAD_PARAMETERS;
+			sess->ccm_payload_left -= in_sz;
+		}
+
+		sess->ae_state = AE_STATE_PAYLOAD;
+		return TEE_AEUpdate(sess->op_handle,
+				    params[0].memref.buffer, in_sz,
+				    out->memref.buffer, &out->memref.size);
+	}
+
 	/*
-	 * Process ciphering operation on provided buffers
+	 * Process ciphering operation on provided buffers, the GP API
+	 * accepts the same buffer as source and destination
 	 */
 	return TEE_CipherUpdate(sess->op_handle,
-				params[0].memref.buffer, params[0].memref.size,
-				params[1].memref.buffer, &params[1].memref.size);
+				params[0].memref.buffer, in_sz,
+				out->memref.buffer, &out->memref.size);
 }
 
-TEE_Result TA_CreateEntryPoint(void)
+/*
+ * Process command TA_AES_CMD_AE_INIT. API in aes_ta.h
+ */
+static TEE_Result ae_init(void *session, uint32_t param_types,
+			  TEE_Param params[4])
 {
-	/* Nothing to do */
-	return TEE_SUCCESS;
-}
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	uint32_t tag_len;
+	TEE_Result res;
 
-void TA_DestroyEntryPoint(void)
-{
-	/* Nothing to do */
-}
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: AE init", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
 
-TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
-					TEE_Param __unused params[4],
-					void __unused **session)
-{
-	struct aes_cipher *sess;
+	if (sess->op_handle == TEE_HANDLE_NULL || !is_ae_algo(sess->algo))
+		return TEE_ERROR_BAD_STATE;
 
-	/*
-	 * Allocate and init ciphering materials for the session.
-	 * The address of the structure is used as session ID for
-	 * the client.
-	 */
-	sess = TEE_Malloc(sizeof(*sess), 0);
-	if (!sess)
-		return TEE_ERROR_OUT_OF_MEMORY;
+	tag_len = params[1].value.a;
+	if (!ae_sizes_valid(sess->algo, params[0].memref.size, tag_len))
+		return TEE_ERROR_BAD_PARAMETERS;
 
-	sess->key_handle = TEE_HANDLE_NULL;
-	sess->op_handle = TEE_HANDLE_NULL;
+	/* TEE_AEInit() requires the operation in initial state */
+	TEE_ResetOperation(sess->op_handle);
+	sess->ae_state = AE_STATE_IDLE;
 
-	*session = (void *)sess;
-	DMSG("Session %p: newly allocated", *session);
+	res = TEE_AEInit(sess->op_handle,
+			 params[0].memref.buffer, params[0].memref.size,
+			 tag_len * 8, params[1].value.b, params[2].value.a);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_AEInit failed %x", res);
+		return res;
+	}
+
+	sess->tag_len = tag_len;
+	sess->ccm_aad_left = params[1].value.b;
+	sess->ccm_payload_left = params[2].value.a;
+	sess->ae_state = AE_STATE_AAD;
 
 	return TEE_SUCCESS;
 }
 
-void TA_CloseSessionEntryPoint(void *session)
+/*
+ * Process command TA_AES_CMD_AE_UPDATE_AAD. API in aes_ta.h
+ */
+static TEE_Result ae_update_aad(void *session, uint32_t param_types,
+				TEE_Param params[4])
 {
-	struct aes_cipher *sess;
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Result res;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: AE update AAD", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* AAD must precede the payload */
+	if (sess->ae_state != AE_STATE_AAD)
+		return TEE_ERROR_BAD_STATE;
+
+	if (sess->algo == TEE_ALG_AES_CCM) {
+		if (params[0].memref.size > sess->ccm_aad_left)
+			return TEE_ERROR_BAD_PARAMETERS;
+		sess->ccm_aad_left -= params[0].memref.size;
+	}
+
+	TEE_AEUpdateAAD(sess->op_handle,
+			params[0].memref.buffer, params[0].memref.size);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Process commands TA_AES_CMD_AE_ENCRYPT_FINAL and
+ * TA_AES_CMD_AE_DECRYPT_FINAL. API in aes_ta.h
+ */
+static TEE_Result ae_final(void *session, uint32_t param_types,
+			   TEE_Param params[4], bool encrypt)
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				encrypt ? TEE_PARAM_TYPE_MEMREF_OUTPUT :
+					  TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Result res;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: AE final", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->ae_state == AE_STATE_IDLE)
+		return TEE_ERROR_BAD_STATE;
+
+	if (sess->mode != (encrypt ? TEE_MODE_ENCRYPT : TEE_MODE_DECRYPT))
+		return TEE_ERROR_BAD_STATE;
+
+	/* CCM ends exactly at the sizes given to TA_AES_CMD_AE_INIT */
+	if (sess->algo == TEE_ALG_AES_CCM) {
+		if (sess->ccm_aad_left)
+			return TEE_ERROR_BAD_STATE;
+		if (params[0].memref.size != sess->ccm_payload_left)
+			return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (params[1].memref.size < params[0].memref.size) {
+		params[1].memref.size = params[0].memref.size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (encrypt) {
+		if (params[2].memref.size < sess->tag_len) {
+			params[2].memref.size = sess->tag_len;
+			return TEE_ERROR_SHORT_BUFFER;
+		}
+
+		res = TEE_AEEncryptFinal(sess->op_handle,
+					 params[0].memref.buffer,
+					 params[0].memref.size,
+					 params[1].memref.buffer,
+					 &params[1].memref.size,
+					 params[2].memref.buffer,
+					 &params[2].memref.size);
+	} else {
+		if (params[2].memref.size != sess->tag_len)
+			return TEE_ERROR_BAD_PARAMETERS;
+
+		/* TEE_ERROR_MAC_INVALID if the tag does not match */
+		res = TEE_AEDecryptFinal(sess->op_handle,
+					 params[0].memref.buffer,
+					 params[0].memref.size,
+					 params[1].memref.buffer,
+					 &params[1].memref.size,
+					 params[2].memref.buffer,
+					 params[2].memref.size);
+	}
+
+	/* A new message always starts from TA_AES_CMD_AE_INIT */
+	sess->ae_state = AE_STATE_IDLE;
+
+	return res;
+}
+
+/* Compare without early exit, the key may be REE controlled */
+static bool same_key(const uint8_t *a, const uint8_t *b, size_t size)
+{
+	uint8_t diff = 0;
+	size_t n;
+
+	for (n = 0; n < size; n++)
+		diff |= a[n] ^ b[n];
+
+	return !diff;
+}
+
+/*
+ * Process command TA_AES_CMD_ONESHOT. API in aes_ta.h
+ *
+ * The operation is only reallocated when the algorithm, the direction
+ * or the key size differ from the previous request, and the key is only
+ * reloaded when it changed, so a stream of requests with the same
+ * configuration costs one TEE_CipherInit() and one TEE_CipherDoFinal().
+ */
+static TEE_Result cipher_oneshot(void *session, uint32_t param_types,
+				 TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT);
+	const uint32_t exp_inplace_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INOUT,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Param *out = &params[3];
+	TEE_Result res;
+	uint32_t in_sz;
+	uint32_t algo;
+	uint32_t mode;
+	uint32_t key_sz;
+	uint32_t iv_sz;
+	uint8_t *key;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: one-shot cipher", session);
+	if (TEE_PARAM_TYPE_GET(param_types, 2) == TEE_PARAM_TYPE_MEMREF_INOUT) {
+		/* In place, output size is updated in param[2] */
+		res = get_cipher(session, param_types, exp_inplace_types,
+				 params, &sess);
+		out = &params[2];
+	} else {
+		res = get_cipher(session, param_types, exp_param_types,
+				 params, &sess);
+	}
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = ta2tee_algo_id(params[0].value.a, &algo);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* No room for AAD and tag in the parameters, XTS has its own command */
+	if (is_ae_algo(algo) || algo == TEE_ALG_AES_XTS)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	res = ta2tee_mode_id(params[0].value.b, &mode);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* param[1] holds key || IV, ECB has no IV */
+	iv_sz = algo == TEE_ALG_AES_ECB_NOPAD ? 0 : TA_AES_BLOCK_SIZE;
+	if (params[1].memref.size < iv_sz)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	key = params[1].memref.buffer;
+	res = ta2tee_key_size(params[1].memref.size - iv_sz, &key_sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	in_sz = params[2].memref.size;
+
+	/* GP panics on partial blocks of the NOPAD modes */
+	if (algo != TEE_ALG_AES_CTR && in_sz % TA_AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (out->memref.size < in_sz) {
+		EMSG("Bad sizes: in %" PRIu32 ", out %" PRIu32,
+		     in_sz, out->memref.size);
+		out->memref.size = in_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (sess->op_handle == TEE_HANDLE_NULL || sess->algo != algo ||
+	    sess->mode != mode || sess->key_size != key_sz) {
+		sess->algo = algo;
+		sess->mode = mode;
+		sess->key_size = key_sz;
+
+		res = prepare_operation(sess);
+		if (res != TEE_SUCCESS) {
+			release_cipher(sess);
+			return res;
+		}
+	}
+
+	if (sess->oneshot_key_size != key_sz ||
+	    !same_key(sess->oneshot_key, key, key_sz)) {
+		sess->oneshot_key_size = 0;
+
+		res = load_key(sess, key, true);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		TEE_MemMove(sess->oneshot_key, key, key_sz);
+		sess->oneshot_key_size = key_sz;
+	}
+
+	TEE_CipherInit(sess->op_handle, iv_sz ? key + key_sz : NULL, iv_sz);
+
+	return TEE_CipherDoFinal(sess->op_handle,
+				 params[2].memref.buffer, in_sz,
+				 out->memref.buffer, &out->memref.size);
+}
+
+/*
+ * Process command TA_AES_CMD_XTS_SECTORS. API in aes_ta.h
+ *
+ * Each sector is an XTS data unit whose tweak is its sector number as a
+ * 128 bit little endian value (IEEE 1619), so one request covers many
+ * sectors without a SET_IV per sector.
+ */
+static TEE_Result cipher_xts_sectors(void *session, uint32_t param_types,
+				     TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT);
+	const uint32_t exp_inplace_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INOUT,
+				TEE_PARAM_TYPE_NONE);
+	uint8_t tweak[TA_AES_BLOCK_SIZE] = { 0 };
+	struct aes_cipher *sess;
+	TEE_Param *out = &params[3];
+	uint64_t sector;
+	uint32_t sector_sz;
+	uint32_t out_sz;
+	uint32_t pos;
+	uint32_t in_sz;
+	uint8_t *dst;
+	uint8_t *src;
+	TEE_Result res;
+	size_t n;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: XTS sectors", session);
+	if (TEE_PARAM_TYPE_GET(param_types, 2) == TEE_PARAM_TYPE_MEMREF_INOUT) {
+		res = get_cipher(session, param_types, exp_inplace_types,
+				 params, &sess);
+		out = &params[2];
+	} else {
+		res = get_cipher(session, param_types, exp_param_types,
+				 params, &sess);
+	}
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->op_handle == TEE_HANDLE_NULL ||
+	    sess->algo != TEE_ALG_AES_XTS)
+		return TEE_ERROR_BAD_STATE;
 
-	/* Get ciphering context from session ID */
+	sector = ((uint64_t)params[0].value.b << 32) | params[0].value.a;
+	sector_sz = params[1].value.a;
+	in_sz = params[2].memref.size;
+
+	if (sector_sz < TA_AES_BLOCK_SIZE || sector_sz % TA_AES_BLOCK_SIZE ||
+	    in_sz % sector_sz) {
+		EMSG("Bad sizes: sector %" PRIu32 ", data %" PRIu32,
+		     sector_sz, in_sz);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (out->memref.size < in_sz) {
+		out->memref.size = in_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	src = params[2].memref.buffer;
+	dst = out->memref.buffer;
+
+	for (pos = 0; pos < in_sz; pos += sector_sz, sector++) {
+		for (n = 0; n < sizeof(sector); n++)
+			tweak[n] = sector >> (8 * n);
+
+		TEE_CipherInit(sess->op_handle, tweak, sizeof(tweak));
+
+		out_sz = sector_sz;
+		res = TEE_CipherDoFinal(sess->op_handle, src + pos, sector_sz,
+					dst + pos, &out_sz);
+		if (res != TEE_SUCCESS) {
+			EMSG("TEE_CipherDoFinal failed %x", res);
+			return res;
+		}
+	}
+
+	out->memref.size = in_sz;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Process command TA_AES_CMD_CIPHER_PACKETS. API in aes_ta.h
+ *
+ * Each descriptor is copied into TA memory before it is checked so the
+ * client cannot change it between the bounds check and its use.
+ */
+static TEE_Result cipher_packets(void *session, uint32_t param_types,
+				 TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+	const uint32_t exp_inplace_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INOUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	const struct ta_aes_packet *table;
+	struct ta_aes_packet pkt;
+	struct aes_cipher *sess;
+	TEE_Param *out = &params[2];
+	uint32_t count;
+	uint32_t out_sz;
+	uint32_t in_sz;
+	uint32_t iv_sz;
+	uint8_t *dst;
+	uint8_t *src;
+	TEE_Result res;
+	uint32_t n;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: cipher packets", session);
+	if (TEE_PARAM_TYPE_GET(param_types, 1) == TEE_PARAM_TYPE_MEMREF_INOUT) {
+		res = get_cipher(session, param_types, exp_inplace_types,
+				 params, &sess);
+		out = &params[1];
+	} else {
+		res = get_cipher(session, param_types, exp_param_types,
+				 params, &sess);
+	}
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->op_handle == TEE_HANDLE_NULL || is_ae_algo(sess->algo) ||
+	    sess->algo == TEE_ALG_AES_XTS)
+		return TEE_ERROR_BAD_STATE;
+
+	if (params[0].memref.size % sizeof(pkt))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	table = params[0].memref.buffer;
+	count = params[0].memref.size / sizeof(pkt);
+	in_sz = params[1].memref.size;
+	iv_sz = sess->algo == TEE_ALG_AES_ECB_NOPAD ? 0 : TA_AES_BLOCK_SIZE;
+
+	if (out->memref.size < in_sz) {
+		EMSG("Bad sizes: in %" PRIu32 ", out %" PRIu32,
+		     in_sz, out->memref.size);
+		out->memref.size = in_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	src = params[1].memref.buffer;
+	dst = out->memref.buffer;
+
+	for (n = 0; n < count; n++) {
+		TEE_MemMove(&pkt, table + n, sizeof(pkt));
+
+		if (pkt.offset > in_sz || pkt.length > in_sz - pkt.offset) {
+			EMSG("Packet %" PRIu32 " out of bounds", n);
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+
+		/* GP panics on partial blocks of the NOPAD modes */
+		if (sess->algo != TEE_ALG_AES_CTR &&
+		    pkt.length % TA_AES_BLOCK_SIZE) {
+			EMSG("Packet %" PRIu32 " not a multiple of the block size",
+			     n);
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+
+		TEE_CipherInit(sess->op_handle, iv_sz ? pkt.iv : NULL, iv_sz);
+
+		out_sz = pkt.length;
+		res = TEE_CipherDoFinal(sess->op_handle, src + pkt.offset,
+					pkt.length, dst + pkt.offset, &out_sz);
+		if (res != TEE_SUCCESS) {
+			EMSG("Packet %" PRIu32 ": TEE_CipherDoFinal failed %x",
+			     n, res);
+			return res;
+		}
+	}
+
+	out->memref.size = in_sz;
+	return TEE_SUCCESS;
+}
+
+/* Add blocks to the big endian counter of size bytes */
+static void increment_iv(uint8_t *iv, size_t size, uint64_t blocks)
+{
+	uint32_t sum;
+	size_t n = size;
+
+	while (n-- && blocks) {
+		sum = iv[n] + (uint32_t)(blocks & 0xff);
+		iv[n] = sum;
+		blocks = (blocks >> 8) + (sum >> 8);
+	}
+}
+
+/*
+ * Copy the next TA chosen IV (iv_sz bytes) and step the sequence past
+ * the blocks counter blocks the message uses. CBC gets a fresh random IV
+ * each time.
+ */
+static void next_auto_iv(struct aes_cipher *sess, uint8_t *iv,
+			 uint32_t iv_sz, uint64_t blocks)
+{
+	if (!sess->auto_iv_ready || sess->algo == TEE_ALG_AES_CBC_NOPAD) {
+		TEE_GenerateRandom(sess->auto_iv, sizeof(sess->auto_iv));
+		sess->auto_iv_ready = true;
+	}
+
+	TEE_MemMove(iv, sess->auto_iv, iv_sz);
+	increment_iv(sess->auto_iv, iv_sz, blocks);
+}
+
+/*
+ * Process command TA_AES_CMD_ENCRYPT_AUTO_IV. API in aes_ta.h
+ *
+ * The IV is never taken from the client, so the client cannot make the
+ * TA reuse a counter block or a nonce.
+ */
+static TEE_Result encrypt_auto_iv(void *session, uint32_t param_types,
+				  TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+	uint8_t iv[TA_AES_BLOCK_SIZE];
+	struct aes_cipher *sess;
+	uint32_t tag_sz = 0;
+	uint32_t iv_sz;
+	uint32_t in_sz;
+	uint32_t out_sz;
+	uint8_t *out;
+	TEE_Result res;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: encrypt with TA IV", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->op_handle == TEE_HANDLE_NULL ||
+	    sess->mode != TEE_MODE_ENCRYPT)
+		return TEE_ERROR_BAD_STATE;
+
+	switch (sess->algo) {
+	case TEE_ALG_AES_CBC_NOPAD:
+	case TEE_ALG_AES_CTR:
+		iv_sz = TA_AES_BLOCK_SIZE;
+		break;
+	case TEE_ALG_AES_GCM:
+	case TEE_ALG_AES_CCM:
+		iv_sz = TA_AES_AUTO_NONCE_SIZE;
+		tag_sz = TA_AES_TAG_MAX_SIZE;
+		break;
+	default:
+		return TEE_ERROR_BAD_STATE;
+	}
+
+	in_sz = params[0].memref.size;
+	if (in_sz > UINT32_MAX - tag_sz)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* GP panics on partial CBC blocks, check before using an IV */
+	if (sess->algo == TEE_ALG_AES_CBC_NOPAD && in_sz % TA_AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[1].memref.size < in_sz + tag_sz ||
+	    params[2].memref.size < iv_sz) {
+		params[1].memref.size = in_sz + tag_sz;
+		params[2].memref.size = iv_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	out = params[1].memref.buffer;
+	out_sz = in_sz;
+
+	if (tag_sz) {
+		next_auto_iv(sess, iv, iv_sz, 1);
+
+		/* TEE_AEInit() requires the operation in initial state */
+		TEE_ResetOperation(sess->op_handle);
+		sess->ae_state = AE_STATE_IDLE;
+
+		res = TEE_AEInit(sess->op_handle, iv, iv_sz, tag_sz * 8, 0,
+				 in_sz);
+		if (res == TEE_SUCCESS)
+			res = TEE_AEEncryptFinal(sess->op_handle,
+						 params[0].memref.buffer, in_sz,
+						 out, &out_sz, out + in_sz,
+						 &tag_sz);
+	} else {
+		next_auto_iv(sess, iv, iv_sz,
+			     ((uint64_t)in_sz + TA_AES_BLOCK_SIZE - 1) /
+			     TA_AES_BLOCK_SIZE);
+
+		TEE_CipherInit(sess->op_handle, iv, iv_sz);
+		res = TEE_CipherDoFinal(sess->op_handle,
+					params[0].memref.buffer, in_sz,
+					out, &out_sz);
+	}
+	if (res != TEE_SUCCESS) {
+		EMSG("Encryption failed %x", res);
+		return res;
+	}
+
+	TEE_MemMove(params[2].memref.buffer, iv, iv_sz);
+	params[2].memref.size = iv_sz;
+	params[1].memref.size = out_sz + tag_sz;
+
+	return TEE_SUCCESS;
+}
+
+static uint32_t mac_size(struct aes_cipher *sess)
+{
+	return sess->mac_algo == TEE_ALG_AES_CMAC ? TA_AES_CMAC_SIZE :
+						    TA_AES_HMAC_SHA256_SIZE;
+}
+
+/*
+ * Process command TA_AES_CMD_MAC_SET_KEY. API in aes_ta.h
+ *
+ * The MAC operation and key object are only reallocated when the MAC
+ * algorithm or the CMAC key size changes, HMAC handles are allocated for
+ * the largest key. A failed key load releases the MAC engine, so an
+ * allocated operation always has a key and can be reset.
+ */
+static TEE_Result set_mac_key(void *session, uint32_t param_types,
+			      TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Attribute attr;
+	uint32_t key_bits;
+	uint32_t obj_type;
+	uint32_t key_sz;
+	uint32_t algo;
+	TEE_Result res;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: load MAC key", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = ta2tee_mac_algo(params[0].value.a, &algo);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	key_sz = params[1].memref.size;
+	if (algo == TEE_ALG_AES_CMAC) {
+		res = ta2tee_key_size(key_sz, &key_sz);
+		if (res != TEE_SUCCESS)
+			return res;
+		obj_type = TEE_TYPE_AES;
+		key_bits = key_sz * 8;
+	} else {
+		if (key_sz < TA_AES_HMAC_KEY_MIN_SIZE ||
+		    key_sz > TA_AES_HMAC_KEY_MAX_SIZE) {
+			EMSG("Invalid HMAC key size %" PRIu32, key_sz);
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+		obj_type = TEE_TYPE_HMAC_SHA256;
+		key_bits = TA_AES_HMAC_KEY_MAX_SIZE * 8;
+	}
+
+	if (sess->mac_handle != TEE_HANDLE_NULL &&
+	    sess->mac_algo == algo && sess->mac_key_bits == key_bits) {
+		TEE_ResetOperation(sess->mac_handle);
+	} else {
+		release_mac(sess);
+
+		res = TEE_AllocateOperation(&sess->mac_handle, algo,
+					    TEE_MODE_MAC, key_bits);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to allocate MAC operation");
+			sess->mac_handle = TEE_HANDLE_NULL;
+			return res;
+		}
+
+		res = TEE_AllocateTransientObject(obj_type, key_bits,
+						  &sess->mac_key_handle);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to allocate transient object");
+			sess->mac_key_handle = TEE_HANDLE_NULL;
+			release_mac(sess);
+			return res;
+		}
+
+		sess->mac_algo = algo;
+		sess->mac_key_bits = key_bits;
+	}
+	sess->mac_active = false;
+
+	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE,
+			     params[1].memref.buffer, key_sz);
+
+	TEE_ResetTransientObject(sess->mac_key_handle);
+	res = TEE_PopulateTransientObject(sess->mac_key_handle, &attr, 1);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_PopulateTransientObject failed, %x", res);
+		release_mac(sess);
+		return res;
+	}
+
+	res = TEE_SetOperationKey(sess->mac_handle, sess->mac_key_handle);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_SetOperationKey failed %x", res);
+		release_mac(sess);
+	}
+
+	return res;
+}
+
+/*
+ * Process commands TA_AES_CMD_MAC_INIT and TA_AES_CMD_MAC_UPDATE. API in
+ * aes_ta.h
+ */
+static TEE_Result mac_update(void *session, uint32_t param_types,
+			     TEE_Param params[4], bool init)
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(init ? TEE_PARAM_TYPE_NONE :
+				       TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Result res;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: MAC %s", session, init ? "init" : "update");
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->mac_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	if (init) {
+		TEE_MACInit(sess->mac_handle, NULL, 0);
+		sess->mac_active = true;
+		return TEE_SUCCESS;
+	}
+
+	/* GP panics on an update without init */
+	if (!sess->mac_active)
+		return TEE_ERROR_BAD_STATE;
+
+	TEE_MACUpdate(sess->mac_handle,
+		      params[0].memref.buffer, params[0].memref.size);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Process commands TA_AES_CMD_MAC_FINAL and TA_AES_CMD_MAC_ONESHOT. API
+ * in aes_ta.h
+ */
+static TEE_Result mac_final(void *session, uint32_t param_types,
+			    TEE_Param params[4], bool oneshot)
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	const uint32_t exp_verify_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Result res;
+	bool verify;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: MAC final", session);
+	verify = TEE_PARAM_TYPE_GET(param_types, 1) ==
+		 TEE_PARAM_TYPE_MEMREF_INPUT;
+	res = get_cipher(session, param_types,
+			 verify ? exp_verify_types : exp_param_types,
+			 params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->mac_handle == TEE_HANDLE_NULL ||
+	    (!oneshot && !sess->mac_active))
+		return TEE_ERROR_BAD_STATE;
+
+	if (verify) {
+		if (params[1].memref.size != mac_size(sess))
+			return TEE_ERROR_BAD_PARAMETERS;
+	} else if (params[1].memref.size < mac_size(sess)) {
+		params[1].memref.size = mac_size(sess);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (oneshot)
+		TEE_MACInit(sess->mac_handle, NULL, 0);
+
+	/* A new MAC always starts from TA_AES_CMD_MAC_INIT */
+	sess->mac_active = false;
+
+	if (verify)
+		/* TEE_ERROR_MAC_INVALID if the MAC does not match */
+		return TEE_MACCompareFinal(sess->mac_handle,
+					   params[0].memref.buffer,
+					   params[0].memref.size,
+					   params[1].memref.buffer,
+					   params[1].memref.size);
+
+	return TEE_MACComputeFinal(sess->mac_handle,
+				   params[0].memref.buffer,
+				   params[0].memref.size,
+				   params[1].memref.buffer,
+				   &params[1].memref.size);
+}
+
+/*
+ * Process command TA_AES_CMD_MAC_BATCH. API in aes_ta.h
+ *
+ * Like TA_AES_CMD_CIPHER_PACKETS, each message descriptor is copied into
+ * TA memory before it is checked.
+ */
+static TEE_Result mac_batch(void *session, uint32_t param_types,
+			    TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+	const struct ta_aes_span *table;
+	struct ta_aes_span span;
+	struct aes_cipher *sess;
+	uint32_t count;
+	uint32_t in_sz;
+	uint32_t mac_sz;
+	uint32_t out_sz;
+	uint8_t *data;
+	uint8_t *mac;
+	TEE_Result res;
+	uint32_t n;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: MAC batch", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->mac_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	if (params[0].memref.size % sizeof(span))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	table = params[0].memref.buffer;
+	count = params[0].memref.size / sizeof(span);
+	data = params[1].memref.buffer;
+	in_sz = params[1].memref.size;
+	mac = params[2].memref.buffer;
+	mac_sz = mac_size(sess);
+
+	if (count > UINT32_MAX / mac_sz)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[2].memref.size < count * mac_sz) {
+		params[2].memref.size = count * mac_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	sess->mac_active = false;
+
+	for (n = 0; n < count; n++) {
+		TEE_MemMove(&span, table + n, sizeof(span));
+
+		if (span.offset > in_sz || span.length > in_sz - span.offset) {
+			EMSG("Message %" PRIu32 " out of bounds", n);
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+
+		TEE_MACInit(sess->mac_handle, NULL, 0);
+
+		out_sz = mac_sz;
+		res = TEE_MACComputeFinal(sess->mac_handle,
+					  data + span.offset, span.length,
+					  mac + n * mac_sz, &out_sz);
+		if (res != TEE_SUCCESS) {
+			EMSG("Message %" PRIu32 ": TEE_MACComputeFinal failed %x",
+			     n, res);
+			return res;
+		}
+	}
+
+	params[2].memref.size = count * mac_sz;
+	return TEE_SUCCESS;
+}
+
+/* Bytes of the ENCRYPT_THEN_MAC chunk at pos of a msg_sz bytes message */
+static uint32_t etm_chunk_len(uint32_t msg_sz, uint32_t pos)
+{
+	return msg_sz - pos < ETM_CHUNK_SIZE ? msg_sz - pos : ETM_CHUNK_SIZE;
+}
+
+/*
+ * Process command TA_AES_CMD_ENCRYPT_THEN_MAC. API in aes_ta.h
+ *
+ * The message goes through a TA buffer ETM_CHUNK_SIZE bytes at a time.
+ * Encoding reads each chunk once from the client, ciphers and MACs it in
+ * TA memory and writes it once to the client. Decoding first MACs the
+ * whole cipher text and only deciphers it, in a second pass, once the MAC
+ * matches, so no unauthenticated clear text reaches the normal world. A
+ * client changing its input between the passes only corrupts its own
+ * output, it holds the MAC key anyway.
+ */
+static TEE_Result encrypt_then_mac(void *session, uint32_t param_types,
+				   TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	uint8_t mac[TA_AES_MAC_MAX_SIZE];
+	uint8_t iv[TA_AES_BLOCK_SIZE];
+	struct aes_cipher *sess;
+	uint32_t msg_sz;
+	uint32_t out_sz;
+	uint32_t mac_sz;
+	uint32_t pos;
+	uint32_t len;
+	uint8_t *chunk;
+	uint8_t *src;
+	uint8_t *dst;
+	TEE_Result res;
+	bool encrypt;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: encrypt then MAC", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (sess->op_handle == TEE_HANDLE_NULL ||
+	    sess->mac_handle == TEE_HANDLE_NULL ||
+	    (sess->algo != TEE_ALG_AES_CBC_NOPAD &&
+	     sess->algo != TEE_ALG_AES_CTR))
+		return TEE_ERROR_BAD_STATE;
+
+	encrypt = sess->mode == TEE_MODE_ENCRYPT;
+	mac_sz = mac_size(sess);
+	src = params[0].memref.buffer;
+	dst = params[1].memref.buffer;
+
+	/* msg_sz: clear text and cipher text size */
+	if (encrypt) {
+		msg_sz = params[0].memref.size;
+		if (msg_sz > UINT32_MAX - sizeof(iv) - mac_sz)
+			return TEE_ERROR_BAD_PARAMETERS;
+		out_sz = sizeof(iv) + msg_sz + mac_sz;
+	} else {
+		if (params[0].memref.size < sizeof(iv) + mac_sz)
+			return TEE_ERROR_BAD_PARAMETERS;
+		msg_sz = params[0].memref.size - sizeof(iv) - mac_sz;
+		out_sz = msg_sz;
+	}
+
+	if (sess->algo == TEE_ALG_AES_CBC_NOPAD && msg_sz % TA_AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[1].memref.size < out_sz) {
+		params[1].memref.size = out_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	chunk = TEE_Malloc(ETM_CHUNK_SIZE, 0);
+	if (!chunk)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	if (encrypt) {
+		next_auto_iv(sess, iv, sizeof(iv),
+			     ((uint64_t)msg_sz + TA_AES_BLOCK_SIZE - 1) /
+			     TA_AES_BLOCK_SIZE);
+		TEE_MemMove(dst, iv, sizeof(iv));
+		dst += sizeof(iv);
+	} else {
+		TEE_MemMove(iv, src, sizeof(iv));
+		TEE_MemMove(mac, src + sizeof(iv) + msg_sz, mac_sz);
+		src += sizeof(iv);
+	}
+
+	TEE_MACInit(sess->mac_handle, NULL, 0);
+	TEE_MACUpdate(sess->mac_handle, iv, sizeof(iv));
+	sess->mac_active = false;
+
+	if (!encrypt) {
+		/* First pass: authenticate IV || cipher text */
+		for (pos = 0; pos < msg_sz; pos += len) {
+			len = etm_chunk_len(msg_sz, pos);
+			TEE_MemMove(chunk, src + pos, len);
+			TEE_MACUpdate(sess->mac_handle, chunk, len);
+		}
+
+		/* TEE_ERROR_MAC_INVALID if the MAC does not match */
+		res = TEE_MACCompareFinal(sess->mac_handle, NULL, 0,
+					  mac, mac_sz);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	TEE_CipherInit(sess->op_handle, iv, sizeof(iv));
+
+	for (pos = 0; pos < msg_sz; pos += len) {
+		len = etm_chunk_len(msg_sz, pos);
+		TEE_MemMove(chunk, src + pos, len);
+
+		out_sz = len;
+		if (pos + len < msg_sz)
+			res = TEE_CipherUpdate(sess->op_handle, chunk, len,
+					       chunk, &out_sz);
+		else
+			res = TEE_CipherDoFinal(sess->op_handle, chunk, len,
+						chunk, &out_sz);
+		if (res != TEE_SUCCESS) {
+			EMSG("Ciphering failed %x", res);
+			goto out;
+		}
+
+		if (encrypt)
+			TEE_MACUpdate(sess->mac_handle, chunk, len);
+
+		TEE_MemMove(dst + pos, chunk, len);
+	}
+
+	if (encrypt) {
+		out_sz = mac_sz;
+		res = TEE_MACComputeFinal(sess->mac_handle, NULL, 0,
+					  dst + msg_sz, &out_sz);
+		params[1].memref.size = sizeof(iv) + msg_sz + mac_sz;
+	} else {
+		params[1].memref.size = msg_sz;
+	}
+
+out:
+	TEE_Free(chunk);
+	return res;
+}
+
+/*
+ * Process commands TA_AES_CMD_DATA_KEY_GENERATE, TA_AES_CMD_DATA_KEY_WRAP
+ * and TA_AES_CMD_DATA_KEY_UNWRAP. API in aes_ta.h
+ */
+static TEE_Result manage_data_key(uint32_t cmd, uint32_t param_types,
+				  TEE_Param params[4])
+{
+	uint32_t exp_param_types;
+	void *kek_id = params[0].memref.buffer;
+	uint32_t kek_id_len = params[0].memref.size;
+
+	switch (cmd) {
+	case TA_AES_CMD_DATA_KEY_GENERATE:
+		exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_VALUE_INPUT,
+						  TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						  TEE_PARAM_TYPE_MEMREF_OUTPUT);
+		break;
+	default:
+		exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_MEMREF_INPUT,
+						  TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						  TEE_PARAM_TYPE_NONE);
+		break;
+	}
+
+	/* Safely get the invocation parameters */
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	switch (cmd) {
+	case TA_AES_CMD_DATA_KEY_GENERATE:
+		if (params[2].memref.size < params[1].value.a) {
+			params[2].memref.size = params[1].value.a;
+			return TEE_ERROR_SHORT_BUFFER;
+		}
+		params[2].memref.size = params[1].value.a;
+		return data_key_generate(kek_id, kek_id_len, params[1].value.a,
+					 params[2].memref.buffer,
+					 params[3].memref.buffer,
+					 &params[3].memref.size);
+	case TA_AES_CMD_DATA_KEY_WRAP:
+		return data_key_wrap(kek_id, kek_id_len,
+				     params[1].memref.buffer,
+				     params[1].memref.size,
+				     params[2].memref.buffer,
+				     &params[2].memref.size);
+	default:
+		return data_key_unwrap(kek_id, kek_id_len,
+				       params[1].memref.buffer,
+				       params[1].memref.size,
+				       params[2].memref.buffer,
+				       &params[2].memref.size);
+	}
+}
+
+/*
+ * Process command TA_AES_CMD_RELEASE. API in aes_ta.h
+ */
+static TEE_Result release_resources(void *session, uint32_t param_types,
+				    TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct aes_cipher *sess;
+	TEE_Result res;
+
+	/* Get ciphering context from session ID and parameters */
+	DMSG("Session %p: release ciphering resources", session);
+	res = get_cipher(session, param_types, exp_param_types, params, &sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	release_cipher(sess);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TA_CreateEntryPoint(void)
+{
+	/* Nothing to do */
+	return TEE_SUCCESS;
+}
+
+void TA_DestroyEntryPoint(void)
+{
+	key_store_flush();
+}
+
+TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
+					TEE_Param __unused params[4],
+					void __unused **session)
+{
+	struct aes_session *sess;
+	size_t n;
+
+	/*
+	 * Allocate and init ciphering materials for the session.
+	 * The address of the structure is used as session ID for
+	 * the client.
+	 */
+	sess = TEE_Malloc(sizeof(*sess), 0);
+	if (!sess)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < TA_AES_MAX_CONTEXTS; n++)
+		release_cipher(&sess->ciphers[n]);
+
+	*session = (void *)sess;
+	DMSG("Session %p: newly allocated", *session);
+
+	return TEE_SUCCESS;
+}
+
+void TA_CloseSessionEntryPoint(void *session)
+{
+	struct aes_session *sess;
+	size_t n;
+
+	/* Get ciphering contexts from session ID */
 	DMSG("Session %p: release session", session);
-	sess = (struct aes_cipher *)session;
+	sess = (struct aes_session *)session;
 
-	/* Release the session resources */
-	if (sess->key_handle != TEE_HANDLE_NULL)
-		TEE_FreeTransientObject(sess->key_handle);
-	if (sess->op_handle != TEE_HANDLE_NULL)
-		TEE_FreeOperation(sess->op_handle);
+	/* Release the session resources, release_cipher() wipes the keys */
+	for (n = 0; n < TA_AES_MAX_CONTEXTS; n++)
+		release_cipher(&sess->ciphers[n]);
 	TEE_Free(sess);
 }
 
@@ -426,6 +1921,48 @@ TEE_Result TA_InvokeCommandEntryPoint(void *session,
 		return reset_aes_iv(session, param_types, params);
 	case TA_AES_CMD_CIPHER:
 		return cipher_buffer(session, param_types, params);
+	case TA_AES_CMD_ONESHOT:
+		return cipher_oneshot(session, param_types, params);
+	case TA_AES_CMD_AE_INIT:
+		return ae_init(session, param_types, params);
+	case TA_AES_CMD_AE_UPDATE_AAD:
+		return ae_update_aad(session, param_types, params);
+	case TA_AES_CMD_AE_ENCRYPT_FINAL:
+		return ae_final(session, param_types, params, true);
+	case TA_AES_CMD_AE_DECRYPT_FINAL:
+		return ae_final(session, param_types, params, false);
+	case TA_AES_CMD_RELEASE:
+		return release_resources(session, param_types, params);
+	case TA_AES_CMD_KEY_GENERATE:
+	case TA_AES_CMD_KEY_IMPORT:
+	case TA_AES_CMD_KEY_DELETE:
+		return manage_key(cmd, param_types, params);
+	case TA_AES_CMD_SET_KEY_ID:
+		return set_aes_key_id(session, param_types, params);
+	case TA_AES_CMD_XTS_SECTORS:
+		return cipher_xts_sectors(session, param_types, params);
+	case TA_AES_CMD_CIPHER_PACKETS:
+		return cipher_packets(session, param_types, params);
+	case TA_AES_CMD_ENCRYPT_AUTO_IV:
+		return encrypt_auto_iv(session, param_types, params);
+	case TA_AES_CMD_DATA_KEY_GENERATE:
+	case TA_AES_CMD_DATA_KEY_WRAP:
+	case TA_AES_CMD_DATA_KEY_UNWRAP:
+		return manage_data_key(cmd, param_types, params);
+	case TA_AES_CMD_MAC_SET_KEY:
+		return set_mac_key(session, param_types, params);
+	case TA_AES_CMD_MAC_INIT:
+		return mac_update(session, param_types, params, true);
+	case TA_AES_CMD_MAC_UPDATE:
+		return mac_update(session, param_types, params, false);
+	case TA_AES_CMD_MAC_FINAL:
+		return mac_final(session, param_types, params, false);
+	case TA_AES_CMD_MAC_ONESHOT:
+		return mac_final(session, param_types, params, true);
+	case TA_AES_CMD_MAC_BATCH:
+		return mac_batch(session, param_types, params);
+	case TA_AES_CMD_ENCRYPT_THEN_MAC:
+		return encrypt_then_mac(session, param_types, params);
 	default:
 		EMSG("Command ID 0x%x is not supported", cmd);
 		return TEE_ERROR_NOT_SUPPORTED;
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <inttypes.h>
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include <aes_ta.h>
+
+#include "data_key.h"
+#include "key_store.h"
+
+#define WRAPPED_MAX_SIZE	TA_AES_WRAPPED_KEY_SIZE(TA_AES_SIZE_256BIT)
+
+static bool valid_key_size(uint32_t key_size)
+{
+	return key_size == TA_AES_SIZE_128BIT || key_size == TA_AES_SIZE_256BIT;
+}
+
+TEE_Result client_identity(TEE_Identity *id)
+{
+	TEE_Result res;
+
+	res = TEE_GetPropertyAsIdentity(TEE_PROPSET_CURRENT_CLIENT,
+					"gpd.client.identity", id);
+	if (res != TEE_SUCCESS) {
+		EMSG("Client identity not available, res=0x%08x", res);
+		return res;
+	}
+
+	/* Any normal world process shares the public identity */
+	if (id->login == TEE_LOGIN_PUBLIC) {
+		EMSG("Data keys require a client login");
+		return TEE_ERROR_ACCESS_DENIED;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * AES-GCM of size bytes under the KEK, bound to the client identity. In
+ * and out shall be in TA memory, the tag is an output when encrypting and
+ * an input when decrypting.
+ */
+static TEE_Result kek_cipher(const void *kek_id, uint32_t kek_id_len,
+			     uint32_t mode, const uint8_t *nonce,
+			     const void *in, uint32_t size, void *out,
+			     uint8_t *tag)
+{
+	TEE_OperationHandle op = TEE_HANDLE_NULL;
+	uint32_t tag_sz = TA_AES_TAG_MAX_SIZE;
+	uint32_t out_sz = size;
+	TEE_ObjectHandle kek;
+	TEE_Identity id;
+	uint32_t kek_size;
+	TEE_Result res;
+
+	res = client_identity(&id);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = key_store_get(kek_id, kek_id_len, &kek, &kek_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = TEE_AllocateOperation(&op, TEE_ALG_AES_GCM, mode, kek_size * 8);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_AllocateOperation failed %x", res);
+		return res;
+	}
+
+	res = TEE_SetOperationKey(op, kek);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_SetOperationKey failed %x", res);
+		goto out;
+	}
+
+	res = TEE_AEInit(op, nonce, TA_AES_WRAP_NONCE_SIZE, tag_sz * 8,
+			 sizeof(id), size);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_AEInit failed %x", res);
+		goto out;
+	}
+
+	TEE_AEUpdateAAD(op, &id, sizeof(id));
+
+	if (mode == TEE_MODE_ENCRYPT)
+		res = TEE_AEEncryptFinal(op, in, size, out, &out_sz,
+					 tag, &tag_sz);
+	else
+		res = TEE_AEDecryptFinal(op, in, size, out, &out_sz,
+					 tag, tag_sz);
+out:
+	TEE_FreeOperation(op);
+	return res;
+}
+
+/* Wrap a key already in TA memory */
+static TEE_Result wrap(const void *kek_id, uint32_t kek_id_len,
+		       const uint8_t *key, uint32_t key_size,
+		       void *wrapped, uint32_t *wrapped_len)
+{
+	uint8_t blob[WRAPPED_MAX_SIZE];
+	uint32_t blob_len = TA_AES_WRAPPED_KEY_SIZE(key_size);
+	TEE_Result res;
+
+	if (*wrapped_len < blob_len) {
+		*wrapped_len = blob_len;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	TEE_GenerateRandom(blob, TA_AES_WRAP_NONCE_SIZE);
+
+	res = kek_cipher(kek_id, kek_id_len, TEE_MODE_ENCRYPT, blob,
+			 key, key_size, blob + TA_AES_WRAP_NONCE_SIZE,
+			 blob + TA_AES_WRAP_NONCE_SIZE + key_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	TEE_MemMove(wrapped, blob, blob_len);
+	*wrapped_len = blob_len;
+	return TEE_SUCCESS;
+}
+
+TEE_Result data_key_wrap(const void *kek_id, uint32_t kek_id_len,
+			 const void *key, uint32_t key_size,
+			 void *wrapped, uint32_t *wrapped_len)
+{
+	uint8_t clear[TA_AES_SIZE_256BIT];
+	TEE_Result res;
+
+	if (!valid_key_size(key_size))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	TEE_MemMove(clear, key, key_size);
+	res = wrap(kek_id, kek_id_len, clear, key_size, wrapped, wrapped_len);
+	TEE_MemFill(clear, 0, sizeof(clear));
+
+	return res;
+}
+
+TEE_Result data_key_generate(const void *kek_id, uint32_t kek_id_len,
+			     uint32_t key_size, void *key,
+			     void *wrapped, uint32_t *wrapped_len)
+{
+	uint8_t clear[TA_AES_SIZE_256BIT];
+	TEE_Result res;
+
+	if (!valid_key_size(key_size))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	TEE_GenerateRandom(clear, key_size);
+	res = wrap(kek_id, kek_id_len, clear, key_size, wrapped, wrapped_len);
+	if (res == TEE_SUCCESS)
+		TEE_MemMove(key, clear, key_size);
+	TEE_MemFill(clear, 0, sizeof(clear));
+
+	return res;
+}
+
+TEE_Result data_key_unwrap(const void *kek_id, uint32_t kek_id_len,
+			   const void *wrapped, uint32_t wrapped_len,
+			   void *key, uint32_t *key_size)
+{
+	uint8_t blob[WRAPPED_MAX_SIZE];
+	uint8_t clear[TA_AES_SIZE_256BIT];
+	uint32_t clear_size;
+	TEE_Result res;
+
+	if (wrapped_len < TA_AES_WRAPPED_KEY_SIZE(0))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	clear_size = wrapped_len - TA_AES_WRAPPED_KEY_SIZE(0);
+	if (!valid_key_size(clear_size))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (*key_size < clear_size) {
+		*key_size = clear_size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	/* Check the tag on a copy the client cannot change meanwhile */
+	TEE_MemMove(blob, wrapped, wrapped_len);
+
+	/* TEE_ERROR_MAC_INVALID for a foreign or altered wrapped key */
+	res = kek_cipher(kek_id, kek_id_len, TEE_MODE_DECRYPT, blob,
+			 blob + TA_AES_WRAP_NONCE_SIZE, clear_size, clear,
+			 blob + TA_AES_WRAP_NONCE_SIZE + clear_size);
+	if (res == TEE_SUCCESS) {
+		TEE_MemMove(key, clear, clear_size);
+		*key_size = clear_size;
+	}
+	TEE_MemFill(clear, 0, sizeof(clear));
+
+	return res;
+}
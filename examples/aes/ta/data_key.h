@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef DATA_KEY_H
+#define DATA_KEY_H
+
+#include <tee_internal_api.h>
+
+/*
+ * Data keys for envelope encryption: AES keys handed to the client in
+ * clear and in a wrapped form, AES-GCM under a key encryption key (KEK)
+ * of the key store. The client identity is authenticated with the wrapped
+ * key, only the client that wrapped a key can unwrap it, and clients with
+ * a public login are refused.
+ *
+ * Wrapped key layout: nonce (TA_AES_WRAP_NONCE_SIZE) || encrypted key ||
+ * tag (TA_AES_TAG_MAX_SIZE). Arguments may point to non-secure memory.
+ */
+
+/*
+ * Identity of the calling client, the AAD of the wrapped keys. Fails with
+ * TEE_ERROR_ACCESS_DENIED for a public login, shared by all normal world
+ * processes.
+ */
+TEE_Result client_identity(TEE_Identity *id);
+
+/* Wrap the key_size bytes of key into wrapped, size updated */
+TEE_Result data_key_wrap(const void *kek_id, uint32_t kek_id_len,
+			 const void *key, uint32_t key_size,
+			 void *wrapped, uint32_t *wrapped_len);
+
+/* Generate a random key of key_size bytes and wrap it */
+TEE_Result data_key_generate(const void *kek_id, uint32_t kek_id_len,
+			     uint32_t key_size, void *key,
+			     void *wrapped, uint32_t *wrapped_len);
+
+/* Check and unwrap a wrapped key into key, key_size updated */
+TEE_Result data_key_unwrap(const void *kek_id, uint32_t kek_id_len,
+			   const void *wrapped, uint32_t wrapped_len,
+			   void *key, uint32_t *key_size);
+
+#endif /* DATA_KEY_H */
@@ -28,23 +28,36 @@
 #ifndef __AES_TA_H__
 #define __AES_TA_H__
 
+#include <stdint.h>
+
 /* UUID of the AES example trusted application */
 #define TA_AES_UUID \
 	{ 0x5dbac793, 0xf574, 0x4871, \
 		{ 0x8a, 0xd3, 0x04, 0x33, 0x1e, 0xc1, 0x7f, 0x24 } }
 
+/*
+ * Each session holds TA_AES_MAX_CONTEXTS independent ciphering contexts
+ * (operation, key, IV state). Commands documented with "param[3] (value)
+ * a: context index" take the index of the context to use there; with
+ * param[3] unused they address context 0.
+ */
+#define TA_AES_MAX_CONTEXTS		16
+
 /*
  * TA_AES_CMD_PREPARE - Allocate resources for the AES ciphering
  * param[0] (value) a: TA_AES_ALGO_xxx, b: unused
- * param[1] (value) a: key size in bytes, b: unused
+ * param[1] (value) a: key size in bytes (of each key for XTS), b: unused
  * param[2] (value) a: TA_AES_MODE_ENCODE/_DECODE, b: unused
- * param[3] unused
+ * param[3] (value) a: context index, optional
  */
 #define TA_AES_CMD_PREPARE		0
 
 #define TA_AES_ALGO_ECB			0
 #define TA_AES_ALGO_CBC			1
 #define TA_AES_ALGO_CTR			2
+#define TA_AES_ALGO_GCM			3	/* authenticated, see AE commands */
+#define TA_AES_ALGO_CCM			4	/* authenticated, see AE commands */
+#define TA_AES_ALGO_XTS			5	/* key1 || key2, see XTS_SECTORS */
 
 #define TA_AES_SIZE_128BIT		(128 / 8)
 #define TA_AES_SIZE_256BIT		(256 / 8)
@@ -54,10 +67,11 @@
 
 /*
  * TA_AES_CMD_SET_KEY - Allocate resources for the AES ciphering
- * param[0] (memref) key data, size shall equal key length
+ * param[0] (memref) key data, size shall equal key length (twice the key
+ *          length for XTS: key1 || key2)
  * param[1] unused
  * param[2] unused
- * param[3] unused
+ * param[3] (value) a: context index, optional
  */
 #define TA_AES_CMD_SET_KEY		1
 
@@ -66,7 +80,7 @@
  * param[0] (memref) initial vector, size shall equal block length
  * param[1] unused
  * param[2] unused
- * param[3] unused
+ * param[3] (value) a: context index, optional
  */
 #define TA_AES_CMD_SET_IV		2
 
@@ -75,8 +89,338 @@
  * param[0] (memref) input buffer
  * param[1] (memref) output buffer (shall be bigger than input buffer)
  * param[2] unused
- * param[3] unused
+ * param[3] (value) a: context index, optional
+ *
+ * For TA_AES_ALGO_GCM/_CCM the payload is processed after TA_AES_CMD_AE_INIT
+ * and the output size is updated to the bytes actually produced.
+ *
+ * In place form, the buffer is overwritten with its ciphered content:
+ * param[0] (memref inout) buffer, size updated
+ * param[1] unused
+ * param[2] unused
+ * param[3] (value) a: context index, optional
  */
 #define TA_AES_CMD_CIPHER		3
 
+/* AES block size in bytes, also the IV size of CBC and CTR */
+#define TA_AES_BLOCK_SIZE		16
+
+/*
+ * TA_AES_CMD_ONESHOT - Load key and IV and cipher a buffer in one request
+ * param[0] (value) a: TA_AES_ALGO_xxx, b: TA_AES_MODE_ENCODE/_DECODE
+ * param[1] (memref) key || IV, the key size is the memref size minus
+ *          TA_AES_BLOCK_SIZE (minus 0 for TA_AES_ALGO_ECB)
+ * param[2] (memref) input buffer
+ * param[3] (memref) output buffer (shall be bigger than input buffer)
+ *
+ * In place form: param[2] (memref inout) buffer, size updated, and param[3]
+ * (value) a: context index, optional.
+ *
+ * Works on context 0 unless given in the in place form. Its operation is
+ * reused as long as algorithm, mode and key size do not change. The command
+ * replaces the configuration set by TA_AES_CMD_PREPARE/_SET_KEY/_SET_IV on
+ * that context.
+ */
+#define TA_AES_CMD_ONESHOT		4
+
+/* Largest authentication tag of GCM and CCM in bytes */
+#define TA_AES_TAG_MAX_SIZE		16
+
+/*
+ * TA_AES_CMD_AE_INIT - Start a GCM/CCM message, operation prepared with
+ * TA_AES_ALGO_GCM or TA_AES_ALGO_CCM and its key set
+ * param[0] (memref) nonce (GCM: not empty, 12 bytes advised, CCM: 7 to 13
+ *          bytes)
+ * param[1] (value) a: tag size in bytes (GCM: 12 to 16, CCM: even, 4 to
+ *          16), b: AAD size in bytes (CCM only)
+ * param[2] (value) a: payload size in bytes (CCM only), b: unused
+ * param[3] (value) a: context index, optional
+ *
+ * CCM fails with TEE_ERROR_BAD_PARAMETERS on AAD or payload beyond the
+ * sizes given here and with TEE_ERROR_BAD_STATE on payload before all AAD
+ * or on the final call before all AAD. The final call shall carry exactly
+ * the payload bytes still due.
+ */
+#define TA_AES_CMD_AE_INIT		5
+
+/*
+ * TA_AES_CMD_AE_UPDATE_AAD - Feed additional authenticated data, only
+ * before the first payload byte
+ * param[0] (memref) AAD
+ * param[1] unused
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_AE_UPDATE_AAD	6
+
+/*
+ * TA_AES_CMD_AE_ENCRYPT_FINAL - Encrypt the last payload bytes and get the tag
+ * param[0] (memref) input buffer, may be empty
+ * param[1] (memref) output buffer, size updated
+ * param[2] (memref) tag output, size updated to the tag size
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_AE_ENCRYPT_FINAL	7
+
+/*
+ * TA_AES_CMD_AE_DECRYPT_FINAL - Decrypt the last payload bytes and verify
+ * the tag, fails with TEE_ERROR_MAC_INVALID on mismatch
+ * param[0] (memref) input buffer, may be empty
+ * param[1] (memref) output buffer, size updated
+ * param[2] (memref) expected tag, size shall equal the tag size of AE_INIT
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_AE_DECRYPT_FINAL	8
+
+/*
+ * TA_AES_CMD_RELEASE - Free operation and key of a context
+ * param[0] unused
+ * param[1] unused
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_RELEASE		9
+
+/*
+ * Key IDs of the persistent key store are 1 to 32 bytes. Generating,
+ * importing or deleting a key requires a session opened with a login
+ * other than TEEC_LOGIN_PUBLIC, TEE_ERROR_ACCESS_DENIED otherwise.
+ */
+#define TA_AES_KEY_ID_MAX_SIZE		32
+
+/*
+ * TA_AES_CMD_KEY_GENERATE - Generate a random key in secure storage,
+ * replacing a key of the same ID
+ * param[0] (memref) key ID
+ * param[1] (value) a: key size in bytes, b: unused
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_AES_CMD_KEY_GENERATE		10
+
+/*
+ * TA_AES_CMD_KEY_IMPORT - Store key material in secure storage,
+ * replacing a key of the same ID
+ * param[0] (memref) key ID
+ * param[1] (memref) key data, 16 or 32 bytes
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_AES_CMD_KEY_IMPORT		11
+
+/*
+ * TA_AES_CMD_KEY_DELETE - Delete a key from secure storage
+ * param[0] (memref) key ID
+ * param[1] unused
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_AES_CMD_KEY_DELETE		12
+
+/*
+ * TA_AES_CMD_SET_KEY_ID - Load a stored key like TA_AES_CMD_SET_KEY does,
+ * from a cache of loaded keys when possible
+ * param[0] (memref) key ID, key size shall equal the prepared key length
+ * param[1] unused
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_SET_KEY_ID		13
+
+/*
+ * TA_AES_CMD_XTS_SECTORS - Cipher contiguous sectors with AES-XTS, the
+ * tweak of each sector is its sector number
+ * param[0] (value) a: first sector number bits 0-31, b: bits 32-63
+ * param[1] (value) a: sector size in bytes, multiple of TA_AES_BLOCK_SIZE
+ * param[2] (memref) input sectors, size multiple of the sector size
+ * param[3] (memref) output sectors (shall be bigger than input)
+ *
+ * In place form: param[2] (memref inout) sectors, size updated, and
+ * param[3] (value) a: context index, optional.
+ */
+#define TA_AES_CMD_XTS_SECTORS		14
+
+/*
+ * TA_AES_CMD_CIPHER_PACKETS - Cipher many packets of a packed buffer, each
+ * packet restarting from its own IV (or initial counter)
+ * param[0] (memref) descriptor table, array of struct ta_aes_packet
+ * param[1] (memref) packed input data
+ * param[2] (memref) output (shall be bigger than input), same layout
+ * param[3] (value) a: context index, optional
+ *
+ * In place form: param[1] (memref inout) packed data, param[2] unused.
+ *
+ * The context shall be prepared and keyed for TA_AES_ALGO_ECB, _CBC or
+ * _CTR. Bytes not covered by any descriptor are left as they are in the
+ * in place form and undefined otherwise.
+ */
+#define TA_AES_CMD_CIPHER_PACKETS	15
+
+/*
+ * TA_AES_CMD_ENCRYPT_AUTO_IV - Encrypt a whole message under an IV or
+ * nonce chosen by the TA, returned with the cipher text
+ * param[0] (memref) clear text
+ * param[1] (memref) cipher text, for GCM/CCM followed by the
+ *          TA_AES_TAG_MAX_SIZE bytes tag, size updated
+ * param[2] (memref) IV or nonce used, TA_AES_BLOCK_SIZE bytes for CBC and
+ *          CTR, TA_AES_AUTO_NONCE_SIZE bytes for GCM and CCM, size updated
+ * param[3] (value) a: context index, optional
+ *
+ * The context shall be prepared for encoding with TA_AES_ALGO_CBC, _CTR,
+ * _GCM or _CCM and keyed. CBC gets a random IV per message. CTR, GCM and
+ * CCM start from a random value when the key is set and increment it, CTR
+ * by the blocks of the message, so no counter block or nonce repeats under
+ * a key. Decode with TA_AES_CMD_SET_IV or TA_AES_CMD_AE_INIT and the
+ * returned value.
+ */
+#define TA_AES_CMD_ENCRYPT_AUTO_IV	16
+
+/* Nonce size of TA_AES_CMD_ENCRYPT_AUTO_IV for GCM and CCM */
+#define TA_AES_AUTO_NONCE_SIZE		12
+
+/*
+ * Data keys for envelope encryption, the client ciphers its bulk data
+ * itself with a data key it only stores wrapped under a key encryption
+ * key (KEK) of the key store. The client shall open its session with a
+ * login other than TEEC_LOGIN_PUBLIC, a wrapped key only unwraps for the
+ * same client identity.
+ */
+
+/* Wrapped key: nonce || encrypted key || tag */
+#define TA_AES_WRAP_NONCE_SIZE		12
+#define TA_AES_WRAPPED_KEY_SIZE(key_size) \
+	(TA_AES_WRAP_NONCE_SIZE + (key_size) + TA_AES_TAG_MAX_SIZE)
+
+/*
+ * TA_AES_CMD_DATA_KEY_GENERATE - Generate a random data key and wrap it
+ * param[0] (memref) KEK ID
+ * param[1] (value) a: data key size in bytes, b: unused
+ * param[2] (memref) data key, size updated
+ * param[3] (memref) wrapped data key, size updated
+ */
+#define TA_AES_CMD_DATA_KEY_GENERATE	17
+
+/*
+ * TA_AES_CMD_DATA_KEY_WRAP - Wrap a data key given by the client
+ * param[0] (memref) KEK ID
+ * param[1] (memref) data key, 16 or 32 bytes
+ * param[2] (memref) wrapped data key, size updated
+ * param[3] unused
+ */
+#define TA_AES_CMD_DATA_KEY_WRAP	18
+
+/*
+ * TA_AES_CMD_DATA_KEY_UNWRAP - Unwrap a data key, TEE_ERROR_MAC_INVALID
+ * if it was altered, wrapped under another KEK or for another client
+ * param[0] (memref) KEK ID
+ * param[1] (memref) wrapped data key
+ * param[2] (memref) data key, size updated
+ * param[3] unused
+ */
+#define TA_AES_CMD_DATA_KEY_UNWRAP	19
+
+/*
+ * Each context also holds a MAC engine, keyed by TA_AES_CMD_MAC_SET_KEY
+ * apart from its cipher key. The operation and key object stay allocated
+ * from message to message and through key changes of the same MAC
+ * algorithm and key size.
+ */
+#define TA_AES_MAC_CMAC			0	/* AES-CMAC, 16 or 32 bytes key */
+#define TA_AES_MAC_HMAC_SHA256		1	/* HMAC-SHA256, see sizes below */
+
+#define TA_AES_CMAC_SIZE		16
+#define TA_AES_HMAC_SHA256_SIZE		32
+#define TA_AES_MAC_MAX_SIZE		TA_AES_HMAC_SHA256_SIZE
+
+/* HMAC-SHA256 key sizes accepted by the GP object type */
+#define TA_AES_HMAC_KEY_MIN_SIZE	24
+#define TA_AES_HMAC_KEY_MAX_SIZE	128
+
+/*
+ * TA_AES_CMD_MAC_SET_KEY - Select the MAC algorithm and load its key,
+ * aborting a MAC in progress
+ * param[0] (value) a: TA_AES_MAC_xxx, b: unused
+ * param[1] (memref) key data
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_MAC_SET_KEY		20
+
+/*
+ * TA_AES_CMD_MAC_INIT - Start a MAC, restarting a MAC in progress
+ * param[0] unused
+ * param[1] unused
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_MAC_INIT		21
+
+/*
+ * TA_AES_CMD_MAC_UPDATE - Feed data to the MAC started by MAC_INIT
+ * param[0] (memref) data
+ * param[1] unused
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_MAC_UPDATE		22
+
+/*
+ * TA_AES_CMD_MAC_FINAL - Feed the last data and complete the MAC started
+ * by MAC_INIT
+ * param[0] (memref) last data, may be empty
+ * param[1] (memref) MAC output, size updated
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ *
+ * Verify form, fails with TEE_ERROR_MAC_INVALID on mismatch:
+ * param[1] (memref input) expected MAC, size shall equal the MAC size
+ */
+#define TA_AES_CMD_MAC_FINAL		23
+
+/*
+ * TA_AES_CMD_MAC_ONESHOT - MAC_INIT and MAC_FINAL in one request, same
+ * parameters and verify form as TA_AES_CMD_MAC_FINAL
+ */
+#define TA_AES_CMD_MAC_ONESHOT		24
+
+/*
+ * TA_AES_CMD_MAC_BATCH - MAC many messages of a packed buffer
+ * param[0] (memref) message table, array of struct ta_aes_span
+ * param[1] (memref) packed messages
+ * param[2] (memref) MAC output, the MACs of the messages one after the
+ *          other, size updated
+ * param[3] (value) a: context index, optional
+ */
+#define TA_AES_CMD_MAC_BATCH		25
+
+/*
+ * TA_AES_CMD_ENCRYPT_THEN_MAC - Cipher a whole message and authenticate
+ * the IV and the cipher text in a single pass over the buffers
+ * param[0] (memref) input message
+ * param[1] (memref) output message, size updated
+ * param[2] unused
+ * param[3] (value) a: context index, optional
+ *
+ * The context shall be prepared with TA_AES_ALGO_CBC or _CTR, keyed, and
+ * its MAC keyed. Encoding takes the clear text and outputs
+ * IV || cipher text || MAC, the IV chosen as by TA_AES_CMD_ENCRYPT_AUTO_IV.
+ * Decoding takes IV || cipher text || MAC and outputs the clear text, or
+ * fails with TEE_ERROR_MAC_INVALID without writing the output. CBC
+ * messages are a multiple of TA_AES_BLOCK_SIZE long.
+ */
+#define TA_AES_CMD_ENCRYPT_THEN_MAC	26
+
+/* Packet of TA_AES_CMD_CIPHER_PACKETS, offset and length in the data buffer */
+struct ta_aes_packet {
+	uint32_t offset;
+	uint32_t length;	/* multiple of TA_AES_BLOCK_SIZE but for CTR */
+	uint8_t iv[TA_AES_BLOCK_SIZE];	/* unused for TA_AES_ALGO_ECB */
+};
+
+/* Message of TA_AES_CMD_MAC_BATCH, offset and length in the data buffer */
+struct ta_aes_span {
+	uint32_t offset;
+	uint32_t length;
+};
+
 #endif /* __AES_TA_H */
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <inttypes.h>
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include <aes_ta.h>
+
+#include "key_store.h"
+
+struct cached_key {
+	uint8_t id[TA_AES_KEY_ID_MAX_SIZE];
+	uint32_t id_len;		/* 0 for a free entry */
+	uint32_t key_size;		/* in bytes */
+	uint32_t last_use;		/* for least recently used eviction */
+	TEE_ObjectHandle handle;	/* populated transient object */
+};
+
+static struct cached_key cache[KEY_STORE_CACHE_SIZE];
+static uint32_t use_counter;
+
+/*
+ * Each session runs its own TA instance, thus has its own cache. Every
+ * key write or deletion stores a fresh random tag in the generation
+ * object, a cache filled under another tag may hold stale keys. The ID
+ * is longer than TA_AES_KEY_ID_MAX_SIZE so that no key can take it.
+ */
+static const char generation_id[] = "key_store: generation of the stored keys";
+static uint64_t cache_generation;
+
+/* Object IDs shall live in TA memory */
+static TEE_Result copy_id(uint8_t *dst, const void *id, uint32_t id_len)
+{
+	if (!id_len || id_len > TA_AES_KEY_ID_MAX_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	TEE_MemMove(dst, id, id_len);
+	return TEE_SUCCESS;
+}
+
+static bool valid_key_size(uint32_t key_size)
+{
+	return key_size == TA_AES_SIZE_128BIT || key_size == TA_AES_SIZE_256BIT;
+}
+
+static struct cached_key *cache_find(const uint8_t *id, uint32_t id_len)
+{
+	size_t n;
+
+	for (n = 0; n < KEY_STORE_CACHE_SIZE; n++)
+		if (cache[n].id_len == id_len &&
+		    !TEE_MemCompare(cache[n].id, id, id_len))
+			return &cache[n];
+
+	return NULL;
+}
+
+static void cache_evict(struct cached_key *entry)
+{
+	if (entry->handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(entry->handle);
+
+	TEE_MemFill(entry, 0, sizeof(*entry));
+	entry->handle = TEE_HANDLE_NULL;
+}
+
+/* Free entry or least recently used one */
+static struct cached_key *cache_victim(void)
+{
+	struct cached_key *victim = &cache[0];
+	size_t n;
+
+	for (n = 0; n < KEY_STORE_CACHE_SIZE; n++) {
+		if (!cache[n].id_len)
+			return &cache[n];
+		if (use_counter - cache[n].last_use >
+		    use_counter - victim->last_use)
+			victim = &cache[n];
+	}
+
+	cache_evict(victim);
+	return victim;
+}
+
+/* Current generation tag, 0 before the first key write */
+static TEE_Result read_generation(uint64_t *generation)
+{
+	TEE_ObjectHandle object;
+	uint32_t count = 0;
+	TEE_Result res;
+
+	*generation = 0;
+	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, generation_id,
+				       sizeof(generation_id) - 1,
+				       TEE_DATA_FLAG_ACCESS_READ |
+				       TEE_DATA_FLAG_SHARE_READ,
+				       &object);
+	if (res == TEE_ERROR_ITEM_NOT_FOUND)
+		return TEE_SUCCESS;
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = TEE_ReadObjectData(object, generation, sizeof(*generation),
+				 &count);
+	if (res == TEE_SUCCESS && count != sizeof(*generation))
+		*generation = 0;
+
+	TEE_CloseObject(object);
+	return res;
+}
+
+/* Tell the other TA instances that their cached keys may be stale */
+static TEE_Result new_generation(void)
+{
+	TEE_ObjectHandle object;
+	uint64_t generation;
+	TEE_Result res;
+
+	TEE_GenerateRandom(&generation, sizeof(generation));
+
+	res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, generation_id,
+					 sizeof(generation_id) - 1,
+					 TEE_DATA_FLAG_ACCESS_READ |
+					 TEE_DATA_FLAG_ACCESS_WRITE_META |
+					 TEE_DATA_FLAG_OVERWRITE,
+					 TEE_HANDLE_NULL, &generation,
+					 sizeof(generation), &object);
+	if (res != TEE_SUCCESS) {
+		EMSG("Key generation not updated, res=0x%08x", res);
+		return res;
+	}
+
+	TEE_CloseObject(object);
+	return TEE_SUCCESS;
+}
+
+/* Write the key object to storage and drop a stale cached copy */
+static TEE_Result store_key(const uint8_t *id, uint32_t id_len,
+			    TEE_ObjectHandle key)
+{
+	struct cached_key *entry;
+	TEE_ObjectHandle object;
+	TEE_Result res;
+
+	entry = cache_find(id, id_len);
+	if (entry)
+		cache_evict(entry);
+
+	res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, id, id_len,
+					 TEE_DATA_FLAG_ACCESS_READ |
+					 TEE_DATA_FLAG_ACCESS_WRITE_META |
+					 TEE_DATA_FLAG_OVERWRITE,
+					 key, NULL, 0, &object);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
+		return res;
+	}
+
+	TEE_CloseObject(object);
+	return new_generation();
+}
+
+TEE_Result key_store_generate(const void *id, uint32_t id_len,
+			      uint32_t key_size)
+{
+	uint8_t obj_id[TA_AES_KEY_ID_MAX_SIZE];
+	TEE_ObjectHandle key;
+	TEE_Result res;
+
+	res = copy_id(obj_id, id, id_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!valid_key_size(key_size))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = TEE_AllocateTransientObject(TEE_TYPE_AES, key_size * 8, &key);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* The key material never leaves the TEE */
+	res = TEE_GenerateKey(key, key_size * 8, NULL, 0);
+	if (res == TEE_SUCCESS)
+		res = store_key(obj_id, id_len, key);
+
+	TEE_FreeTransientObject(key);
+	return res;
+}
+
+TEE_Result key_store_import(const void *id, uint32_t id_len,
+			    const void *key_data, uint32_t key_size)
+{
+	uint8_t obj_id[TA_AES_KEY_ID_MAX_SIZE];
+	TEE_ObjectHandle key;
+	TEE_Attribute attr;
+	TEE_Result res;
+
+	res = copy_id(obj_id, id, id_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!valid_key_size(key_size))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = TEE_AllocateTransientObject(TEE_TYPE_AES, key_size * 8, &key);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key_data, key_size);
+	res = TEE_PopulateTransientObject(key, &attr, 1);
+	if (res == TEE_SUCCESS)
+		res = store_key(obj_id, id_len, key);
+
+	TEE_FreeTransientObject(key);
+	return res;
+}
+
+TEE_Result key_store_delete(const void *id, uint32_t id_len)
+{
+	uint8_t obj_id[TA_AES_KEY_ID_MAX_SIZE];
+	struct cached_key *entry;
+	TEE_ObjectHandle object;
+	TEE_Result res;
+
+	res = copy_id(obj_id, id, id_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	entry = cache_find(obj_id, id_len);
+	if (entry)
+		cache_evict(entry);
+
+	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, id_len,
+				       TEE_DATA_FLAG_ACCESS_READ |
+				       TEE_DATA_FLAG_ACCESS_WRITE_META,
+				       &object);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = TEE_CloseAndDeletePersistentObject1(object);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return new_generation();
+}
+
+TEE_Result key_store_get(const void *id, uint32_t id_len,
+			 TEE_ObjectHandle *key, uint32_t *key_size)
+{
+	uint8_t obj_id[TA_AES_KEY_ID_MAX_SIZE];
+	struct cached_key *entry;
+	TEE_ObjectHandle object;
+	TEE_ObjectInfo info;
+	uint64_t generation;
+	TEE_Result res;
+
+	res = copy_id(obj_id, id, id_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* Read before any load so that a later write changes it */
+	res = read_generation(&generation);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (generation != cache_generation) {
+		key_store_flush();
+		cache_generation = generation;
+	}
+
+	entry = cache_find(obj_id, id_len);
+	if (entry)
+		goto out;
+
+	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, id_len,
+				       TEE_DATA_FLAG_ACCESS_READ |
+				       TEE_DATA_FLAG_SHARE_READ,
+				       &object);
+	if (res != TEE_SUCCESS) {
+		EMSG("Key not found, res=0x%08x", res);
+		return res;
+	}
+
+	res = TEE_GetObjectInfo1(object, &info);
+	if (res == TEE_SUCCESS && (info.objectType != TEE_TYPE_AES ||
+				   !valid_key_size(info.objectSize / 8)))
+		res = TEE_ERROR_BAD_FORMAT;
+	if (res != TEE_SUCCESS)
+		goto close;
+
+	entry = cache_victim();
+	res = TEE_AllocateTransientObject(TEE_TYPE_AES, info.objectSize,
+					  &entry->handle);
+	if (res != TEE_SUCCESS) {
+		entry->handle = TEE_HANDLE_NULL;
+		goto close;
+	}
+
+	res = TEE_CopyObjectAttributes1(entry->handle, object);
+	if (res != TEE_SUCCESS) {
+		cache_evict(entry);
+		goto close;
+	}
+
+	TEE_MemMove(entry->id, obj_id, id_len);
+	entry->id_len = id_len;
+	entry->key_size = info.objectSize / 8;
+	TEE_CloseObject(object);
+out:
+	entry->last_use = ++use_counter;
+	*key = entry->handle;
+	*key_size = entry->key_size;
+	return TEE_SUCCESS;
+
+close:
+	TEE_CloseObject(object);
+	return res;
+}
+
+void key_store_flush(void)
+{
+	size_t n;
+
+	for (n = 0; n < KEY_STORE_CACHE_SIZE; n++)
+		cache_evict(&cache[n]);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef KEY_STORE_H
+#define KEY_STORE_H
+
+#include <tee_internal_api.h>
+
+/* Populated key objects kept in memory by the TA instance */
+#define KEY_STORE_CACHE_SIZE		8
+
+/*
+ * Persistent AES keys in the TA private storage, addressed by an ID of
+ * 1 to TA_AES_KEY_ID_MAX_SIZE bytes. The IDs may point to non-secure
+ * memory, they are copied before use.
+ */
+
+/* Generate a random key of key_size bytes, replacing an existing one */
+TEE_Result key_store_generate(const void *id, uint32_t id_len,
+			      uint32_t key_size);
+
+/* Store the given key material, replacing an existing key */
+TEE_Result key_store_import(const void *id, uint32_t id_len,
+			    const void *key, uint32_t key_size);
+
+/* Remove a key from storage and cache */
+TEE_Result key_store_delete(const void *id, uint32_t id_len);
+
+/*
+ * Get the populated key object of an ID, loaded from storage on a cache
+ * miss. The cache is dropped whenever a session wrote or deleted a key
+ * since it was filled. The handle remains owned by the cache and is only
+ * valid until the next key_store_xxx() call, long enough for
+ * TEE_SetOperationKey().
+ */
+TEE_Result key_store_get(const void *id, uint32_t id_len,
+			 TEE_ObjectHandle *key, uint32_t *key_size);
+
+/* Free all cached key objects */
+void key_store_flush(void);
+
+#endif /* KEY_STORE_H */
@@ -1,2 +1,4 @@
 global-incdirs-y += include
 srcs-y += aes_ta.c
+srcs-y += key_store.c
+srcs-y += data_key.c
@@ -7,6 +7,7 @@
 
 #include <err.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* OP-TEE TEE client API (built by optee_client) */
@@ -36,7 +37,80 @@ struct test_value rfc4226_test_values[] = {
 	{ 9, 520489 }
 };
 
-int main(void)
+#define NUM_TEST_VALUES \
+	(sizeof(rfc4226_test_values) / sizeof(struct test_value))
+
+/* OTPs computed by each implementation in the benchmark, by default */
+#define BENCH_ITERATIONS	100000
+
+static TEEC_Result run_benchmark(TEEC_Session *sess, uint32_t impl,
+				 uint32_t iterations, uint32_t *elapsed_ms,
+				 uint32_t *sum)
+{
+	TEEC_Operation op = { 0 };
+	TEEC_Result res;
+	uint32_t err_origin;
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = impl;
+	op.params[0].value.b = iterations;
+
+	res = TEEC_InvokeCommand(sess, TA_HOTP_CMD_BENCHMARK, &op,
+				 &err_origin);
+	if (res != TEEC_SUCCESS) {
+		fprintf(stderr, "TEEC_InvokeCommand failed with code 0x%x "
+			"origin 0x%x\n", res, err_origin);
+		return res;
+	}
+
+	*elapsed_ms = op.params[1].value.a;
+	*sum = op.params[1].value.b;
+	return TEEC_SUCCESS;
+}
+
+/*
+ * Check each HMAC-SHA1 implementation of the TA against the RFC4226 test
+ * values (through the sum of the HOTP values of counters 0 to 9), then
+ * time it over iterations OTPs inside the TA.
+ */
+static void benchmark(TEEC_Session *sess, uint32_t iterations)
+{
+	static const struct {
+		uint32_t impl;
+		const char *name;
+	} impls[] = {
+		{ TA_HOTP_IMPL_MIDSTATE, "midstate" },
+		{ TA_HOTP_IMPL_TEE_MAC, "TEE_MAC" },
+	};
+	uint32_t expected = 0;
+	uint32_t elapsed_ms;
+	uint32_t sum;
+	size_t i;
+
+	for (i = 0; i < NUM_TEST_VALUES; i++)
+		expected += rfc4226_test_values[i].expected;
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (run_benchmark(sess, impls[i].impl, NUM_TEST_VALUES,
+				  &elapsed_ms, &sum))
+			return;
+		if (sum != expected) {
+			fprintf(stderr, "%s: unexpected HOTPs from TEE!\n",
+				impls[i].name);
+			continue;
+		}
+
+		if (run_benchmark(sess, impls[i].impl, iterations,
+				  &elapsed_ms, &sum))
+			return;
+		fprintf(stdout, "%-9s %u HOTPs in %u ms, %.2f us per HOTP\n",
+			impls[i].name, iterations, elapsed_ms,
+			iterations ? elapsed_ms * 1000.0 / iterations : 0);
+	}
+}
+
+int main(int argc, char *argv[])
 {
 	TEEC_Context ctx;
 	TEEC_Operation op = { 0 };
@@ -85,12 +159,17 @@ int main(void)
 		goto exit;
 	}
 
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		benchmark(&sess, argc > 2 ? strtoul(argv[2], NULL, 0) :
+					    BENCH_ITERATIONS);
+		goto exit;
+	}
+
 	/* 2. Get HMAC based One Time Passwords */
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_NONE,
 					 TEEC_NONE, TEEC_NONE);
 
-	for (i = 0; i < sizeof(rfc4226_test_values) / sizeof(struct test_value);
-	     i++) {
+	for (i = 0; i < NUM_TEST_VALUES; i++) {
 		res = TEEC_InvokeCommand(&sess, TA_HOTP_CMD_GET_HOTP, &op,
 					 &err_origin);
 		if (res != TEEC_SUCCESS) {
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <tee_internal_api.h>
+
+#include "hmac_sha1.h"
+
+#define ROL32(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/* SHA-1 compression function (FIPS 180-4 6.1.2), 16 words of schedule */
+static void sha1_compress(uint32_t state[5],
+			  const uint8_t block[HMAC_SHA1_BLOCK_SIZE])
+{
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t e = state[4];
+	uint32_t w[16];
+	uint32_t f;
+	uint32_t k;
+	uint32_t t;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = get_be32(block + 4 * i);
+
+	for (i = 0; i < 80; i++) {
+		if (i >= 16)
+			w[i & 15] = ROL32(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^
+					  w[(i + 2) & 15] ^ w[i & 15], 1);
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdc;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+
+		t = ROL32(a, 5) + f + e + k + w[i & 15];
+		e = d;
+		d = c;
+		c = ROL32(b, 30);
+		b = a;
+		a = t;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+
+	TEE_MemFill(w, 0, sizeof(w));
+}
+
+/*
+ * Hash the last block of a message: msglen bytes already absorbed in
+ * state as whole blocks, plus len bytes of data.
+ */
+static void sha1_final(uint32_t state[5], const uint8_t *data, size_t len,
+		       size_t msglen, uint8_t digest[HMAC_SHA1_SIZE])
+{
+	uint8_t block[HMAC_SHA1_BLOCK_SIZE] = { 0 };
+	uint64_t bits = (uint64_t)(msglen + len) * 8;
+	int i;
+
+	memcpy(block, data, len);
+	block[len] = 0x80;
+	put_be32(block + 56, bits >> 32);
+	put_be32(block + 60, bits);
+
+	sha1_compress(state, block);
+
+	for (i = 0; i < 5; i++)
+		put_be32(digest + 4 * i, state[i]);
+
+	TEE_MemFill(block, 0, sizeof(block));
+}
+
+void hmac_sha1_set_key(struct hmac_sha1_key *hkey, const uint8_t *key,
+		       size_t keylen)
+{
+	uint8_t block[HMAC_SHA1_BLOCK_SIZE] = { 0 };
+	size_t i;
+
+	memcpy(block, key, keylen);
+
+	for (i = 0; i < sizeof(block); i++)
+		block[i] ^= 0x36;
+	memcpy(hkey->inner, sha1_iv, sizeof(sha1_iv));
+	sha1_compress(hkey->inner, block);
+
+	for (i = 0; i < sizeof(block); i++)
+		block[i] ^= 0x36 ^ 0x5c;
+	memcpy(hkey->outer, sha1_iv, sizeof(sha1_iv));
+	sha1_compress(hkey->outer, block);
+
+	TEE_MemFill(block, 0, sizeof(block));
+}
+
+void hmac_sha1_short(const struct hmac_sha1_key *hkey, const uint8_t *msg,
+		     size_t msglen, uint8_t mac[HMAC_SHA1_SIZE])
+{
+	uint8_t inner[HMAC_SHA1_SIZE];
+	uint32_t state[5];
+
+	/* H(key ^ ipad || msg), the key block is in the midstate */
+	memcpy(state, hkey->inner, sizeof(state));
+	sha1_final(state, msg, msglen, HMAC_SHA1_BLOCK_SIZE, inner);
+
+	/* H(key ^ opad || inner) */
+	memcpy(state, hkey->outer, sizeof(state));
+	sha1_final(state, inner, sizeof(inner), HMAC_SHA1_BLOCK_SIZE, mac);
+
+	TEE_MemFill(inner, 0, sizeof(inner));
+	TEE_MemFill(state, 0, sizeof(state));
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HMAC_SHA1_H
+#define HMAC_SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HMAC-SHA1 (RFC 2104) of short messages under a fixed key. The SHA-1
+ * states after the key XOR ipad and key XOR opad blocks are computed once
+ * per key, a message of up to HMAC_SHA1_MAX_MSG_SIZE bytes then costs two
+ * SHA-1 compressions.
+ */
+
+#define HMAC_SHA1_SIZE		20
+#define HMAC_SHA1_BLOCK_SIZE	64
+/* Longest message fitting a single block with its padding */
+#define HMAC_SHA1_MAX_MSG_SIZE	(HMAC_SHA1_BLOCK_SIZE - 1 - 8)
+
+struct hmac_sha1_key {
+	uint32_t inner[5];	/* state after key ^ ipad */
+	uint32_t outer[5];	/* state after key ^ opad */
+};
+
+/* Precompute the states of a key of at most HMAC_SHA1_BLOCK_SIZE bytes */
+void hmac_sha1_set_key(struct hmac_sha1_key *hkey, const uint8_t *key,
+		       size_t keylen);
+
+/* HMAC of msglen <= HMAC_SHA1_MAX_MSG_SIZE bytes into mac */
+void hmac_sha1_short(const struct hmac_sha1_key *hkey, const uint8_t *msg,
+		     size_t msglen, uint8_t mac[HMAC_SHA1_SIZE]);
+
+#endif /* HMAC_SHA1_H */
@@ -9,8 +9,10 @@
 #include <tee_internal_api_extensions.h>
 #include <tee_internal_api.h>
 
+#include "hmac_sha1.h"
+
 /* The size of a SHA1 hash in bytes. */
-#define SHA1_HASH_SIZE 20
+#define SHA1_HASH_SIZE HMAC_SHA1_SIZE
 
 /* GP says that for HMAC SHA-1, max is 512 bits and min 80 bits. */
 #define MAX_KEY_SIZE 64 /* In bytes */
@@ -23,58 +25,82 @@
  * Currently this only supports a single key, in the future this could be
  * updated to support multiple users, all with different unique keys (stored
  * using secure storage).
+ *
+ * The HMAC operation and the key object holding K live from
+ * register_shared_key() until the key changes, so that an OTP only costs
+ * TEE_MACInit() and TEE_MACComputeFinal(). Both are allocated for
+ * MAX_KEY_SIZE, a new key of any size reuses them.
+ *
+ * OTPs are computed from the SHA-1 states after K ^ ipad and K ^ opad,
+ * precomputed at the same time, so that an OTP only costs two SHA-1
+ * compressions in the TA. The GP operation remains for comparison, see
+ * TA_HOTP_CMD_BENCHMARK.
  */
-static uint8_t K[MAX_KEY_SIZE];
-static uint32_t K_len;
+static TEE_OperationHandle op_handle = TEE_HANDLE_NULL;
+static TEE_ObjectHandle key_handle = TEE_HANDLE_NULL;
+static struct hmac_sha1_key hkey;
 
 /* The counter as defined by RFC4226. */
 static uint8_t counter[] = { 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
 
+static void free_hmac_key(void)
+{
+	if (op_handle != TEE_HANDLE_NULL)
+		TEE_FreeOperation(op_handle);
+	op_handle = TEE_HANDLE_NULL;
+
+	/* It is OK to call this when key_handle is TEE_HANDLE_NULL */
+	TEE_FreeTransientObject(key_handle);
+	key_handle = TEE_HANDLE_NULL;
+
+	TEE_MemFill(&hkey, 0, sizeof(hkey));
+}
+
 /*
- *  HMAC a block of memory to produce the authentication tag
+ *  Load the secret key into the HMAC operation, allocating the handles on
+ *  first use. On error no key is loaded.
  *  @param key       The secret key
  *  @param keylen    The length of the secret key (bytes)
- *  @param in        The data to HMAC
- *  @param inlen     The length of the data to HMAC (bytes)
- *  @param out       [out] Destination of the authentication tag
- *  @param outlen    [in/out] Max size and resulting size of authentication tag
  */
-static TEE_Result hmac_sha1(const uint8_t *key, const size_t keylen,
-			    const uint8_t *in, const size_t inlen,
-			    uint8_t *out, uint32_t *outlen)
+static TEE_Result set_hmac_key(const uint8_t *key, const size_t keylen)
 {
 	TEE_Attribute attr = { 0 };
-	TEE_ObjectHandle key_handle = TEE_HANDLE_NULL;
-	TEE_OperationHandle op_handle = TEE_HANDLE_NULL;
 	TEE_Result res = TEE_SUCCESS;
 
 	if (keylen < MIN_KEY_SIZE || keylen > MAX_KEY_SIZE)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	if (!in || !out || !outlen)
-		return TEE_ERROR_BAD_PARAMETERS;
-
-	/*
-	 * 1. Allocate cryptographic (operation) handle for the HMAC operation.
-	 *    Note that the expected size here is in bits (and therefore times
-	 *    8)!
-	 */
-	res = TEE_AllocateOperation(&op_handle, TEE_ALG_HMAC_SHA1, TEE_MODE_MAC,
-				    keylen * 8);
-	if (res != TEE_SUCCESS) {
-		EMSG("0x%08x", res);
-		goto exit;
-	}
-
-	/*
-	 * 2. Allocate a container (key handle) for the HMAC attributes. Note
-	 *    that the expected size here is in bits (and therefore times 8)!
-	 */
-	res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA1, keylen * 8,
-					  &key_handle);
-	if (res != TEE_SUCCESS) {
-		EMSG("0x%08x", res);
-		goto exit;
+	if (op_handle == TEE_HANDLE_NULL) {
+		/*
+		 * 1. Allocate cryptographic (operation) handle for the HMAC
+		 *    operation. Note that the expected size here is in bits
+		 *    (and therefore times 8)!
+		 */
+		res = TEE_AllocateOperation(&op_handle, TEE_ALG_HMAC_SHA1,
+					    TEE_MODE_MAC, MAX_KEY_SIZE * 8);
+		if (res != TEE_SUCCESS) {
+			EMSG("0x%08x", res);
+			op_handle = TEE_HANDLE_NULL;
+			goto exit;
+		}
+
+		/*
+		 * 2. Allocate a container (key handle) for the HMAC
+		 *    attributes. Note that the expected size here is in bits
+		 *    (and therefore times 8)!
+		 */
+		res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA1,
+						  MAX_KEY_SIZE * 8,
+						  &key_handle);
+		if (res != TEE_SUCCESS) {
+			EMSG("0x%08x", res);
+			key_handle = TEE_HANDLE_NULL;
+			goto exit;
+		}
+	} else {
+		/* A key is loaded, the operation holds a copy of it */
+		TEE_ResetOperation(op_handle);
+		TEE_ResetTransientObject(key_handle);
 	}
 
 	/*
@@ -97,20 +123,38 @@ static TEE_Result hmac_sha1(const uint8_t *key, const size_t keylen,
 		goto exit;
 	}
 
-	/* 6. Do the HMAC operations */
-	TEE_MACInit(op_handle, NULL, 0);
-	TEE_MACUpdate(op_handle, in, inlen);
-	res = TEE_MACComputeFinal(op_handle, NULL, 0, out, outlen);
+	/* 6. Absorb K ^ ipad and K ^ opad once for all OTPs */
+	hmac_sha1_set_key(&hkey, key, keylen);
 exit:
-	if (op_handle != TEE_HANDLE_NULL)
-		TEE_FreeOperation(op_handle);
-
-	/* It is OK to call this when key_handle is TEE_HANDLE_NULL */
-	TEE_FreeTransientObject(key_handle);
+	/* The handles only stay allocated with a key loaded */
+	if (res != TEE_SUCCESS)
+		free_hmac_key();
 
 	return res;
 }
 
+/*
+ *  HMAC a block of memory with the key of set_hmac_key() to produce the
+ *  authentication tag
+ *  @param in        The data to HMAC
+ *  @param inlen     The length of the data to HMAC (bytes)
+ *  @param out       [out] Destination of the authentication tag
+ *  @param outlen    [in/out] Max size and resulting size of authentication tag
+ */
+static TEE_Result hmac_sha1(const uint8_t *in, const size_t inlen,
+			    uint8_t *out, uint32_t *outlen)
+{
+	if (op_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	if (!in || !out || !outlen)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* 7. Do the HMAC operations */
+	TEE_MACInit(op_handle, NULL, 0);
+	return TEE_MACComputeFinal(op_handle, in, inlen, out, outlen);
+}
+
 /*
  * Truncate function working as described in RFC4226.
  */
@@ -140,14 +184,11 @@ static TEE_Result register_shared_key(uint32_t param_types, TEE_Param params[4])
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	if (params[0].memref.size > sizeof(K))
-		return TEE_ERROR_BAD_PARAMETERS;
-
-	memset(K, 0, sizeof(K));
-	memcpy(K, params[0].memref.buffer, params[0].memref.size);
+	res = set_hmac_key(params[0].memref.buffer, params[0].memref.size);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	K_len = params[0].memref.size;
-	DMSG("Got shared key %s (%u bytes).", K, params[0].memref.size);
+	DMSG("Got shared key (%u bytes).", params[0].memref.size);
 
 	return res;
 }
@@ -157,7 +198,6 @@ static TEE_Result get_hotp(uint32_t param_types, TEE_Param params[4])
 	TEE_Result res = TEE_SUCCESS;
 	uint32_t hotp_val;
 	uint8_t mac[SHA1_HASH_SIZE];
-	uint32_t mac_len = sizeof(mac);
 	int i;
 
 	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
@@ -170,7 +210,10 @@ static TEE_Result get_hotp(uint32_t param_types, TEE_Param params[4])
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	res = hmac_sha1(K, K_len, counter, sizeof(counter), mac, &mac_len);
+	if (op_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	hmac_sha1_short(&hkey, counter, sizeof(counter), mac);
 
 	/* Increment the counter. */
 	for (i = sizeof(counter) - 1; i >= 0; i--) {
@@ -185,6 +228,66 @@ static TEE_Result get_hotp(uint32_t param_types, TEE_Param params[4])
 	return res;
 }
 
+static TEE_Result benchmark(uint32_t param_types, TEE_Param params[4])
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t ctr[sizeof(counter)];
+	uint8_t mac[SHA1_HASH_SIZE];
+	uint32_t mac_len;
+	uint32_t hotp_val;
+	uint32_t sum = 0;
+	uint32_t impl;
+	uint32_t n;
+	TEE_Time start;
+	TEE_Time end;
+	int i;
+
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types) {
+		EMSG("Expected: 0x%x, got: 0x%x", exp_param_types, param_types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	impl = params[0].value.a;
+	if (impl != TA_HOTP_IMPL_MIDSTATE && impl != TA_HOTP_IMPL_TEE_MAC)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (op_handle == TEE_HANDLE_NULL)
+		return TEE_ERROR_BAD_STATE;
+
+	TEE_GetSystemTime(&start);
+
+	for (n = 0; n < params[0].value.b; n++) {
+		/* Counter n, big endian as defined by RFC4226 */
+		for (i = sizeof(ctr) - 1; i >= 0; i--)
+			ctr[i] = (uint64_t)n >> (8 * (sizeof(ctr) - 1 - i));
+
+		if (impl == TA_HOTP_IMPL_MIDSTATE) {
+			hmac_sha1_short(&hkey, ctr, sizeof(ctr), mac);
+		} else {
+			mac_len = sizeof(mac);
+			res = hmac_sha1(ctr, sizeof(ctr), mac, &mac_len);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+
+		truncate(mac, &hotp_val);
+		sum += hotp_val;
+	}
+
+	TEE_GetSystemTime(&end);
+
+	params[1].value.a = (end.seconds - start.seconds) * 1000 +
+			    end.millis - start.millis;
+	params[1].value.b = sum;
+
+	return res;
+}
+
 /*******************************************************************************
  * Mandatory TA functions.
  ******************************************************************************/
@@ -195,6 +298,7 @@ TEE_Result TA_CreateEntryPoint(void)
 
 void TA_DestroyEntryPoint(void)
 {
+	free_hmac_key();
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
@@ -226,6 +330,9 @@ TEE_Result TA_InvokeCommandEntryPoint(void __unused *sess_ctx,
 	case TA_HOTP_CMD_GET_HOTP:
 		return get_hotp(param_types, params);
 
+	case TA_HOTP_CMD_BENCHMARK:
+		return benchmark(param_types, params);
+
 	default:
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
@@ -20,4 +20,16 @@
 #define TA_HOTP_CMD_REGISTER_SHARED_KEY	0
 #define TA_HOTP_CMD_GET_HOTP		1
 
+/*
+ * TA_HOTP_CMD_BENCHMARK - Time the HOTP of counters 0 to iterations - 1
+ * under the registered key, the OTP counter is left as is
+ * param[0] (value) a: TA_HOTP_IMPL_xxx, b: iterations
+ * param[1] (value) a: elapsed milliseconds, b: sum of the HOTP values
+ */
+#define TA_HOTP_CMD_BENCHMARK		2
+
+/* HMAC-SHA1 implementations, TA_HOTP_CMD_GET_HOTP uses the midstates */
+#define TA_HOTP_IMPL_MIDSTATE		0	/* precomputed ipad/opad states */
+#define TA_HOTP_IMPL_TEE_MAC		1	/* TEE_MACInit/ComputeFinal */
+
 #endif
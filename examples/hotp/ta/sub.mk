@@ -1,2 +1,3 @@
 global-incdirs-y += include
 srcs-y += hotp_ta.c
+srcs-y += hmac_sha1.c
@@ -0,0 +1,264 @@
+/**
+ * Hex encoder and decoder
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "hexcodec.h"
+
+// bytes encoded per fwrite in hex_fprint()
+#define HEX_PRINT_CHUNK     2048
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+// character to nibble value + 1, 0 for non hex characters
+static const uint8_t hex_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+size_t hex_encode_scalar(char *dst, const void *src, size_t len)
+{
+    const uint8_t *p = src;
+
+    for (size_t i = 0; i < len; i++) {
+        dst[2 * i] = hex_digits[p[i] >> 4];
+        dst[2 * i + 1] = hex_digits[p[i] & 0x0f];
+    }
+
+    return 2 * len;
+}
+
+ssize_t hex_decode_scalar(void *dst, const char *src, size_t len)
+{
+    uint8_t *p = dst;
+
+    if (len % 2)
+        return -1;
+
+    for (size_t i = 0; i < len / 2; i++) {
+        int hi = hex_values[(uint8_t)src[2 * i]] - 1;
+        int lo = hex_values[(uint8_t)src[2 * i + 1]] - 1;
+
+        if (hi < 0 || lo < 0)
+            return -1;
+
+        p[i] = hi << 4 | lo;
+    }
+
+    return len / 2;
+}
+
+#if defined(__SSE2__)
+
+/* nibble (0..15) per byte to '0'..'9', 'A'..'F' */
+static inline __m128i nibble_to_ascii(__m128i n)
+{
+    __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+                        _mm_and_si128(letter, _mm_set1_epi8('A' - '0' - 10)));
+}
+
+/* hex character per byte to its value, non hex characters are flagged in invalid */
+static inline __m128i ascii_to_nibble(__m128i c, __m128i *invalid)
+{
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    // unsigned x <= max as min(x, max) == x
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+
+    *invalid = _mm_or_si128(*invalid, _mm_andnot_si128(_mm_or_si128(is_digit, is_alpha), _mm_set1_epi8(-1)));
+
+    return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                        _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+/* 16 characters (as 8 pairs in 16 bit lanes) to 8 bytes in the low half of each lane */
+static inline __m128i pack_pairs(__m128i n)
+{
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00ff)), 4),
+                        _mm_srli_epi16(n, 8));
+}
+
+size_t hex_encode(char *dst, const void *src, size_t len)
+{
+    const uint8_t *p = src;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+        __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+
+        // high nibble first
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), nibble_to_ascii(_mm_unpacklo_epi8(hi, lo)));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), nibble_to_ascii(_mm_unpackhi_epi8(hi, lo)));
+    }
+
+    hex_encode_scalar(dst + 2 * i, p + i, len - i);
+
+    return 2 * len;
+}
+
+ssize_t hex_decode(void *dst, const char *src, size_t len)
+{
+    uint8_t *p = dst;
+    __m128i invalid = _mm_setzero_si128();
+    size_t i = 0;
+
+    if (len % 2)
+        return -1;
+
+    for (; i + 32 <= len; i += 32) {
+        __m128i n0 = ascii_to_nibble(_mm_loadu_si128((const __m128i *)(src + i)), &invalid);
+        __m128i n1 = ascii_to_nibble(_mm_loadu_si128((const __m128i *)(src + i + 16)), &invalid);
+
+        _mm_storeu_si128((__m128i *)(p + i / 2), _mm_packus_epi16(pack_pairs(n0), pack_pairs(n1)));
+    }
+
+    if (_mm_movemask_epi8(invalid))
+        return -1;
+
+    if (hex_decode_scalar(p + i / 2, src + i, len - i) < 0)
+        return -1;
+
+    return len / 2;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+static inline uint8x16_t ascii_to_nibble(uint8x16_t c, uint8x16_t *invalid)
+{
+    uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+    uint8x16_t is_alpha = vcleq_u8(alpha, vdupq_n_u8(5));
+
+    *invalid = vorrq_u8(*invalid, vmvnq_u8(vorrq_u8(is_digit, is_alpha)));
+
+    return vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+
+size_t hex_encode(char *dst, const void *src, size_t len)
+{
+    const uint8x16_t digits = vld1q_u8((const uint8_t *)hex_digits);
+    const uint8_t *p = src;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16x2_t out;
+
+        out.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(v, 4));
+        out.val[1] = vqtbl1q_u8(digits, vandq_u8(v, vdupq_n_u8(0x0f)));
+        // interleaving store puts the high nibble first
+        vst2q_u8((uint8_t *)dst + 2 * i, out);
+    }
+
+    hex_encode_scalar(dst + 2 * i, p + i, len - i);
+
+    return 2 * len;
+}
+
+ssize_t hex_decode(void *dst, const char *src, size_t len)
+{
+    uint8x16_t invalid = vdupq_n_u8(0);
+    uint8_t *p = dst;
+    size_t i = 0;
+
+    if (len % 2)
+        return -1;
+
+    for (; i + 32 <= len; i += 32) {
+        // de-interleaving load splits high and low nibble characters
+        uint8x16x2_t c = vld2q_u8((const uint8_t *)src + i);
+        uint8x16_t hi = ascii_to_nibble(c.val[0], &invalid);
+        uint8x16_t lo = ascii_to_nibble(c.val[1], &invalid);
+
+        vst1q_u8(p + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+
+    if (vmaxvq_u8(invalid))
+        return -1;
+
+    if (hex_decode_scalar(p + i / 2, src + i, len - i) < 0)
+        return -1;
+
+    return len / 2;
+}
+
+#else
+
+size_t hex_encode(char *dst, const void *src, size_t len)
+{
+    return hex_encode_scalar(dst, src, len);
+}
+
+ssize_t hex_decode(void *dst, const char *src, size_t len)
+{
+    return hex_decode_scalar(dst, src, len);
+}
+
+#endif
+
+int hex_fprint(FILE *fp, const void *buf, size_t len)
+{
+    char out[2 * HEX_PRINT_CHUNK + 1];
+    const uint8_t *p = buf;
+
+    // an empty buffer still ends its line, like the printf loop did
+    if (!len)
+        return fputc('\n', fp) == EOF ? -1 : 0;
+
+    while (len) {
+        size_t n = len < HEX_PRINT_CHUNK ? len : HEX_PRINT_CHUNK;
+        size_t chars = hex_encode(out, p, n);
+
+        p += n;
+        len -= n;
+
+        // the newline goes out with the last chunk
+        if (!len)
+            out[chars++] = '\n';
+
+        if (fwrite(out, 1, chars, fp) != chars)
+            return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * Hex encoder and decoder
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HEXCODEC_H__
+#define __HEXCODEC_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/**
+ * Encode len bytes into 2 * len upper case hex characters, dst is not
+ * NUL terminated
+ * @param dst [out] at least 2 * len characters
+ * @param src
+ * @param len
+ * @return number of characters written
+ */
+size_t hex_encode(char *dst, const void *src, size_t len);
+
+/**
+ * Decode len hex characters (upper or lower case) into len / 2 bytes
+ * @param dst [out] at least len / 2 bytes
+ * @param src
+ * @param len has to be even
+ * @return number of bytes written, -1 on odd length or a non hex character
+ */
+ssize_t hex_decode(void *dst, const char *src, size_t len);
+
+/**
+ * Plain C versions of hex_encode() and hex_decode(), used for the tails
+ * the SIMD loops leave over
+ */
+size_t hex_encode_scalar(char *dst, const void *src, size_t len);
+ssize_t hex_decode_scalar(void *dst, const char *src, size_t len);
+
+/**
+ * Write buf as one line of upper case hex, encoded in chunks and written
+ * with fwrite instead of one printf per byte
+ * @param fp
+ * @param buf
+ * @param len
+ * @return 0 on success, -1 on write error
+ */
+int hex_fprint(FILE *fp, const void *buf, size_t len);
+
+#endif /* __HEXCODEC_H__ */
@@ -36,6 +36,9 @@
 #include <termios.h>
 
 #include <tee_client_api.h>
+
+#include "hexcodec.h"
+
 /* To the the UUID (found the the TA's h-file(s)) */
 #include <signer-tee_ta.h>
 
@@ -79,11 +82,7 @@ int get_one_character(char* c)
  * @param len
  */
 void print_buffer(void *buf, size_t len){
-    uint8_t *pbyte = buf;
-
-    for(int i = 0; i < len; i ++)
-        printf("%02"PRIX8"", pbyte[i]);
-    printf("\n");
+    hex_fprint(stdout, buf, len);
 }
 
 /**
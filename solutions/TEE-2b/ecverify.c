@@ -31,7 +31,6 @@
 #include <openssl/err.h>
 #include <openssl/ec.h>
 #include <openssl/pem.h>
-#include <openssl/bn.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -39,67 +38,344 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "hash.h"
+#include "hexcodec.h"
+#include "keyring.h"
+#include "sha256mb.h"
+#include "sigverify.h"
+#include "treeverify.h"
+#include "vcache.h"
+
 void print_buffer(void *buf, size_t len)
 {
-    uint8_t *pbyte = buf;
-
-    for(size_t i = 0; i < len; i ++)
-        printf("%02"PRIX8"", pbyte[i]);
-    printf("\n");
+    hex_fprint(stdout, buf, len);
 }
 
 /**
- * Calculate hash of type EVP_MD*
- * @param type
- * @param src
- * @param size
- * @param digest
+ * Last OpenSSL error as string. Error strings are only loaded once there
+ * is an error to report, not on every start.
  * @return
  */
-int calc_hash(const EVP_MD* type, const void* src, const size_t size, void** digest)
+static const char *crypto_error(void)
+{
+    OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
+    return ERR_error_string(ERR_get_error(), NULL);
+}
+
+static uint64_t now_ns(void)
 {
-    unsigned int len = 0;
-    unsigned char calc_hash[EVP_MAX_KEY_LENGTH];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-    //EVP_MD_CTX_set_flags(ctx, EVP_MD_CTX_FLAG_ONESHOT | EVP_MD_CTX_FLAG_FINALISE);
+// batch lines up to this length are hashed with the multi-buffer kernel
+#define BATCH_SHORT_MESSAGE     512
+// lines of a batch file hashed, verified and reported together
+#define BATCH_LINES             64
+
+// verdicts of batch lines besides the EVP_PKEY_verify ones (1, 0, -1)
+#define BATCH_PENDING           2
+#define BATCH_MALFORMED         3
+#define BATCH_UNKNOWN_KEY       4
+
+// one line of a batch file, buf is reused for the following lines
+struct batch_record {
+    size_t line;
+    char *buf;
+    size_t buf_size;
+    int result;
+    const char *message;
+    size_t message_len;
+    uint8_t pubkey[SIGVERIFY_PUBKEY_SIZE];
+    uint8_t signature[SIGVERIFY_SIGNATURE_SIZE];
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    int digestlen;
+};
+
+struct batch_totals {
+    size_t verified;
+    size_t failed;
+    size_t skipped;
+};
 
-    if (!EVP_DigestInit_ex(ctx,  type, NULL)) {
-        printf("EVP_DigestInit_ex() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
-        goto cleanup;
+/**
+ * SHA256 the messages of all pending records, short messages several at once
+ * @param records
+ * @param count
+ */
+static void hash_batch_records(struct batch_record *records, size_t count)
+{
+    const void *msgs[BATCH_LINES];
+    size_t lens[BATCH_LINES];
+    uint8_t digests[BATCH_LINES][SHA256MB_DIGEST_SIZE];
+    size_t idx[BATCH_LINES];
+    size_t n = 0;
+    int multi_buffer = sha256mb_lanes() > 1;
+
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].result != BATCH_PENDING) {
+            continue;
+        }
+
+        // the scalar kernel and long messages are faster through OpenSSL
+        if (multi_buffer && records[i].message_len <= BATCH_SHORT_MESSAGE) {
+            msgs[n] = records[i].message;
+            lens[n] = records[i].message_len;
+            idx[n++] = i;
+        } else {
+            records[i].digestlen = calc_hash(hash_sha256(), records[i].message, records[i].message_len, records[i].digest);
+        }
     }
 
-    if (!EVP_DigestUpdate(ctx, src, size)) {
-        printf("EVP_DigestUpdate() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
-        goto cleanup;
+    sha256mb(msgs, lens, n, digests);
+
+    for (size_t k = 0; k < n; k++) {
+        memcpy(records[idx[k]].digest, digests[k], SHA256MB_DIGEST_SIZE);
+        records[idx[k]].digestlen = SHA256MB_DIGEST_SIZE;
     }
+}
 
-    if (!EVP_DigestFinal_ex(ctx, calc_hash, &len)) {
-        printf("EVP_DigestFinal_ex() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+/**
+ * Verify the pending records and report every line that did not verify,
+ * in line order. Records with a cached verdict are not verified again.
+ * @param outbio
+ * @param verifier
+ * @param cache NULL without verification cache
+ * @param records
+ * @param count
+ * @param totals [in,out] updated with the records
+ * @return 0 on success, -1 on error
+ */
+static int verify_batch_records(BIO *outbio, struct sigverify *verifier, struct vcache *cache,
+                                struct batch_record *records, size_t count, struct batch_totals *totals)
+{
+    static const char *const verdicts[] = {
+        [BATCH_MALFORMED] = "MALFORMED", [BATCH_UNKNOWN_KEY] = "UNKNOWN KEY",
+    };
+    uint8_t key[VCACHE_KEY_SIZE];
+    uint64_t start;
+
+    hash_batch_records(records, count);
+
+    for (size_t i = 0; i < count; i++) {
+        struct batch_record *record = &records[i];
+
+        if (record->result != BATCH_PENDING) {
+            continue;
+        }
+
+        if (cache) {
+            if (vcache_key(record->pubkey, record->digest, record->digestlen, record->signature, key)) {
+                BIO_printf(outbio, "vcache_key() failed!\n");
+                return -1;
+            }
+            if ((record->result = vcache_lookup(cache, key)) >= 0) {
+                continue;
+            }
+        }
+
+        start = now_ns();
+        record->result = sigverify_verify(verifier, record->pubkey, record->digest, record->digestlen,
+                                          record->signature);
+        if (cache) {
+            vcache_account(cache, 1, now_ns() - start);
+            vcache_store(cache, key, record->result);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct batch_record *record = &records[i];
+
+        switch (record->result) {
+            case 1:
+                totals->verified++;
+                break;
+            case 0:
+            case -1:
+                BIO_printf(outbio, "line %zu: %s\n", record->line, record->result ? "INVALID KEY" : "FAILURE");
+                totals->verified++;
+                totals->failed++;
+                break;
+            default:
+                BIO_printf(outbio, "line %zu: %s\n", record->line, verdicts[record->result]);
+                totals->skipped++;
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Resolve the key field of a batch line
+ * @param ring NULL without keyring
+ * @param hex X || Y in hex or, with a keyring, a key ID of up to 2 * KEYRING_ID_SIZE hex digits
+ * @param pubkey [out] X || Y
+ * @return 0 on success, -1 if malformed, 1 if the key ID is not in the keyring
+ */
+static int parse_batch_key(const struct keyring *ring, const char *hex, uint8_t *pubkey)
+{
+    const struct keyring_record *record;
+    uint8_t id[KEYRING_ID_SIZE];
+    size_t len = strlen(hex);
+
+    if (len == 2 * SIGVERIFY_PUBKEY_SIZE) {
+        return hex_decode(pubkey, hex, len) < 0 ? -1 : 0;
+    }
+
+    if (!ring || keyring_parse_id(hex, len, id)) {
+        return -1;
+    }
+
+    if ((record = keyring_find(ring, id)) == NULL) {
+        return 1;
+    }
+
+    // skip the 0x04 of the uncompressed point
+    memcpy(pubkey, record->point + 1, SIGVERIFY_PUBKEY_SIZE);
+
+    return 0;
+}
+
+/**
+ * Verify a batch file, one signed message per line:
+ * <pubkey X||Y hex | key ID hex> <signature R||S hex> <message>
+ * The message is hashed with SHA256, same as string_to_sign. Lines that
+ * are malformed or name an unknown key are reported in line order with
+ * the verdicts, but do not count as verified signatures.
+ * @param outbio
+ * @param cache NULL without verification cache
+ * @param ring NULL without keyring
+ * @param path
+ * @return number of lines not verified successfully, -1 on error
+ */
+static int verify_batch_file(BIO *outbio, struct vcache *cache, const struct keyring *ring, const char *path)
+{
+    struct batch_record records[BATCH_LINES];
+    struct batch_totals totals = { 0 };
+    struct sigverify *verifier = NULL;
+    size_t count = 0, lineno = 0;
+    ssize_t len;
+    int failed = -1;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        BIO_printf(outbio, "%s while opening %s\n", strerror(errno), path);
+        return -1;
+    }
+
+    memset(records, 0, sizeof(records));
+
+    if ((verifier = sigverify_new(SIGVERIFY_DEFAULT_KEYS)) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+
+    while ((len = getline(&records[count].buf, &records[count].buf_size, fp)) != -1) {
+        struct batch_record *record = &records[count];
+        char *line = record->buf;
+        char *pubkey_hex, *signature_hex, *message, *save = NULL;
+        int key;
+
+        record->line = ++lineno;
+
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+
+        pubkey_hex = strtok_r(line, " ", &save);
+        signature_hex = strtok_r(NULL, " ", &save);
+        message = strtok_r(NULL, "", &save);
+
+        if (!pubkey_hex || !signature_hex || !message || strlen(signature_hex) != 2 * SIGVERIFY_SIGNATURE_SIZE ||
+            hex_decode(record->signature, signature_hex, 2 * SIGVERIFY_SIGNATURE_SIZE) < 0 ||
+            (key = parse_batch_key(ring, pubkey_hex, record->pubkey)) < 0) {
+            record->result = BATCH_MALFORMED;
+        } else if (key) {
+            record->result = BATCH_UNKNOWN_KEY;
+        } else {
+            record->result = BATCH_PENDING;
+            record->message = message;
+            record->message_len = strlen(message);
+        }
+
+        if (++count == BATCH_LINES) {
+            if (verify_batch_records(outbio, verifier, cache, records, count, &totals)) {
+                goto cleanup;
+            }
+            count = 0;
+        }
+    }
+
+    if (count && verify_batch_records(outbio, verifier, cache, records, count, &totals)) {
         goto cleanup;
     }
 
-    *digest = OPENSSL_zalloc(len);
-    memcpy(*digest, calc_hash, len);
+    BIO_printf(outbio, "%zu signatures verified, %zu failed", totals.verified, totals.failed);
+    if (totals.skipped) {
+        BIO_printf(outbio, ", %zu lines skipped (malformed or unknown key)", totals.skipped);
+    }
+    BIO_printf(outbio, "\n");
+
+    failed = totals.failed + totals.skipped;
 
 cleanup:
-    EVP_MD_CTX_free(ctx);
-    return len;
+    sigverify_free(verifier);
+    for (size_t i = 0; i < BATCH_LINES; i++) {
+        free(records[i].buf);
+    }
+    fclose(fp);
+
+    return failed;
 }
 
-unsigned char* hexstr_to_char(const char* hexstr)
+static void usage(const char *prog)
 {
-    size_t len = strlen(hexstr);
-    if (len % 2 != 0)
-        return NULL;
-    size_t final_len = len / 2;
-    unsigned char* chrs = (unsigned char*)malloc((final_len+1) * sizeof(*chrs));
-    for (size_t i=0, j=0; j<final_len; i+=2, j++)
-        chrs[j] = (hexstr[i] % 32 + 9) % 25 * 16 + (hexstr[i+1] % 32 + 9) % 25;
-    chrs[final_len] = '\0';
-    return chrs;
+    fprintf(stderr, "usage: %s [-n] [-c cachefile] [-k keyring] [-b batchfile] [-f file -s signature.txt] [-d dir [-j threads]] [-p pub.txt | -i keyid]\n", prog);
+    fprintf(stderr, "  without options the built-in sample signature is verified\n");
+    fprintf(stderr, "  -n                skip the OpenSSL configuration file (openssl.cnf, OPENSSL_CONF), faster start\n");
+    fprintf(stderr, "  -c cachefile      reuse verdicts of earlier runs, kept in a memory mapped file\n");
+    fprintf(stderr, "  -k keyring        look up keys by ID in a keyring built by keyring_build\n");
+    fprintf(stderr, "  -b batchfile      verify one '<pubkey hex | keyid> <signature hex> <message>' per line\n");
+    fprintf(stderr, "  -f file           verify the SHA256 of file ('-' for stdin)\n");
+    fprintf(stderr, "  -s signature.txt  raw R || S as written by signer-tee\n");
+    fprintf(stderr, "  -d dir            verify every file below dir against <file>%s\n", TREE_SIGNATURE_SUFFIX);
+    fprintf(stderr, "  -j threads        threads for -d, defaults to the number of CPUs\n");
+    fprintf(stderr, "  -p pub.txt        raw X || Y as written by signer-tee, built-in key if omitted\n");
+    fprintf(stderr, "  -i keyid          key ID in the keyring instead of -p, not with -b\n");
+}
+
+/**
+ * Read exactly len bytes from a raw key or signature file
+ * @param path
+ * @param buf
+ * @param len
+ * @return 0 on success, -1 on error
+ */
+static int read_raw(const char *path, void *buf, size_t len)
+{
+    int fd;
+    ssize_t n;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(stderr, "%s while opening %s\n", strerror(errno), path);
+        return -1;
+    }
+
+    n = read(fd, buf, len);
+    close(fd);
+
+    if (n != (ssize_t)len) {
+        fprintf(stderr, "%s: expected %zu bytes\n", path, len);
+        return -1;
+    }
+
+    return 0;
 }
 
 // EC Pubkey TEE_ECC_CURVE_NIST_P256  each 32 bytes (256 bits)
@@ -113,122 +389,275 @@ static const char *ecdsa_signature_s = "B3D2C189CE4DE13C31ACF64F4418F5DE79AAD951
 
 static const char* string_to_sign = "Noser Engineering";
 
-int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
+/**
+ * Get the signer key from the keyring, a raw pub.txt or the built-in key
+ * @param outbio
+ * @param ring NULL without keyring
+ * @param pubkey_path NULL for the built-in key
+ * @param keyid key ID in ring, used instead of pubkey_path
+ * @param pubkey [out] X || Y
+ * @return 0 on success, -1 on error
+ */
+static int load_pubkey(BIO *outbio, const struct keyring *ring, const char *pubkey_path, const char *keyid,
+                       uint8_t *pubkey)
 {
-    int ret;
-    BIO *outbio = NULL;
-    void *digest = NULL;
-    int digestlen = 0;
+    if (keyid) {
+        uint8_t id[KEYRING_ID_SIZE];
+        const struct keyring_record *record;
+
+        if (keyring_parse_id(keyid, strlen(keyid), id) || (record = keyring_find(ring, id)) == NULL) {
+            BIO_printf(outbio, "unknown key ID %s\n", keyid);
+            return -1;
+        }
+        memcpy(pubkey, record->point + 1, SIGVERIFY_PUBKEY_SIZE);
+    } else if (pubkey_path) {
+        if (read_raw(pubkey_path, pubkey, SIGVERIFY_PUBKEY_SIZE)) {
+            return -1;
+        }
+    } else {
+        hex_decode(pubkey, ecdsa_pubkey_x, 64);
+        hex_decode(pubkey + 32, ecdsa_pubkey_y, 64);
+    }
+
+    return 0;
+}
 
-    OpenSSL_add_all_algorithms();
-    OpenSSL_add_all_ciphers();
-    OpenSSL_add_all_digests();
-    ERR_load_BIO_strings();
-    ERR_load_crypto_strings();
+/**
+ * Verify the detached signature of a file
+ * @param outbio
+ * @param cache NULL without verification cache
+ * @param pubkey X || Y
+ * @param path
+ * @param signature_path
+ * @return 1 on success, 0 on signature mismatch, -1 on error
+ */
+static int verify_file(BIO *outbio, struct vcache *cache, const uint8_t *pubkey, const char *path,
+                       const char *signature_path)
+{
+    uint8_t signature[SIGVERIFY_SIGNATURE_SIZE];
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    uint8_t key[VCACHE_KEY_SIZE];
+    struct sigverify *verifier;
+    int digestlen, ret = -1;
+    uint64_t start;
+
+    if (read_raw(signature_path, signature, sizeof(signature))) {
+        return -1;
+    }
 
-    outbio = BIO_new(BIO_s_file());
-    outbio = BIO_new_fp(stdout, BIO_NOCLOSE);
+    if ((digestlen = calc_hash_file(hash_sha256(), path, digest)) == 0) {
+        return -1;
+    }
 
-    // calculate SHA256 digest from string_to_sign
-    digestlen = calc_hash(EVP_sha256(), string_to_sign, strlen(string_to_sign), &digest);
     BIO_printf(outbio, "SHA256 Digest :    ");
     print_buffer(digest, digestlen);
 
-    // convert ECDSA public key X/Y into big number
-    BIGNUM *ecdsa_pubkey_bn_x = NULL;
-    BIGNUM *ecdsa_pubkey_bn_y = NULL;
+    if (cache) {
+        if (vcache_key(pubkey, digest, digestlen, signature, key)) {
+            return -1;
+        }
+        ret = vcache_lookup(cache, key);
+    }
 
-    // if big number var is NULL, it will be allocated internally
-    BN_hex2bn(&ecdsa_pubkey_bn_x, ecdsa_pubkey_x);
-    BN_hex2bn(&ecdsa_pubkey_bn_y, ecdsa_pubkey_y);
+    if (ret < 0) {
+        if ((verifier = sigverify_new(1)) == NULL) {
+            return -1;
+        }
 
-    char *value = BN_bn2hex(ecdsa_pubkey_bn_x);
-    BIO_printf(outbio, "ECDSA Pubkey X:    %s\n", value);
-    OPENSSL_free(value);
+        start = now_ns();
+        ret = sigverify_verify(verifier, pubkey, digest, digestlen, signature);
+        if (cache) {
+            vcache_account(cache, 1, now_ns() - start);
+            vcache_store(cache, key, ret);
+        }
 
-    value = BN_bn2hex(ecdsa_pubkey_bn_y);
-    BIO_printf(outbio, "ECDSA Pubkey Y:    %s\n", value);
-    OPENSSL_free(value);
+        sigverify_free(verifier);
+    }
 
-    // create new EC key
-    EC_KEY *ec_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
-    EC_KEY_set_asn1_flag(ec_key, OPENSSL_EC_NAMED_CURVE);
+    BIO_printf(outbio, "%s: %s\n", path, ret == 1 ? "SUCCESS" : ret == 0 ? "FAILURE" : "ERROR");
 
-    // assigne public key values
-    if (!EC_KEY_set_public_key_affine_coordinates(ec_key, ecdsa_pubkey_bn_x, ecdsa_pubkey_bn_y)) {
-        BIO_printf(outbio, "EC_KEY_set_public_key_affine_coordinates() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
-    }
+    return ret;
+}
+
+/**
+ * Print hit rate and the verification time the hits saved, estimated from
+ * the mean time of all verifications the cache has accounted so far
+ * @param outbio
+ * @param cache
+ */
+static void report_cache(BIO *outbio, struct vcache *cache)
+{
+    struct vcache_stats stats;
 
-    // Converting the EC key into a PKEY structure
-    EVP_PKEY *pkey = EVP_PKEY_new();
+    vcache_get_stats(cache, &stats);
 
-    // EVP_PKEY_assign_EC_KEY free ec_key
-    if (!EVP_PKEY_assign_EC_KEY(pkey, ec_key)) {
-        BIO_printf(outbio, "EVP_PKEY_assign_EC_KEY() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+    BIO_printf(outbio, "cache: %"PRIu64" lookups, %"PRIu64" hits (%.1f%%), %"PRIu64" evictions",
+               stats.lookups, stats.hits, stats.lookups ? 100.0 * stats.hits / stats.lookups : 0.0,
+               stats.evictions);
+    if (stats.verified) {
+        BIO_printf(outbio, ", ~%.3f ms verification time saved",
+                   (double)stats.hits * stats.verify_ns / stats.verified / 1e6);
     }
+    BIO_printf(outbio, "\n");
+}
 
-    // print public key as PEM
-    if (!PEM_write_bio_PUBKEY(outbio, pkey)) {
-        BIO_printf(outbio, "Error writing public key data in PEM format\n");
+int main(int argc, char *argv[])
+{
+    int ret, opt;
+    BIO *outbio = NULL;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    int digestlen = 0;
+    const char *batch_file = NULL, *cache_file = NULL, *keyring_file = NULL, *keyid = NULL, *dir = NULL;
+    uint8_t pubkey[SIGVERIFY_PUBKEY_SIZE];
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t init_opts = OPENSSL_INIT_NO_ADD_ALL_CIPHERS | OPENSSL_INIT_NO_ADD_ALL_DIGESTS;
+    struct vcache *cache = NULL;
+    struct keyring *ring = NULL;
+    const char *file = NULL, *pubkey_file = NULL, *signature_file = NULL;
+
+    while ((opt = getopt(argc, argv, "b:c:d:f:i:j:k:np:s:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                batch_file = optarg;
+                break;
+            case 'c':
+                cache_file = optarg;
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'f':
+                file = optarg;
+                break;
+            case 'i':
+                keyid = optarg;
+                break;
+            case 'j':
+                threads = atol(optarg);
+                break;
+            case 'k':
+                keyring_file = optarg;
+                break;
+            case 'n':
+                init_opts |= OPENSSL_INIT_NO_LOAD_CONFIG;
+                break;
+            case 'p':
+                pubkey_file = optarg;
+                break;
+            case 's':
+                signature_file = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
     }
 
-    EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    // batch lines name their own keys
+    if ((file && !signature_file) || (keyid && (!keyring_file || pubkey_file || batch_file)) || threads < 1) {
+        usage(argv[0]);
+        return 2;
+    }
 
-    ECDSA_SIG *ecdsa_sig = ECDSA_SIG_new();
-    // convert ecdsa signature R/S values into big number
-    BIGNUM *ecdsa_signature_bn_r = NULL;
-    BIGNUM *ecdsa_signature_bn_s = NULL;
+    /*
+     * Only SHA256 and P-256 are used, both directly and not by name. Skip
+     * registering every cipher and digest, OpenSSL initializes everything
+     * else on first use. openssl.cnf may select providers or a FIPS policy,
+     * it is only skipped on request (-n).
+     */
+    if (!OPENSSL_init_crypto(init_opts, NULL) || hash_sha256() == NULL) {
+        fprintf(stderr, "OpenSSL initialization failed\n");
+        return 1;
+    }
 
-    // if big number var is NULL, it will be allocated internally
-    BN_hex2bn(&ecdsa_signature_bn_r, ecdsa_signature_r);
-    BN_hex2bn(&ecdsa_signature_bn_s, ecdsa_signature_s);
+    outbio = BIO_new_fp(stdout, BIO_NOCLOSE);
+
+    if (cache_file && (batch_file || file || dir)) {
+        if ((cache = vcache_open(cache_file, VCACHE_DEFAULT_SLOTS)) == NULL) {
+            BIO_free_all(outbio);
+            return 1;
+        }
+    }
 
-    value = BN_bn2hex(ecdsa_signature_bn_r);
-    BIO_printf(outbio, "ECDSA Signature R: %s\n", value);
-    OPENSSL_free(value);
+    if (keyring_file && (batch_file || file || dir)) {
+        // records are used in place, parsed keys are cached by the verifiers
+        if ((ring = keyring_open(keyring_file)) == NULL) {
+            vcache_close(cache);
+            BIO_free_all(outbio);
+            return 1;
+        }
+    }
 
-    value = BN_bn2hex(ecdsa_signature_bn_s);
-    BIO_printf(outbio, "ECDSA Signature S: %s\n\n", value);
-    OPENSSL_free(value);
+    if (batch_file) {
+        ret = verify_batch_file(outbio, cache, ring, batch_file);
+        if (cache) {
+            report_cache(outbio, cache);
+            vcache_close(cache);
+        }
+        keyring_close(ring);
+        BIO_free_all(outbio);
+        return ret == 0 ? 0 : 1;
+    }
 
-    // set ECDSA signature R and S part
-    if (!ECDSA_SIG_set0(ecdsa_sig, ecdsa_signature_bn_r, ecdsa_signature_bn_s)) {
-        BIO_printf(outbio, "ECDSA_SIG_set0() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+    if (file || dir) {
+        if (load_pubkey(outbio, ring, pubkey_file, keyid, pubkey)) {
+            ret = -1;
+        } else if (dir) {
+            ret = verify_tree(outbio, cache, pubkey, dir, threads) == 0 ? 1 : -1;
+        } else {
+            ret = verify_file(outbio, cache, pubkey, file, signature_file);
+        }
+        if (cache) {
+            report_cache(outbio, cache);
+            vcache_close(cache);
+        }
+        keyring_close(ring);
+        BIO_free_all(outbio);
+        return ret == 1 ? 0 : 1;
     }
 
-    // EC signatures are always in plain signature format for EC curves but EVP_PKEY_verify whants ASN.1
-    int ecdsa_sig_asn1_len;
-    unsigned char *ecdsa_sig_asn1 = NULL;
+    // calculate SHA256 digest from string_to_sign
+    digestlen = calc_hash(hash_sha256(), string_to_sign, strlen(string_to_sign), digest);
+    BIO_printf(outbio, "SHA256 Digest :    ");
+    print_buffer(digest, digestlen);
 
-    // ASN.1 encode the signature
-    ecdsa_sig_asn1_len = i2d_ECDSA_SIG(ecdsa_sig, &ecdsa_sig_asn1);
+    // the built-in sample is verified like every other signature
+    uint8_t signature[SIGVERIFY_SIGNATURE_SIZE];
+    struct sigverify *verifier;
+    EVP_PKEY *pkey;
 
-    if (!EVP_PKEY_verify_init(key_ctx)) {
-        BIO_printf(outbio, "EVP_PKEY_verify_init() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
-    }
-    if (!EVP_PKEY_CTX_set_signature_md(key_ctx, EVP_sha256())) {
-        BIO_printf(outbio, "EVP_PKEY_CTX_set_signature_md() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+    load_pubkey(outbio, NULL, NULL, NULL, pubkey);
+    hex_decode(signature, ecdsa_signature_r, 64);
+    hex_decode(signature + 32, ecdsa_signature_s, 64);
+
+    BIO_printf(outbio, "ECDSA Pubkey X:    %s\n", ecdsa_pubkey_x);
+    BIO_printf(outbio, "ECDSA Pubkey Y:    %s\n", ecdsa_pubkey_y);
+
+    // print public key as PEM
+    if ((pkey = sigverify_pubkey_to_pkey(pubkey)) == NULL || !PEM_write_bio_PUBKEY(outbio, pkey)) {
+        BIO_printf(outbio, "Error writing public key data in PEM format\n");
     }
+    EVP_PKEY_free(pkey);
 
-    // verify the signatore
-    ret = EVP_PKEY_verify(key_ctx,  ecdsa_sig_asn1, ecdsa_sig_asn1_len, digest, digestlen);
+    BIO_printf(outbio, "ECDSA Signature R: %s\n", ecdsa_signature_r);
+    BIO_printf(outbio, "ECDSA Signature S: %s\n\n", ecdsa_signature_s);
+
+    // verify the signature
+    if ((verifier = sigverify_new(1)) == NULL) {
+        BIO_printf(outbio, "sigverify_new() failed\n");
+        BIO_free_all(outbio);
+        return 1;
+    }
+    ret = sigverify_verify(verifier, pubkey, digest, digestlen, signature);
     if (ret == 1) {
         BIO_printf(outbio, "EVP_PKEY_verify(): returned SUCCESS\n\n");
     } else if (ret == 0) {
         BIO_printf(outbio, "EVP_PKEY_verify(): returned FAILURE\n\n");
     } else {
-        BIO_printf(outbio, "EVP_PKEY_verify() failed! Error: %s\n\n", ERR_error_string(ERR_get_error(), NULL));
-        //ERR_print_errors(outbio);
+        BIO_printf(outbio, "EVP_PKEY_verify() failed! Error: %s\n\n", crypto_error());
     }
 
-    EVP_PKEY_CTX_free(key_ctx);
-    EVP_PKEY_free(pkey);
-    OPENSSL_free(ecdsa_sig_asn1);
-    BN_free(ecdsa_pubkey_bn_x);
-    BN_free(ecdsa_pubkey_bn_y);
-    BN_free(ecdsa_signature_bn_r);
-    BN_free(ecdsa_signature_bn_s);
-    OPENSSL_free(digest);
+    sigverify_free(verifier);
     BIO_free_all(outbio);
 
     return 0;
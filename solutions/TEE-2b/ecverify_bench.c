@@ -0,0 +1,517 @@
+/**
+ * ECDSA verification benchmark
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "keyring.h"
+#include "sigverify.h"
+#include "vcache.h"
+
+// signatures verified per scenario
+#define BENCH_TOTAL_SIGNATURES  1000
+// keys of the batch scenario and every n-th signature corrupted in it
+#define BENCH_BATCH_KEYS        10
+#define BENCH_BATCH_CORRUPT     97
+// the cache scenario verifies every signature of the batch this often
+#define BENCH_CACHE_PASSES      4
+// signatures of the batch whose cached verdict byte gets corrupted
+#define BENCH_BAD_VERDICTS      16
+// keys of the scenario where every signature uses the next key in turn
+#define BENCH_INTERLEAVED_KEYS  100
+// keyring lookups, spread over the first BENCH_KEYRING_HOT keys
+#define BENCH_KEYRING_LOOKUPS   100000
+#define BENCH_KEYRING_HOT       128
+
+struct bench_sample {
+    uint8_t pubkey[SIGVERIFY_PUBKEY_SIZE];
+    uint8_t digest[32];
+    uint8_t signature[SIGVERIFY_SIGNATURE_SIZE];
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * Create num_keys key pairs and sign sigs_per_key random digests with each
+ * @param samples
+ * @param num_keys
+ * @param sigs_per_key
+ */
+static void make_samples(struct bench_sample *samples, size_t num_keys, size_t sigs_per_key)
+{
+    uint8_t pub[1 + SIGVERIFY_PUBKEY_SIZE];
+
+    for (size_t k = 0; k < num_keys; k++) {
+        EC_KEY *ec_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+
+        if (!ec_key || !EC_KEY_generate_key(ec_key)) {
+            errx(1, "EC_KEY_generate_key() failed! Error: %s", ERR_error_string(ERR_get_error(), NULL));
+        }
+
+        // uncompressed point 0x04 || X || Y
+        EC_POINT_point2oct(EC_KEY_get0_group(ec_key), EC_KEY_get0_public_key(ec_key),
+                           POINT_CONVERSION_UNCOMPRESSED, pub, sizeof(pub), NULL);
+
+        for (size_t i = 0; i < sigs_per_key; i++) {
+            struct bench_sample *sample = &samples[k * sigs_per_key + i];
+            const BIGNUM *r, *s;
+            ECDSA_SIG *sig;
+
+            memcpy(sample->pubkey, &pub[1], sizeof(sample->pubkey));
+            RAND_bytes(sample->digest, sizeof(sample->digest));
+
+            if ((sig = ECDSA_do_sign(sample->digest, sizeof(sample->digest), ec_key)) == NULL) {
+                errx(1, "ECDSA_do_sign() failed! Error: %s", ERR_error_string(ERR_get_error(), NULL));
+            }
+
+            ECDSA_SIG_get0(sig, &r, &s);
+            BN_bn2binpad(r, sample->signature, 32);
+            BN_bn2binpad(s, sample->signature + 32, 32);
+            ECDSA_SIG_free(sig);
+        }
+
+        EC_KEY_free(ec_key);
+    }
+}
+
+/**
+ * Reorder samples made by make_samples() so that consecutive signatures
+ * use consecutive keys
+ * @param samples
+ * @param num_keys
+ * @param sigs_per_key
+ */
+static void interleave_samples(struct bench_sample *samples, size_t num_keys, size_t sigs_per_key)
+{
+    struct bench_sample *sorted = malloc(num_keys * sigs_per_key * sizeof(*sorted));
+
+    if (!sorted) {
+        err(1, "malloc");
+    }
+
+    memcpy(sorted, samples, num_keys * sigs_per_key * sizeof(*sorted));
+    for (size_t k = 0; k < num_keys; k++) {
+        for (size_t i = 0; i < sigs_per_key; i++) {
+            samples[i * num_keys + k] = sorted[k * sigs_per_key + i];
+        }
+    }
+
+    free(sorted);
+}
+
+/**
+ * Flip a bit in the digest of every n-th sample
+ * @param samples
+ * @param count
+ * @param nth
+ */
+static void corrupt_samples(struct bench_sample *samples, size_t count, size_t nth)
+{
+    for (size_t i = nth - 1; i < count; i += nth) {
+        samples[i].digest[0] ^= 0x01;
+    }
+}
+
+/**
+ * The ecverify way, EVP_PKEY_verify with the parsed keys and their
+ * EVP_PKEY_CTX cached by sigverify
+ * @param samples
+ * @param count
+ * @param cache if not NULL EVP_PKEY_verify is only called for signatures without cached verdict
+ * @return number of failed verifications
+ */
+static size_t run_evp(const struct bench_sample *samples, size_t count, struct vcache *cache)
+{
+    struct sigverify *verifier = sigverify_new(SIGVERIFY_DEFAULT_KEYS);
+    size_t failed = 0;
+
+    if (!verifier) {
+        errx(1, "sigverify_new() failed");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const struct bench_sample *sample = &samples[i];
+        uint8_t key[VCACHE_KEY_SIZE];
+        int ret;
+
+        if (cache) {
+            vcache_key(sample->pubkey, sample->digest, sizeof(sample->digest), sample->signature, key);
+            if ((ret = vcache_lookup(cache, key)) >= 0) {
+                failed += ret != 1;
+                continue;
+            }
+        }
+
+        ret = sigverify_verify(verifier, sample->pubkey, sample->digest, sizeof(sample->digest),
+                               sample->signature);
+        if (ret != 1) {
+            failed++;
+        }
+        if (cache) {
+            vcache_store(cache, key, ret);
+        }
+    }
+
+    sigverify_free(verifier);
+
+    return failed;
+}
+
+/**
+ * Overwrite the cached verdict of the first count samples in a cache file
+ * with bytes other than 0 and 1. A slot holds the key, a state byte and
+ * the verdict byte.
+ * @param path
+ * @param samples
+ * @param count
+ */
+static void plant_bad_verdicts(const char *path, const struct bench_sample *samples, size_t count)
+{
+    uint8_t key[VCACHE_KEY_SIZE];
+    struct stat st;
+    uint8_t *map;
+    int fd;
+
+    if ((fd = open(path, O_RDWR)) < 0 || fstat(fd, &st)) {
+        err(1, "%s", path);
+    }
+    if ((map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        err(1, "mmap %s", path);
+    }
+    close(fd);
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *p = map;
+
+        vcache_key(samples[i].pubkey, samples[i].digest, sizeof(samples[i].digest), samples[i].signature, key);
+        while ((p = memchr(p, key[0], map + st.st_size - p)) != NULL &&
+               (p + VCACHE_KEY_SIZE + 2 > map + st.st_size || memcmp(p, key, VCACHE_KEY_SIZE))) {
+            p++;
+        }
+        if (!p || p + VCACHE_KEY_SIZE + 2 > map + st.st_size) {
+            errx(1, "%s: signature %zu not cached", path, i);
+        }
+
+        // 2 to 255, past the verdicts a reader could index with it
+        p[VCACHE_KEY_SIZE + 1] = 2 + i * 253 / (count > 1 ? count - 1 : 1);
+    }
+
+    munmap(map, st.st_size);
+}
+
+/**
+ * Reference: every signature parses its key and sets up an EVP_PKEY_CTX,
+ * like ecverify did before keys were cached
+ * @param samples
+ * @param count
+ * @return number of failed verifications
+ */
+static size_t run_uncached(const struct bench_sample *samples, size_t count)
+{
+    size_t failed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        struct sigverify *verifier = sigverify_new(1);
+
+        if (!verifier) {
+            errx(1, "sigverify_new() failed");
+        }
+        if (sigverify_verify(verifier, samples[i].pubkey, samples[i].digest,
+                             sizeof(samples[i].digest), samples[i].signature) != 1) {
+            failed++;
+        }
+        sigverify_free(verifier);
+    }
+
+    return failed;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
+{
+    static const size_t sigs_per_key[] = { 1, 10, 1000 };
+    struct bench_sample *samples;
+
+    if ((samples = calloc(BENCH_TOTAL_SIGNATURES, sizeof(*samples))) == NULL) {
+        err(1, "calloc");
+    }
+
+    printf("%-10s %-6s %-24s %-24s %s\n", "sigs/key", "keys", "key per sig [us/sig]",
+           "cached key [us/sig]", "speedup");
+
+    for (size_t n = 0; n < sizeof(sigs_per_key) / sizeof(sigs_per_key[0]); n++) {
+        size_t num_keys = BENCH_TOTAL_SIGNATURES / sigs_per_key[n];
+        size_t count = num_keys * sigs_per_key[n];
+        size_t failed_uncached, failed_evp;
+        double t0, t_uncached, t_evp;
+
+        make_samples(samples, num_keys, sigs_per_key[n]);
+
+        t0 = now_us();
+        failed_uncached = run_uncached(samples, count);
+        t_uncached = (now_us() - t0) / count;
+
+        t0 = now_us();
+        failed_evp = run_evp(samples, count, NULL);
+        t_evp = (now_us() - t0) / count;
+
+        if (failed_uncached || failed_evp) {
+            errx(1, "verification failed (key per sig %zu, cached key %zu)", failed_uncached, failed_evp);
+        }
+
+        printf("%-10zu %-6zu %-24.1f %-24.1f %.2fx\n", sigs_per_key[n], num_keys, t_uncached, t_evp, t_uncached / t_evp);
+    }
+
+    // keys taking turns, more of them than a verifier used to keep
+    {
+        size_t num_keys = BENCH_INTERLEAVED_KEYS, sigs = BENCH_TOTAL_SIGNATURES / BENCH_INTERLEAVED_KEYS;
+        size_t failed_uncached, failed_evp;
+        double t0, t_uncached, t_evp;
+
+        make_samples(samples, num_keys, sigs);
+        interleave_samples(samples, num_keys, sigs);
+
+        t0 = now_us();
+        failed_uncached = run_uncached(samples, BENCH_TOTAL_SIGNATURES);
+        t_uncached = (now_us() - t0) / BENCH_TOTAL_SIGNATURES;
+
+        t0 = now_us();
+        failed_evp = run_evp(samples, BENCH_TOTAL_SIGNATURES, NULL);
+        t_evp = (now_us() - t0) / BENCH_TOTAL_SIGNATURES;
+
+        if (failed_uncached || failed_evp) {
+            errx(1, "verification failed (key per sig %zu, cached key %zu)", failed_uncached, failed_evp);
+        }
+
+        printf("%-10s %-6zu %-24.1f %-24.1f %.2fx\n", "turns", num_keys, t_uncached, t_evp, t_uncached / t_evp);
+    }
+
+    // key lookup by ID, with and without parsing the point
+    {
+        struct keyring_record *records = calloc(BENCH_TOTAL_SIGNATURES, sizeof(*records));
+        char path[] = "/tmp/ecverify_bench_keyring.XXXXXX";
+        struct keyring *ring;
+        size_t found = 0;
+        double t0, t_find, t_parse;
+        int fd;
+
+        if (!records) {
+            err(1, "calloc");
+        }
+
+        make_samples(samples, BENCH_TOTAL_SIGNATURES, 1);
+        for (size_t i = 0; i < BENCH_TOTAL_SIGNATURES; i++) {
+            keyring_fingerprint(samples[i].pubkey, records[i].id);
+            records[i].point[0] = 0x04;
+            memcpy(records[i].point + 1, samples[i].pubkey, SIGVERIFY_PUBKEY_SIZE);
+        }
+
+        if ((fd = mkstemp(path)) < 0) {
+            err(1, "mkstemp");
+        }
+        close(fd);
+
+        // keyring_write() sorts records, the fingerprints are looked up again below
+        if (keyring_write(path, records, BENCH_TOTAL_SIGNATURES) ||
+            (ring = keyring_open(path)) == NULL) {
+            errx(1, "keyring %s failed", path);
+        }
+        for (size_t i = 0; i < BENCH_TOTAL_SIGNATURES; i++) {
+            keyring_fingerprint(samples[i].pubkey, records[i].id);
+        }
+
+        t0 = now_us();
+        for (size_t i = 0; i < BENCH_KEYRING_LOOKUPS; i++) {
+            found += keyring_find(ring, records[i % BENCH_KEYRING_HOT].id) != NULL;
+        }
+        t_find = (now_us() - t0) / BENCH_KEYRING_LOOKUPS;
+
+        t0 = now_us();
+        for (size_t i = 0; i < BENCH_KEYRING_LOOKUPS; i++) {
+            const struct keyring_record *record = keyring_find(ring, records[i % BENCH_KEYRING_HOT].id);
+            EVP_PKEY *pkey = sigverify_pubkey_to_pkey(record->point + 1);
+
+            found += pkey != NULL;
+            EVP_PKEY_free(pkey);
+        }
+        t_parse = (now_us() - t0) / BENCH_KEYRING_LOOKUPS;
+
+        if (found != 2 * BENCH_KEYRING_LOOKUPS) {
+            errx(1, "keyring lookups failed");
+        }
+
+        printf("\nkeyring of %d keys, %d lookups over %d keys\n",
+               BENCH_TOTAL_SIGNATURES, BENCH_KEYRING_LOOKUPS, BENCH_KEYRING_HOT);
+        printf("%-24s %s\n", "", "[us/lookup]");
+        printf("%-24s %.3f\n", "keyring_find", t_find);
+        printf("%-24s %.3f\n", "find + parse EVP_PKEY", t_parse);
+
+        keyring_close(ring);
+        unlink(path);
+        free(records);
+    }
+
+    // batch of mixed keys with a few bad signatures
+    {
+        size_t sigs = BENCH_TOTAL_SIGNATURES / BENCH_BATCH_KEYS;
+        size_t failed_evp;
+        double t0, t_evp;
+
+        make_samples(samples, BENCH_BATCH_KEYS, sigs);
+        corrupt_samples(samples, BENCH_TOTAL_SIGNATURES, BENCH_BATCH_CORRUPT);
+
+        t0 = now_us();
+        failed_evp = run_evp(samples, BENCH_TOTAL_SIGNATURES, NULL);
+        t_evp = (now_us() - t0) / BENCH_TOTAL_SIGNATURES;
+
+        if (failed_evp != BENCH_TOTAL_SIGNATURES / BENCH_BATCH_CORRUPT) {
+            errx(1, "batch: %zu failed, expected %d", failed_evp, BENCH_TOTAL_SIGNATURES / BENCH_BATCH_CORRUPT);
+        }
+
+        printf("\nbatch of %d signatures, %d keys, every %dth signature bad\n",
+               BENCH_TOTAL_SIGNATURES, BENCH_BATCH_KEYS, BENCH_BATCH_CORRUPT);
+        printf("%-24s %-10s %s\n", "", "[us/sig]", "failed");
+        printf("%-24s %-10.1f %zu\n", "EVP_PKEY_verify", t_evp, failed_evp);
+    }
+
+    // the same batch verified BENCH_CACHE_PASSES times, with and without verdict cache
+    {
+        size_t failed_evp = 0, failed_cache = 0;
+        char path[] = "/tmp/ecverify_bench_vcache.XXXXXX";
+        struct vcache_stats stats;
+        struct vcache *cache;
+        double t0, t_evp, t_cache;
+        int fd;
+
+        t0 = now_us();
+        for (int pass = 0; pass < BENCH_CACHE_PASSES; pass++) {
+            failed_evp += run_evp(samples, BENCH_TOTAL_SIGNATURES, NULL);
+        }
+        t_evp = now_us() - t0;
+
+        if ((cache = vcache_open(NULL, VCACHE_DEFAULT_SLOTS)) == NULL) {
+            errx(1, "vcache_open() failed");
+        }
+
+        t0 = now_us();
+        for (int pass = 0; pass < BENCH_CACHE_PASSES; pass++) {
+            failed_cache += run_evp(samples, BENCH_TOTAL_SIGNATURES, cache);
+        }
+        t_cache = now_us() - t0;
+
+        vcache_get_stats(cache, &stats);
+        vcache_close(cache);
+
+        if (failed_cache != failed_evp) {
+            errx(1, "cached verdicts differ (EVP_PKEY_verify %zu failed, cached %zu)", failed_evp, failed_cache);
+        }
+
+        printf("\n%d passes over the batch\n", BENCH_CACHE_PASSES);
+        printf("%-24s %-10s %s\n", "", "[ms]", "hit rate");
+        printf("%-24s %-10.1f -\n", "EVP_PKEY_verify", t_evp / 1e3);
+        printf("%-24s %-10.1f %.1f%% (%.1f ms saved)\n", "vcache + EVP_PKEY_verify", t_cache / 1e3,
+               100.0 * stats.hits / stats.lookups, (t_evp - t_cache) / 1e3);
+
+        // a reopened cache file has to answer every signature of the batch
+        if ((fd = mkstemp(path)) < 0) {
+            err(1, "mkstemp");
+        }
+        close(fd);
+
+        if ((cache = vcache_open(path, VCACHE_DEFAULT_SLOTS)) == NULL) {
+            errx(1, "vcache_open(%s) failed", path);
+        }
+        run_evp(samples, BENCH_TOTAL_SIGNATURES, cache);
+        vcache_close(cache);
+
+        if ((cache = vcache_open(path, VCACHE_DEFAULT_SLOTS)) == NULL) {
+            errx(1, "vcache_open(%s) failed", path);
+        }
+        t0 = now_us();
+        failed_cache = run_evp(samples, BENCH_TOTAL_SIGNATURES, cache);
+        t_cache = now_us() - t0;
+        vcache_get_stats(cache, &stats);
+        vcache_close(cache);
+
+        if (stats.hits != BENCH_TOTAL_SIGNATURES || failed_cache * BENCH_CACHE_PASSES != failed_evp) {
+            errx(1, "reopened cache: %"PRIu64" hits, %zu failed", stats.hits, failed_cache);
+        }
+
+        // corrupt verdict bytes are misses, the signatures get verified again
+        plant_bad_verdicts(path, samples, BENCH_BAD_VERDICTS);
+        if ((cache = vcache_open(path, VCACHE_DEFAULT_SLOTS)) == NULL) {
+            errx(1, "vcache_open(%s) failed", path);
+        }
+        failed_cache = run_evp(samples, BENCH_TOTAL_SIGNATURES, cache);
+        vcache_get_stats(cache, &stats);
+        vcache_close(cache);
+
+        if (stats.hits != BENCH_TOTAL_SIGNATURES - BENCH_BAD_VERDICTS ||
+            failed_cache * BENCH_CACHE_PASSES != failed_evp) {
+            errx(1, "corrupt verdicts: %"PRIu64" hits, %zu failed", stats.hits, failed_cache);
+        }
+
+        // the misses stored fresh verdicts over the corrupt ones
+        if ((cache = vcache_open(path, VCACHE_DEFAULT_SLOTS)) == NULL) {
+            errx(1, "vcache_open(%s) failed", path);
+        }
+        failed_cache = run_evp(samples, BENCH_TOTAL_SIGNATURES, cache);
+        vcache_get_stats(cache, &stats);
+        vcache_close(cache);
+        unlink(path);
+
+        if (stats.hits != BENCH_TOTAL_SIGNATURES || failed_cache * BENCH_CACHE_PASSES != failed_evp) {
+            errx(1, "repaired cache: %"PRIu64" hits, %zu failed", stats.hits, failed_cache);
+        }
+        printf("%-24s %-10.1f 100.0%% (reopened file)\n", "vcache file", t_cache / 1e3);
+    }
+
+    free(samples);
+
+    return 0;
+}
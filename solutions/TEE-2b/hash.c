@@ -0,0 +1,361 @@
+/**
+ * Message and file hashing
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+
+/*
+ * The digest context is reused for every hash of a thread, EVP_DigestInit_ex
+ * resets it without freeing the underlying buffers. The key destructor
+ * frees it when a worker thread exits.
+ */
+static pthread_once_t ctx_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ctx_key;
+static int ctx_key_ok;
+
+static void free_ctx(void *ctx)
+{
+    EVP_MD_CTX_free(ctx);
+}
+
+static void create_ctx_key(void)
+{
+    ctx_key_ok = pthread_key_create(&ctx_key, free_ctx) == 0;
+}
+
+static pthread_once_t sha256_once = PTHREAD_ONCE_INIT;
+static const EVP_MD *sha256_md;
+
+static void fetch_sha256(void)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    sha256_md = EVP_MD_fetch(NULL, "SHA2-256", NULL);
+#else
+    sha256_md = EVP_sha256();
+#endif
+}
+
+const EVP_MD *hash_sha256(void)
+{
+    pthread_once(&sha256_once, fetch_sha256);
+    return sha256_md;
+}
+
+static EVP_MD_CTX *get_ctx(const EVP_MD* type)
+{
+    EVP_MD_CTX *hash_ctx;
+
+    pthread_once(&ctx_once, create_ctx_key);
+    if (!ctx_key_ok) {
+        return NULL;
+    }
+
+    if ((hash_ctx = pthread_getspecific(ctx_key)) == NULL) {
+        if ((hash_ctx = EVP_MD_CTX_new()) == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(ctx_key, hash_ctx)) {
+            EVP_MD_CTX_free(hash_ctx);
+            return NULL;
+        }
+    }
+
+    if (!EVP_DigestInit_ex(hash_ctx, type, NULL)) {
+        printf("EVP_DigestInit_ex() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return NULL;
+    }
+
+    return hash_ctx;
+}
+
+static int final_hash(EVP_MD_CTX *ctx, unsigned char *digest)
+{
+    unsigned int len = 0;
+
+    if (!EVP_DigestFinal_ex(ctx, digest, &len)) {
+        printf("EVP_DigestFinal_ex() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return 0;
+    }
+
+    return len;
+}
+
+int calc_hash(const EVP_MD* type, const void* src, const size_t size, unsigned char *digest)
+{
+    EVP_MD_CTX *ctx;
+
+    if ((ctx = get_ctx(type)) == NULL) {
+        return 0;
+    }
+
+    if (!EVP_DigestUpdate(ctx, src, size)) {
+        printf("EVP_DigestUpdate() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+        return 0;
+    }
+
+    return final_hash(ctx, digest);
+}
+
+/**
+ * Hash a memory mapped regular file chunk by chunk
+ * @param ctx
+ * @param fd
+ * @param size
+ * @return 1 on success, 0 if the file cannot be mapped, -1 on error
+ */
+static int hash_mmap(EVP_MD_CTX *ctx, int fd, size_t size)
+{
+    unsigned char *map;
+    int ret = 1;
+
+    if ((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        return 0;
+    }
+
+    // kernel read ahead aggressively and drop pages behind us
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    // the mapping is page aligned and HASH_CHUNK_SIZE is a multiple of the page size
+    for (size_t offset = 0; offset < size; offset += HASH_CHUNK_SIZE) {
+        size_t len = size - offset < HASH_CHUNK_SIZE ? size - offset : HASH_CHUNK_SIZE;
+
+        if (!EVP_DigestUpdate(ctx, map + offset, len)) {
+            printf("EVP_DigestUpdate() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+            ret = -1;
+            break;
+        }
+    }
+
+    munmap(map, size);
+
+    return ret;
+}
+
+/*
+ * Double buffered read: a reader thread fills one buffer while the caller
+ * hashes the other one.
+ */
+struct read_buffer {
+    unsigned char *data;
+    ssize_t len;            // bytes in data, 0 on EOF, -1 on read error
+    int error;              // errno of the failed read
+    int full;
+};
+
+struct reader {
+    int fd;
+    struct read_buffer buf[2];
+    int stop;               // consumer gave up, no more reads
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void *reader_thread(void *arg)
+{
+    struct reader *reader = arg;
+
+    for (int idx = 0;; idx ^= 1) {
+        struct read_buffer *buf = &reader->buf[idx];
+        ssize_t len = 0, n;
+        int error = 0;
+
+        pthread_mutex_lock(&reader->lock);
+        while (buf->full && !reader->stop) {
+            pthread_cond_wait(&reader->cond, &reader->lock);
+        }
+        if (reader->stop) {
+            pthread_mutex_unlock(&reader->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&reader->lock);
+
+        // fill the whole chunk, pipes return short reads
+        while (len < HASH_CHUNK_SIZE) {
+            if ((n = read(reader->fd, buf->data + len, HASH_CHUNK_SIZE - len)) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                len = -1;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+            len += n;
+        }
+
+        pthread_mutex_lock(&reader->lock);
+        buf->len = len;
+        buf->error = error;
+        buf->full = 1;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->lock);
+
+        // a short chunk means EOF (or error), the consumer will see it
+        if (len < HASH_CHUNK_SIZE) {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Hash everything readable from fd with two alternating read buffers
+ * @param ctx
+ * @param fd
+ * @return 1 on success, -1 on error
+ */
+static int hash_read(EVP_MD_CTX *ctx, int fd)
+{
+    struct reader reader;
+    pthread_t thread;
+    int ret = -1;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.fd = fd;
+
+    for (int i = 0; i < 2; i++) {
+        if (posix_memalign((void **)&reader.buf[i].data, HASH_CHUNK_SIZE, HASH_CHUNK_SIZE)) {
+            goto cleanup;
+        }
+    }
+
+    pthread_mutex_init(&reader.lock, NULL);
+    pthread_cond_init(&reader.cond, NULL);
+
+    if (pthread_create(&thread, NULL, reader_thread, &reader)) {
+        goto cleanup_sync;
+    }
+
+    for (int idx = 0;; idx ^= 1) {
+        struct read_buffer *buf = &reader.buf[idx];
+        ssize_t len;
+
+        pthread_mutex_lock(&reader.lock);
+        while (!buf->full) {
+            pthread_cond_wait(&reader.cond, &reader.lock);
+        }
+        len = buf->len;
+        pthread_mutex_unlock(&reader.lock);
+
+        if (len < 0) {
+            printf("%s while reading\n", strerror(buf->error));
+            break;
+        }
+
+        if (len && !EVP_DigestUpdate(ctx, buf->data, len)) {
+            printf("EVP_DigestUpdate() failed! Error: %s\n", ERR_error_string(ERR_get_error(), NULL));
+            break;
+        }
+
+        if (len < HASH_CHUNK_SIZE) {
+            ret = 1;
+            break;
+        }
+
+        pthread_mutex_lock(&reader.lock);
+        buf->full = 0;
+        pthread_cond_broadcast(&reader.cond);
+        pthread_mutex_unlock(&reader.lock);
+    }
+
+    // the reader stops by itself after a short chunk, on errors tell it to
+    pthread_mutex_lock(&reader.lock);
+    reader.stop = 1;
+    pthread_cond_broadcast(&reader.cond);
+    pthread_mutex_unlock(&reader.lock);
+    pthread_join(thread, NULL);
+
+cleanup_sync:
+    pthread_cond_destroy(&reader.cond);
+    pthread_mutex_destroy(&reader.lock);
+
+cleanup:
+    free(reader.buf[0].data);
+    free(reader.buf[1].data);
+
+    return ret;
+}
+
+int calc_hash_fd(const EVP_MD* type, int fd, unsigned char *digest)
+{
+    EVP_MD_CTX *ctx;
+    struct stat st;
+    int ret = 0;
+
+    if ((ctx = get_ctx(type)) == NULL) {
+        return 0;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // an empty file cannot be mapped and has nothing to hash
+        ret = st.st_size ? hash_mmap(ctx, fd, st.st_size) : 1;
+    }
+
+    // not mappable (pipe, socket, mmap failure)
+    if (ret == 0) {
+        ret = hash_read(ctx, fd);
+    }
+
+    if (ret < 0) {
+        return 0;
+    }
+
+    return final_hash(ctx, digest);
+}
+
+int calc_hash_file(const EVP_MD* type, const char *path, unsigned char *digest)
+{
+    int fd, len;
+
+    if (!strcmp(path, "-")) {
+        return calc_hash_fd(type, STDIN_FILENO, digest);
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(stderr, "%s while opening %s\n", strerror(errno), path);
+        return 0;
+    }
+
+    len = calc_hash_fd(type, fd, digest);
+    close(fd);
+
+    return len;
+}
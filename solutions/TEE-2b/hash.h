@@ -0,0 +1,77 @@
+/**
+ * Message and file hashing
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <openssl/evp.h>
+#include <stddef.h>
+
+// size of one EVP_DigestUpdate() chunk for files and pipes
+#define HASH_CHUNK_SIZE     (1024 * 1024)
+
+/**
+ * SHA256 digest object, fetched once per process. With OpenSSL 3 every
+ * EVP_sha256() use triggers an implicit provider lookup, the fetched
+ * object skips it.
+ * @return digest or NULL on error
+ */
+const EVP_MD *hash_sha256(void);
+
+/**
+ * Calculate hash of type EVP_MD* into a caller provided buffer
+ * @param type
+ * @param src
+ * @param size
+ * @param digest [out] at least EVP_MD_size(type) bytes (EVP_MAX_MD_SIZE is always enough)
+ * @return digest length, 0 on error
+ */
+int calc_hash(const EVP_MD* type, const void* src, const size_t size, unsigned char *digest);
+
+/**
+ * Calculate hash of type EVP_MD* over everything readable from fd. Regular
+ * files are memory mapped, pipes and sockets are read double buffered so
+ * reading the next chunk overlaps with hashing the current one.
+ * @param type
+ * @param fd
+ * @param digest [out] at least EVP_MD_size(type) bytes
+ * @return digest length, 0 on error
+ */
+int calc_hash_fd(const EVP_MD* type, int fd, unsigned char *digest);
+
+/**
+ * Calculate hash of type EVP_MD* over a file, "-" is stdin
+ * @param type
+ * @param path
+ * @param digest [out] at least EVP_MD_size(type) bytes
+ * @return digest length, 0 on error
+ */
+int calc_hash_file(const EVP_MD* type, const char *path, unsigned char *digest);
+
+#endif /* __HASH_H__ */
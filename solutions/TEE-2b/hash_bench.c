@@ -0,0 +1,159 @@
+/**
+ * SHA256 hashing benchmark
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+#include "sha256mb.h"
+
+// messages hashed per run and runs per message size
+#define BENCH_MESSAGES  4096
+#define BENCH_RUNS      20
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * One EVP_MD_CTX per message, the way calc_hash() used to work
+ * @param msgs
+ * @param lens
+ * @param count
+ * @param digests
+ */
+static void hash_evp_ctx_per_call(const void *const *msgs, const size_t *lens, size_t count,
+                                  uint8_t (*digests)[SHA256MB_DIGEST_SIZE])
+{
+    for (size_t i = 0; i < count; i++) {
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+        unsigned int len;
+
+        EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+        EVP_DigestUpdate(ctx, msgs[i], lens[i]);
+        EVP_DigestFinal_ex(ctx, digests[i], &len);
+        EVP_MD_CTX_free(ctx);
+    }
+}
+
+/**
+ * calc_hash() with its reused context
+ * @param msgs
+ * @param lens
+ * @param count
+ * @param digests
+ */
+static void hash_calc_hash(const void *const *msgs, const size_t *lens, size_t count,
+                           uint8_t (*digests)[SHA256MB_DIGEST_SIZE])
+{
+    for (size_t i = 0; i < count; i++) {
+        calc_hash(EVP_sha256(), msgs[i], lens[i], digests[i]);
+    }
+}
+
+struct bench_variant {
+    const char *name;
+    void (*hash)(const void *const *msgs, const size_t *lens, size_t count,
+                 uint8_t (*digests)[SHA256MB_DIGEST_SIZE]);
+};
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
+{
+    static const size_t sizes[] = { 16, 55, 64, 128, 256, 1024 };
+    const struct bench_variant variants[] = {
+        { "EVP ctx per message", hash_evp_ctx_per_call },
+        { "calc_hash", hash_calc_hash },
+        { "sha256mb scalar", sha256mb_scalar },
+        { "sha256mb", sha256mb },
+    };
+    const size_t num_variants = sizeof(variants) / sizeof(variants[0]);
+    uint8_t (*reference)[SHA256MB_DIGEST_SIZE] = calloc(BENCH_MESSAGES, SHA256MB_DIGEST_SIZE);
+    uint8_t (*digests)[SHA256MB_DIGEST_SIZE] = calloc(BENCH_MESSAGES, SHA256MB_DIGEST_SIZE);
+    const void **msgs = calloc(BENCH_MESSAGES, sizeof(*msgs));
+    size_t *lens = calloc(BENCH_MESSAGES, sizeof(*lens));
+    uint8_t *data = malloc(BENCH_MESSAGES * sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+
+    if (!reference || !digests || !msgs || !lens || !data) {
+        err(1, "calloc");
+    }
+
+    printf("sha256mb kernel: %s, %d lanes\n\n", sha256mb_kernel(), sha256mb_lanes());
+    printf("%-8s", "bytes");
+    for (size_t v = 0; v < num_variants; v++) {
+        printf(" %-22s", variants[v].name);
+    }
+    printf("   [MB/s]\n");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        RAND_bytes(data, BENCH_MESSAGES * sizes[s]);
+        for (size_t i = 0; i < BENCH_MESSAGES; i++) {
+            msgs[i] = data + i * sizes[s];
+            lens[i] = sizes[s];
+        }
+
+        hash_evp_ctx_per_call(msgs, lens, BENCH_MESSAGES, reference);
+
+        printf("%-8zu", sizes[s]);
+        for (size_t v = 0; v < num_variants; v++) {
+            double t0, t;
+
+            memset(digests, 0, BENCH_MESSAGES * SHA256MB_DIGEST_SIZE);
+
+            t0 = now_us();
+            for (int run = 0; run < BENCH_RUNS; run++) {
+                variants[v].hash(msgs, lens, BENCH_MESSAGES, digests);
+            }
+            t = now_us() - t0;
+
+            if (memcmp(digests, reference, BENCH_MESSAGES * SHA256MB_DIGEST_SIZE)) {
+                errx(1, "%s: digest mismatch for %zu byte messages", variants[v].name, sizes[s]);
+            }
+
+            printf(" %-22.1f", (double)BENCH_MESSAGES * BENCH_RUNS * sizes[s] / t);
+        }
+        printf("\n");
+    }
+
+    free(data);
+    free(lens);
+    free(msgs);
+    free(digests);
+    free(reference);
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * Hex codec throughput benchmark
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hexcodec.h"
+
+// bytes processed per measurement
+#define BENCH_BYTES     (16 * 1024 * 1024)
+
+static FILE *devnull;
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * print_buffer() as it was before the codec, one printf per byte
+ */
+static void print_printf(char *hex, uint8_t *bin, size_t len)
+{
+    (void)hex;
+    for (size_t i = 0; i < len; i++)
+        fprintf(devnull, "%02"PRIX8"", bin[i]);
+    fprintf(devnull, "\n");
+}
+
+static void print_codec(char *hex, uint8_t *bin, size_t len)
+{
+    (void)hex;
+    hex_fprint(devnull, bin, len);
+}
+
+static void encode_scalar(char *hex, uint8_t *bin, size_t len)
+{
+    hex_encode_scalar(hex, bin, len);
+}
+
+static void encode_codec(char *hex, uint8_t *bin, size_t len)
+{
+    hex_encode(hex, bin, len);
+}
+
+/**
+ * hexstr_to_char() as it was before the codec, no validation and one
+ * allocation per call
+ */
+static void decode_hexstr_to_char(char *hex, uint8_t *bin, size_t len)
+{
+    size_t final_len = len;
+    unsigned char* chrs = (unsigned char*)malloc((final_len+1) * sizeof(*chrs));
+    for (size_t i=0, j=0; j<final_len; i+=2, j++)
+        chrs[j] = (hex[i] % 32 + 9) % 25 * 16 + (hex[i+1] % 32 + 9) % 25;
+    chrs[final_len] = '\0';
+    memcpy(bin, chrs, len);
+    free(chrs);
+}
+
+static void decode_scalar(char *hex, uint8_t *bin, size_t len)
+{
+    if (hex_decode_scalar(bin, hex, 2 * len) < 0)
+        errx(1, "hex_decode_scalar failed");
+}
+
+static void decode_codec(char *hex, uint8_t *bin, size_t len)
+{
+    if (hex_decode(bin, hex, 2 * len) < 0)
+        errx(1, "hex_decode failed");
+}
+
+struct bench_variant {
+    const char *name;
+    void (*run)(char *hex, uint8_t *bin, size_t len);
+};
+
+/**
+ * Run every variant over BENCH_BYTES bytes in len sized buffers
+ * @return MB/s of binary data
+ */
+static double bench(const struct bench_variant *variant, char *hex, uint8_t *bin, size_t len)
+{
+    size_t iterations = BENCH_BYTES / len;
+    double start = now_us();
+
+    for (size_t i = 0; i < iterations; i++)
+        variant->run(hex, bin, len);
+
+    return (double)iterations * len / (now_us() - start);
+}
+
+static void bench_table(const char *title, const struct bench_variant *variants, size_t num_variants,
+                        char *hex, uint8_t *bin)
+{
+    static const size_t sizes[] = { 32, 64, 256, 4096, 65536 };
+
+    printf("%s\n%-8s", title, "bytes");
+    for (size_t v = 0; v < num_variants; v++)
+        printf(" %-18s", variants[v].name);
+    printf("   [MB/s]\n");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        printf("%-8zu", sizes[s]);
+        for (size_t v = 0; v < num_variants; v++)
+            printf(" %-18.1f", bench(&variants[v], hex, bin, sizes[s]));
+        printf("\n");
+    }
+    printf("\n");
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
+{
+    const struct bench_variant print_variants[] = {
+        { "printf per byte", print_printf },
+        { "hex_fprint", print_codec },
+    };
+    const struct bench_variant encode_variants[] = {
+        { "hex_encode_scalar", encode_scalar },
+        { "hex_encode", encode_codec },
+    };
+    const struct bench_variant decode_variants[] = {
+        { "hexstr_to_char", decode_hexstr_to_char },
+        { "hex_decode_scalar", decode_scalar },
+        { "hex_decode", decode_codec },
+    };
+    uint8_t *bin = malloc(65536), *check = malloc(65536);
+    char *hex = malloc(2 * 65536);
+
+    if (!bin || !check || !hex)
+        err(1, "malloc");
+    if ((devnull = fopen("/dev/null", "w")) == NULL)
+        err(1, "/dev/null");
+
+    for (size_t i = 0; i < 65536; i++)
+        bin[i] = rand();
+
+    // all decoders have to agree with the encoder before anything is timed
+    hex_encode(hex, bin, 65536);
+    for (size_t v = 0; v < sizeof(decode_variants) / sizeof(decode_variants[0]); v++) {
+        memset(check, 0, 65536);
+        decode_variants[v].run(hex, check, 65536);
+        if (memcmp(check, bin, 65536))
+            errx(1, "%s does not round trip", decode_variants[v].name);
+    }
+
+    bench_table("print", print_variants, 2, hex, bin);
+    bench_table("encode", encode_variants, 2, hex, bin);
+    bench_table("decode", decode_variants, 3, hex, bin);
+
+    fclose(devnull);
+    free(hex);
+    free(check);
+    free(bin);
+    return 0;
+}
@@ -0,0 +1,251 @@
+/**
+ * Binary keyring of P-256 public keys indexed by key ID
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <openssl/evp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "hexcodec.h"
+#include "keyring.h"
+
+#define KEYRING_MAGIC       "ECKEYRNG"
+#define KEYRING_VERSION     1
+
+struct keyring_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;
+    uint64_t reserved;
+};
+
+struct keyring {
+    void *map;
+    size_t map_size;
+    const struct keyring_record *records;
+    size_t count;
+};
+
+static int compare_records(const void *a, const void *b)
+{
+    return memcmp(((const struct keyring_record *)a)->id, ((const struct keyring_record *)b)->id, KEYRING_ID_SIZE);
+}
+
+struct keyring *keyring_open(const char *path)
+{
+    const struct keyring_header *header;
+    struct keyring *ring;
+    struct stat st;
+    int fd;
+
+    if ((ring = calloc(1, sizeof(*ring))) == NULL) {
+        return NULL;
+    }
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "%s while opening %s\n", strerror(errno), path);
+        free(ring);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*header)) {
+        fprintf(stderr, "%s: not a keyring\n", path);
+        goto err_close;
+    }
+
+    ring->map_size = st.st_size;
+    if ((ring->map = mmap(NULL, ring->map_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "%s while mapping %s\n", strerror(errno), path);
+        goto err_close;
+    }
+    close(fd);
+    fd = -1;
+
+    header = ring->map;
+    if (memcmp(header->magic, KEYRING_MAGIC, sizeof(header->magic)) || header->version != KEYRING_VERSION ||
+        header->record_size != sizeof(struct keyring_record) ||
+        header->count != (ring->map_size - sizeof(*header)) / sizeof(struct keyring_record) ||
+        (ring->map_size - sizeof(*header)) % sizeof(struct keyring_record)) {
+        fprintf(stderr, "%s: not a keyring\n", path);
+        goto err_unmap;
+    }
+
+    /*
+     * keyring_write() sorts and checks the records, a version 1 file is
+     * trusted to be sorted instead of paging in every record here. Binary
+     * search in a file that is not only misses IDs.
+     */
+    ring->records = (const struct keyring_record *)(header + 1);
+    ring->count = header->count;
+
+    // lookups jump around the records, read-ahead would only waste page cache
+    madvise(ring->map, ring->map_size, MADV_RANDOM);
+
+    return ring;
+
+err_unmap:
+    munmap(ring->map, ring->map_size);
+err_close:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(ring);
+    return NULL;
+}
+
+void keyring_close(struct keyring *ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    munmap(ring->map, ring->map_size);
+    free(ring);
+}
+
+size_t keyring_count(const struct keyring *ring)
+{
+    return ring->count;
+}
+
+const struct keyring_record *keyring_find(const struct keyring *ring, const uint8_t id[KEYRING_ID_SIZE])
+{
+    size_t lo = 0, hi = ring->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(id, ring->records[mid].id, KEYRING_ID_SIZE);
+
+        if (cmp == 0) {
+            return &ring->records[mid];
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+int keyring_fingerprint(const uint8_t *pubkey, uint8_t id[KEYRING_ID_SIZE])
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+
+    if (calc_hash(hash_sha256(), pubkey, 64, digest) == 0) {
+        return -1;
+    }
+
+    memcpy(id, digest, KEYRING_ID_SIZE);
+
+    return 0;
+}
+
+int keyring_parse_id(const char *hex, size_t len, uint8_t id[KEYRING_ID_SIZE])
+{
+    char padded[2 * KEYRING_ID_SIZE];
+
+    if (len == 0 || len > sizeof(padded)) {
+        return -1;
+    }
+
+    memset(padded, '0', sizeof(padded));
+    memcpy(padded + sizeof(padded) - len, hex, len);
+
+    return hex_decode(id, padded, sizeof(padded)) < 0 ? -1 : 0;
+}
+
+int keyring_write(const char *path, struct keyring_record *records, size_t count)
+{
+    struct keyring_header header;
+    char *tmp;
+    FILE *fp;
+    int fd;
+
+    qsort(records, count, sizeof(*records), compare_records);
+
+    for (size_t i = 1; i < count; i++) {
+        if (!compare_records(&records[i - 1], &records[i])) {
+            fprintf(stderr, "duplicate key ID in keyring\n");
+            return -1;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KEYRING_MAGIC, sizeof(header.magic));
+    header.version = KEYRING_VERSION;
+    header.record_size = sizeof(struct keyring_record);
+    header.count = count;
+
+    // write next to the target and rename, readers never see a partial file
+    if ((tmp = malloc(strlen(path) + sizeof(".XXXXXX"))) == NULL) {
+        return -1;
+    }
+    sprintf(tmp, "%s.XXXXXX", path);
+
+    // public keys only, readable like the pub.txt files it is built from
+    if ((fd = mkstemp(tmp)) < 0 || fchmod(fd, 0644) || (fp = fdopen(fd, "w")) == NULL) {
+        fprintf(stderr, "%s while creating %s\n", strerror(errno), tmp);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        free(tmp);
+        return -1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        (count && fwrite(records, sizeof(*records), count, fp) != count) ||
+        fflush(fp) || fsync(fd)) {
+        fprintf(stderr, "%s while writing %s\n", strerror(errno), tmp);
+        fclose(fp);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+
+    fclose(fp);
+    if (rename(tmp, path)) {
+        fprintf(stderr, "%s while renaming %s\n", strerror(errno), tmp);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+
+    free(tmp);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * Binary keyring of P-256 public keys indexed by key ID
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __KEYRING_H__
+#define __KEYRING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KEYRING_ID_SIZE         16
+// uncompressed point 0x04 || X || Y
+#define KEYRING_POINT_SIZE      65
+
+/*
+ * File layout: header followed by header.count records sorted by id,
+ * all integers in host byte order
+ */
+struct keyring_record {
+    uint8_t id[KEYRING_ID_SIZE];
+    uint8_t point[KEYRING_POINT_SIZE];
+    uint8_t reserved[15];
+};
+
+struct keyring;
+
+/**
+ * Map a keyring file read-only
+ * @param path
+ * @return keyring or NULL on error (malformed files are rejected, the records
+ *         are trusted to be sorted as keyring_write() writes them)
+ */
+struct keyring *keyring_open(const char *path);
+
+/**
+ * Unmap the keyring
+ * @param ring
+ */
+void keyring_close(struct keyring *ring);
+
+/**
+ * Number of keys in the keyring
+ * @param ring
+ * @return
+ */
+size_t keyring_count(const struct keyring *ring);
+
+/**
+ * Binary search a key ID
+ * @param ring
+ * @param id
+ * @return record inside the mapping or NULL if the ID is unknown
+ */
+const struct keyring_record *keyring_find(const struct keyring *ring, const uint8_t id[KEYRING_ID_SIZE]);
+
+/**
+ * Default key ID of a public key: the first KEYRING_ID_SIZE bytes of
+ * SHA256(X || Y)
+ * @param pubkey X || Y (64 bytes)
+ * @param id [out]
+ * @return 0 on success, -1 on error
+ */
+int keyring_fingerprint(const uint8_t *pubkey, uint8_t id[KEYRING_ID_SIZE]);
+
+/**
+ * Parse a hex key ID, shorter IDs (serial numbers) are zero padded on the left
+ * @param hex
+ * @param len 1 to 2 * KEYRING_ID_SIZE characters
+ * @param id [out]
+ * @return 0 on success, -1 on error
+ */
+int keyring_parse_id(const char *hex, size_t len, uint8_t id[KEYRING_ID_SIZE]);
+
+/**
+ * Sort records by ID and write them as keyring file, the file is replaced
+ * atomically
+ * @param path
+ * @param records sorted in place
+ * @param count
+ * @return 0 on success, -1 on error (including duplicate IDs)
+ */
+int keyring_write(const char *path, struct keyring_record *records, size_t count);
+
+#endif /* __KEYRING_H__ */
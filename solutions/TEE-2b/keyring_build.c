@@ -0,0 +1,202 @@
+/**
+ * Build an ecverify keyring from signer-tee pub.txt files
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hexcodec.h"
+#include "keyring.h"
+#include "sigverify.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -o keyring [-l listfile] [[keyid=]pub.txt ...]\n", prog);
+    fprintf(stderr, "  -o keyring   keyring file to write (replaced atomically)\n");
+    fprintf(stderr, "  -l listfile  one '[keyid=]pub.txt' per line, '-' for stdin\n");
+    fprintf(stderr, "  keyid        up to %d hex digits, zero padded on the left,\n", 2 * KEYRING_ID_SIZE);
+    fprintf(stderr, "               defaults to the first %d bytes of SHA256(X || Y)\n", KEYRING_ID_SIZE);
+    fprintf(stderr, "               only a valid keyid before the first '=' is split off, write\n");
+    fprintf(stderr, "               ./cafe=pub.txt for a path that starts with hex digits and '='\n");
+    fprintf(stderr, "  pub.txt      raw X || Y as written by signer-tee\n");
+}
+
+struct record_list {
+    struct keyring_record *records;
+    size_t count;
+    size_t size;
+};
+
+/**
+ * Read one pub.txt and append it to the list. Key IDs are hex and never
+ * contain '=', so the ID ends at the first '=' and the path, which may
+ * contain '=' itself, follows. Without a valid ID in front of the first
+ * '=' the whole argument is the path.
+ * @param list
+ * @param arg [keyid=]path
+ * @return 0 on success, -1 on error
+ */
+static int add_key(struct record_list *list, const char *arg)
+{
+    const char *path = arg, *eq = strchr(arg, '=');
+    uint8_t pubkey[64];
+    struct keyring_record *record;
+    EVP_PKEY *pkey;
+    ssize_t n;
+    int fd;
+
+    if (list->count == list->size) {
+        size_t size = list->size ? 2 * list->size : 1024;
+        struct keyring_record *records = realloc(list->records, size * sizeof(*records));
+
+        if (!records) {
+            return -1;
+        }
+        list->records = records;
+        list->size = size;
+    }
+
+    record = &list->records[list->count];
+    memset(record, 0, sizeof(*record));
+
+    if (eq && !keyring_parse_id(arg, eq - arg, record->id)) {
+        path = eq + 1;
+    } else {
+        eq = NULL;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(stderr, "%s while opening %s\n", strerror(errno), path);
+        return -1;
+    }
+    n = read(fd, pubkey, sizeof(pubkey));
+    close(fd);
+
+    if (n != sizeof(pubkey)) {
+        fprintf(stderr, "%s: expected %zu bytes\n", path, sizeof(pubkey));
+        return -1;
+    }
+
+    if (!eq && keyring_fingerprint(pubkey, record->id)) {
+        return -1;
+    }
+
+    record->point[0] = 0x04;
+    memcpy(record->point + 1, pubkey, sizeof(pubkey));
+
+    // keep points off the curve out of the keyring instead of failing every verification later
+    if ((pkey = sigverify_pubkey_to_pkey(pubkey)) == NULL) {
+        fprintf(stderr, "%s: not a P-256 public key\n", path);
+        return -1;
+    }
+    EVP_PKEY_free(pkey);
+
+    // print the ID so default fingerprints can be mapped back to the device
+    printf("%s ", path);
+    hex_fprint(stdout, record->id, KEYRING_ID_SIZE);
+    list->count++;
+
+    return 0;
+}
+
+static int add_list(struct record_list *list, const char *listfile)
+{
+    FILE *fp = strcmp(listfile, "-") ? fopen(listfile, "r") : stdin;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int ret = 0;
+
+    if (!fp) {
+        fprintf(stderr, "%s while opening %s\n", strerror(errno), listfile);
+        return -1;
+    }
+
+    while (ret == 0 && (len = getline(&line, &size, fp)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len) {
+            ret = add_key(list, line);
+        }
+    }
+
+    free(line);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    struct record_list list = { NULL, 0, 0 };
+    const char *output = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:o:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                if (add_list(&list, optarg)) {
+                    return 1;
+                }
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (!output) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (add_key(&list, argv[i])) {
+            return 1;
+        }
+    }
+
+    if (keyring_write(output, list.records, list.count)) {
+        return 1;
+    }
+
+    fprintf(stderr, "%zu keys written to %s\n", list.count, output);
+    free(list.records);
+
+    return 0;
+}
@@ -0,0 +1,304 @@
+/**
+ * Multi-buffer SHA256 for many short messages
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+#include "sha256mb.h"
+
+#define SHA256MB_MAX_LANES      8
+#define SHA256MB_BLOCK_SIZE     64
+// messages sorted by length at once, so lanes of a group finish together
+#define SHA256MB_SORT_WINDOW    256
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)     (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)    (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x)    (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x)    (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x)    (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x)    (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+typedef void (*sha256mb_fn)(uint32_t state[8][SHA256MB_MAX_LANES],
+                            const uint8_t *const blocks[SHA256MB_MAX_LANES]);
+
+struct sha256mb_kernel {
+    const char *name;
+    int lanes;
+    sha256mb_fn compress;
+};
+
+#define SHA256MB_KERNEL compress_scalar
+#define SHA256MB_VEC    uint32_t
+#define SHA256MB_LANES  1
+#define SHA256MB_ATTR
+#include "sha256mb_kernel.h"
+
+static const struct sha256mb_kernel kernel_scalar = { "scalar", 1, compress_scalar };
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+
+#define SHA256MB_KERNEL compress_sse2
+#define SHA256MB_VEC    v4u32
+#define SHA256MB_LANES  4
+#define SHA256MB_ATTR   __attribute__((target("sse2")))
+#include "sha256mb_kernel.h"
+
+#define SHA256MB_KERNEL compress_avx2
+#define SHA256MB_VEC    v8u32
+#define SHA256MB_LANES  8
+#define SHA256MB_ATTR   __attribute__((target("avx2")))
+#include "sha256mb_kernel.h"
+
+static const struct sha256mb_kernel kernel_sse2 = { "sse2", 4, compress_sse2 };
+static const struct sha256mb_kernel kernel_avx2 = { "avx2", 8, compress_avx2 };
+#elif defined(__aarch64__)
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+// Advanced SIMD is part of the aarch64 base ISA, no target attribute needed
+#define SHA256MB_KERNEL compress_neon
+#define SHA256MB_VEC    v4u32
+#define SHA256MB_LANES  4
+#define SHA256MB_ATTR
+#include "sha256mb_kernel.h"
+
+static const struct sha256mb_kernel kernel_neon = { "neon", 4, compress_neon };
+#endif
+
+static const struct sha256mb_kernel *select_kernel(void)
+{
+    static const struct sha256mb_kernel *kernel;
+
+    if (kernel) {
+        return kernel;
+    }
+
+    kernel = &kernel_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = &kernel_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = &kernel_sse2;
+    }
+#elif defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_ASIMD) {
+        kernel = &kernel_neon;
+    }
+#endif
+
+    return kernel;
+}
+
+const char *sha256mb_kernel(void)
+{
+    return select_kernel()->name;
+}
+
+int sha256mb_lanes(void)
+{
+    return select_kernel()->lanes;
+}
+
+/**
+ * Hash up to kernel->lanes messages, one per lane
+ * @param kernel
+ * @param msgs
+ * @param lens
+ * @param idx message index per lane
+ * @param n used lanes
+ * @param digests
+ */
+static void hash_group(const struct sha256mb_kernel *kernel, const void *const *msgs, const size_t *lens,
+                       const size_t *idx, int n, uint8_t (*digests)[SHA256MB_DIGEST_SIZE])
+{
+    static const uint8_t unused_block[SHA256MB_BLOCK_SIZE];
+    uint32_t state[8][SHA256MB_MAX_LANES], saved[8][SHA256MB_MAX_LANES];
+    uint8_t tail[SHA256MB_MAX_LANES][2 * SHA256MB_BLOCK_SIZE];
+    const uint8_t *blocks[SHA256MB_MAX_LANES];
+    size_t full[SHA256MB_MAX_LANES], nblocks[SHA256MB_MAX_LANES], max_blocks = 0;
+
+    for (int l = 0; l < kernel->lanes; l++) {
+        for (int i = 0; i < 8; i++) {
+            state[i][l] = sha256_iv[i];
+        }
+
+        if (l >= n) {
+            full[l] = nblocks[l] = 0;
+            continue;
+        }
+
+        // the message tail, 0x80 and the bit length padded to one or two blocks
+        size_t len = lens[idx[l]];
+        size_t rem = len % SHA256MB_BLOCK_SIZE;
+        size_t tail_blocks = rem + 9 > SHA256MB_BLOCK_SIZE ? 2 : 1;
+        uint64_t bits = (uint64_t)len * 8;
+        uint8_t *end;
+
+        full[l] = len / SHA256MB_BLOCK_SIZE;
+        nblocks[l] = full[l] + tail_blocks;
+
+        memset(tail[l], 0, sizeof(tail[l]));
+        memcpy(tail[l], (const uint8_t *)msgs[idx[l]] + full[l] * SHA256MB_BLOCK_SIZE, rem);
+        tail[l][rem] = 0x80;
+        end = tail[l] + tail_blocks * SHA256MB_BLOCK_SIZE;
+        store_be32(end - 8, bits >> 32);
+        store_be32(end - 4, bits);
+
+        if (nblocks[l] > max_blocks) {
+            max_blocks = nblocks[l];
+        }
+    }
+
+    for (size_t b = 0; b < max_blocks; b++) {
+        int finished = 0;
+
+        for (int l = 0; l < kernel->lanes; l++) {
+            if (b < full[l]) {
+                blocks[l] = (const uint8_t *)msgs[idx[l]] + b * SHA256MB_BLOCK_SIZE;
+            } else if (b < nblocks[l]) {
+                blocks[l] = tail[l] + (b - full[l]) * SHA256MB_BLOCK_SIZE;
+            } else {
+                blocks[l] = unused_block;
+                finished = 1;
+            }
+        }
+
+        // lanes already done run along on a dummy block, keep their state
+        if (finished) {
+            memcpy(saved, state, sizeof(saved));
+        }
+
+        kernel->compress(state, blocks);
+
+        if (finished) {
+            for (int l = 0; l < kernel->lanes; l++) {
+                if (b >= nblocks[l]) {
+                    for (int i = 0; i < 8; i++) {
+                        state[i][l] = saved[i][l];
+                    }
+                }
+            }
+        }
+    }
+
+    for (int l = 0; l < n; l++) {
+        for (int i = 0; i < 8; i++) {
+            store_be32(&digests[idx[l]][4 * i], state[i][l]);
+        }
+    }
+}
+
+struct sort_entry {
+    size_t blocks;
+    size_t index;
+};
+
+static int compare_entry(const void *a, const void *b)
+{
+    const struct sort_entry *ea = a, *eb = b;
+
+    return (ea->blocks > eb->blocks) - (ea->blocks < eb->blocks);
+}
+
+static void hash_messages(const struct sha256mb_kernel *kernel, const void *const *msgs, const size_t *lens,
+                          size_t count, uint8_t (*digests)[SHA256MB_DIGEST_SIZE])
+{
+    struct sort_entry entries[SHA256MB_SORT_WINDOW];
+    size_t idx[SHA256MB_MAX_LANES];
+
+    for (size_t base = 0; base < count; base += SHA256MB_SORT_WINDOW) {
+        size_t n = count - base < SHA256MB_SORT_WINDOW ? count - base : SHA256MB_SORT_WINDOW;
+
+        // group messages of equal block count into the same lanes
+        for (size_t i = 0; i < n; i++) {
+            entries[i].blocks = (lens[base + i] + 9 + SHA256MB_BLOCK_SIZE - 1) / SHA256MB_BLOCK_SIZE;
+            entries[i].index = base + i;
+        }
+        if (kernel->lanes > 1) {
+            qsort(entries, n, sizeof(entries[0]), compare_entry);
+        }
+
+        for (size_t i = 0; i < n; i += kernel->lanes) {
+            int lanes = n - i < (size_t)kernel->lanes ? (int)(n - i) : kernel->lanes;
+
+            for (int l = 0; l < lanes; l++) {
+                idx[l] = entries[i + l].index;
+            }
+            hash_group(kernel, msgs, lens, idx, lanes, digests);
+        }
+    }
+}
+
+void sha256mb(const void *const *msgs, const size_t *lens, size_t count,
+              uint8_t (*digests)[SHA256MB_DIGEST_SIZE])
+{
+    hash_messages(select_kernel(), msgs, lens, count, digests);
+}
+
+void sha256mb_scalar(const void *const *msgs, const size_t *lens, size_t count,
+                     uint8_t (*digests)[SHA256MB_DIGEST_SIZE])
+{
+    hash_messages(&kernel_scalar, msgs, lens, count, digests);
+}
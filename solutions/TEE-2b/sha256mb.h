@@ -0,0 +1,72 @@
+/**
+ * Multi-buffer SHA256 for many short messages
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SHA256MB_H__
+#define __SHA256MB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256MB_DIGEST_SIZE    32
+
+/**
+ * Hash count independent messages, several messages at once in SIMD lanes.
+ * The kernel (AVX2 8 lanes, SSE2 or NEON 4 lanes, scalar) is selected at
+ * runtime on first use.
+ * @param msgs
+ * @param lens
+ * @param count
+ * @param digests [out] one SHA256MB_DIGEST_SIZE digest per message
+ */
+void sha256mb(const void *const *msgs, const size_t *lens, size_t count,
+              uint8_t (*digests)[SHA256MB_DIGEST_SIZE]);
+
+/**
+ * Same as sha256mb() but always use the scalar kernel
+ * @param msgs
+ * @param lens
+ * @param count
+ * @param digests
+ */
+void sha256mb_scalar(const void *const *msgs, const size_t *lens, size_t count,
+                     uint8_t (*digests)[SHA256MB_DIGEST_SIZE]);
+
+/**
+ * Name of the kernel sha256mb() uses
+ * @return
+ */
+const char *sha256mb_kernel(void);
+
+/**
+ * Number of messages sha256mb() hashes at once
+ * @return
+ */
+int sha256mb_lanes(void);
+
+#endif /* __SHA256MB_H__ */
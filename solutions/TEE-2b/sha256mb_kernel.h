@@ -0,0 +1,87 @@
+/**
+ * Multi-buffer SHA256 for many short messages
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * SHA256 compression function template, included once per kernel by
+ * sha256mb.c. Every SIMD lane hashes its own message, the state is kept
+ * word major (state[word][lane]) so a vector holds the same word of all
+ * lanes. With a plain uint32_t as vector type this is the scalar kernel.
+ *
+ * Expects:
+ *  SHA256MB_KERNEL   function name
+ *  SHA256MB_VEC      vector type of SHA256MB_LANES uint32_t
+ *  SHA256MB_LANES    number of lanes
+ *  SHA256MB_ATTR     function attributes (target ISA)
+ */
+
+static SHA256MB_ATTR void SHA256MB_KERNEL(uint32_t state[8][SHA256MB_MAX_LANES],
+                                          const uint8_t *const blocks[SHA256MB_MAX_LANES])
+{
+    SHA256MB_VEC w[16], s[8];
+    SHA256MB_VEC a, b, c, d, e, f, g, h, t1, t2;
+    uint32_t tmp[SHA256MB_LANES];
+
+    for (int i = 0; i < 8; i++) {
+        memcpy(&s[i], state[i], sizeof(s[i]));
+    }
+
+    // transpose: w[i] holds big endian word i of every lane's block
+    for (int i = 0; i < 16; i++) {
+        for (int l = 0; l < SHA256MB_LANES; l++) {
+            tmp[l] = load_be32(blocks[l] + 4 * i);
+        }
+        memcpy(&w[i], tmp, sizeof(w[i]));
+    }
+
+    a = s[0]; b = s[1]; c = s[2]; d = s[3];
+    e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16) {
+            w[i & 15] += SSIG1(w[(i - 2) & 15]) + w[(i - 7) & 15] + SSIG0(w[(i - 15) & 15]);
+        }
+
+        t1 = h + BSIG1(e) + CH(e, f, g) + sha256_k[i] + w[i & 15];
+        t2 = BSIG0(a) + MAJ(a, b, c);
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+    s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+
+    for (int i = 0; i < 8; i++) {
+        memcpy(state[i], &s[i], sizeof(s[i]));
+    }
+}
+
+#undef SHA256MB_KERNEL
+#undef SHA256MB_VEC
+#undef SHA256MB_LANES
+#undef SHA256MB_ATTR
@@ -0,0 +1,237 @@
+/**
+ * ECDSA P-256 verification through EVP_PKEY_verify with cached keys
+ * ECDSA P-256 verification with cached public keys
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "sigverify.h"
+
+/*
+ * Parsing a key and setting up its EVP_PKEY_CTX (provider lookup, verify
+ * init) costs about as much as the verification itself, so both are done
+ * once per key and kept while the key is in use. Batch jobs see keys of
+ * thousands of devices, the cache is set associative and the least
+ * recently used slot of a set is replaced.
+ */
+#define KEY_CACHE_WAYS      4
+
+struct sigverify_key {
+    uint8_t pubkey[SIGVERIFY_PUBKEY_SIZE];
+    EVP_PKEY_CTX *ctx;
+    uint64_t last_use;
+};
+
+struct sigverify {
+    struct sigverify_key *keys;
+    size_t sets;
+    uint64_t clock;
+};
+
+EVP_PKEY *sigverify_pubkey_to_pkey(const uint8_t *pubkey)
+{
+    uint8_t point[1 + SIGVERIFY_PUBKEY_SIZE];
+    EC_KEY *ec_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    EVP_PKEY *pkey = NULL;
+
+    if (!ec_key) {
+        return NULL;
+    }
+
+    EC_KEY_set_asn1_flag(ec_key, OPENSSL_EC_NAMED_CURVE);
+
+    point[0] = POINT_CONVERSION_UNCOMPRESSED;
+    memcpy(point + 1, pubkey, SIGVERIFY_PUBKEY_SIZE);
+
+    // oct2key rejects points off the curve, P-256 has cofactor 1 so that is all EC_KEY_check_key() would add
+    if (!EC_KEY_oct2key(ec_key, point, sizeof(point), NULL)) {
+        EC_KEY_free(ec_key);
+        return NULL;
+    }
+
+    // EVP_PKEY_assign_EC_KEY frees ec_key with the pkey
+    if ((pkey = EVP_PKEY_new()) == NULL || !EVP_PKEY_assign_EC_KEY(pkey, ec_key)) {
+        EVP_PKEY_free(pkey);
+        EC_KEY_free(ec_key);
+        return NULL;
+    }
+
+    return pkey;
+}
+
+/**
+ * Parse a public key into a cache slot
+ * @param key slot, empty or released
+ * @param pubkey
+ * @return 0 on success, -1 if the key is unusable
+ */
+static int key_init(struct sigverify_key *key, const uint8_t *pubkey)
+{
+    EVP_PKEY *pkey;
+
+    if ((pkey = sigverify_pubkey_to_pkey(pubkey)) == NULL) {
+        return -1;
+    }
+
+    // the context holds its own reference to pkey
+    key->ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    EVP_PKEY_free(pkey);
+
+    if (!key->ctx || EVP_PKEY_verify_init(key->ctx) <= 0 ||
+        EVP_PKEY_CTX_set_signature_md(key->ctx, hash_sha256()) <= 0) {
+        EVP_PKEY_CTX_free(key->ctx);
+        key->ctx = NULL;
+        return -1;
+    }
+
+    memcpy(key->pubkey, pubkey, sizeof(key->pubkey));
+
+    return 0;
+}
+
+// FNV-1a over X
+static size_t key_set(const struct sigverify *verifier, const uint8_t *pubkey)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < SIGVERIFY_PUBKEY_SIZE / 2; i++) {
+        h = (h ^ pubkey[i]) * 0x100000001b3ull;
+    }
+
+    return h % verifier->sets;
+}
+
+/**
+ * Lookup the cache entry of a public key, create it in place of the least
+ * recently used entry of its set
+ * @param verifier
+ * @param pubkey
+ * @return
+ */
+static struct sigverify_key *key_get(struct sigverify *verifier, const uint8_t *pubkey)
+{
+    struct sigverify_key *set = &verifier->keys[key_set(verifier, pubkey) * KEY_CACHE_WAYS];
+    struct sigverify_key *slot = NULL;
+
+    verifier->clock++;
+    for (size_t way = 0; way < KEY_CACHE_WAYS; way++) {
+        if (set[way].ctx && !memcmp(set[way].pubkey, pubkey, SIGVERIFY_PUBKEY_SIZE)) {
+            set[way].last_use = verifier->clock;
+            return &set[way];
+        }
+        // empty slots have last_use 0 and are taken first
+        if (!slot || set[way].last_use < slot->last_use) {
+            slot = &set[way];
+        }
+    }
+
+    EVP_PKEY_CTX_free(slot->ctx);
+    slot->ctx = NULL;
+    slot->last_use = 0;
+
+    if (key_init(slot, pubkey)) {
+        return NULL;
+    }
+    slot->last_use = verifier->clock;
+
+    return slot;
+}
+
+struct sigverify *sigverify_new(size_t max_keys)
+{
+    struct sigverify *verifier;
+
+    if ((verifier = calloc(1, sizeof(*verifier))) == NULL) {
+        return NULL;
+    }
+
+    if (!max_keys) {
+        max_keys = SIGVERIFY_DEFAULT_KEYS;
+    }
+    verifier->sets = (max_keys + KEY_CACHE_WAYS - 1) / KEY_CACHE_WAYS;
+
+    if ((verifier->keys = calloc(verifier->sets * KEY_CACHE_WAYS, sizeof(*verifier->keys))) == NULL) {
+        free(verifier);
+        return NULL;
+    }
+
+    return verifier;
+}
+
+void sigverify_free(struct sigverify *verifier)
+{
+    if (!verifier) {
+        return;
+    }
+
+    for (size_t i = 0; i < verifier->sets * KEY_CACHE_WAYS; i++) {
+        EVP_PKEY_CTX_free(verifier->keys[i].ctx);
+    }
+    free(verifier->keys);
+    free(verifier);
+}
+
+int sigverify_verify(struct sigverify *verifier, const uint8_t *pubkey,
+                     const void *digest, size_t digestlen, const uint8_t *signature)
+{
+    struct sigverify_key *key;
+    ECDSA_SIG *ecdsa_sig;
+    BIGNUM *r, *s;
+    unsigned char *ecdsa_sig_asn1 = NULL;
+    int ecdsa_sig_asn1_len, ret = -1;
+
+    if ((key = key_get(verifier, pubkey)) == NULL) {
+        return -1;
+    }
+
+    // EVP_PKEY_verify wants the signature ASN.1 encoded
+    r = BN_bin2bn(signature, 32, NULL);
+    s = BN_bin2bn(signature + 32, 32, NULL);
+    if ((ecdsa_sig = ECDSA_SIG_new()) == NULL || !r || !s || !ECDSA_SIG_set0(ecdsa_sig, r, s)) {
+        ECDSA_SIG_free(ecdsa_sig);
+        BN_free(r);
+        BN_free(s);
+        return -1;
+    }
+
+    if ((ecdsa_sig_asn1_len = i2d_ECDSA_SIG(ecdsa_sig, &ecdsa_sig_asn1)) > 0) {
+        ret = EVP_PKEY_verify(key->ctx, ecdsa_sig_asn1, ecdsa_sig_asn1_len, digest, digestlen);
+    }
+
+    OPENSSL_free(ecdsa_sig_asn1);
+    ECDSA_SIG_free(ecdsa_sig);
+
+    // EVP_PKEY_verify returns 0 or a negative value for a mismatch and for errors alike
+    return ret == 1 ? 1 : ret == 0 ? 0 : -1;
+}
@@ -0,0 +1,85 @@
+/**
+ * ECDSA P-256 verification through EVP_PKEY_verify with cached keys
+ * ECDSA P-256 verification with cached public keys
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SIGVERIFY_H__
+#define __SIGVERIFY_H__
+
+#include <openssl/evp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// EC Pubkey TEE_ECC_CURVE_NIST_P256 X || Y, each 32 bytes (same layout as pub.txt)
+#define SIGVERIFY_PUBKEY_SIZE       64
+// EC signature R || S, each 32 bytes (same layout as signature.txt)
+#define SIGVERIFY_SIGNATURE_SIZE    64
+
+// default number of keys kept by the cache, enough for the hot devices of a batch job
+#define SIGVERIFY_DEFAULT_KEYS      4096
+
+struct sigverify;
+
+/**
+ * Create a verifier caching up to max_keys parsed public keys together
+ * with their EVP_PKEY_CTX. Keys are hashed into sets of four, the least
+ * recently used key of a set is evicted first. A verifier is not thread
+ * safe, use one per thread.
+ * @param max_keys rounded up to a multiple of four, 0 for SIGVERIFY_DEFAULT_KEYS
+ * @return verifier or NULL on error
+ */
+struct sigverify *sigverify_new(size_t max_keys);
+
+/**
+ * Release the verifier and all cached keys
+ * @param verifier
+ */
+void sigverify_free(struct sigverify *verifier);
+
+/**
+ * Verify an ECDSA P-256 signature over a SHA256 digest
+ * @param verifier
+ * @param pubkey X || Y (SIGVERIFY_PUBKEY_SIZE bytes)
+ * @param digest
+ * @param digestlen
+ * @param signature R || S (SIGVERIFY_SIGNATURE_SIZE bytes)
+ * @return 1 on success, 0 on signature mismatch, -1 on error or unusable key (like EVP_PKEY_verify)
+ */
+int sigverify_verify(struct sigverify *verifier, const uint8_t *pubkey,
+                     const void *digest, size_t digestlen, const uint8_t *signature);
+
+/**
+ * Parse X || Y, the point is checked to be on the curve. This is the only
+ * check any public key gets, whether it is verified with, printed or
+ * added to a keyring.
+ * @param pubkey X || Y (SIGVERIFY_PUBKEY_SIZE bytes)
+ * @return EVP_PKEY or NULL if the point is invalid
+ */
+EVP_PKEY *sigverify_pubkey_to_pkey(const uint8_t *pubkey);
+
+#endif /* __SIGVERIFY_H__ */
@@ -0,0 +1,162 @@
+/**
+ * Startup benchmark, wall-clock time from exec to the first verdict
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS    50
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n runs] -- command [args ...]\n", prog);
+    fprintf(stderr, "  e.g. %s -- ./ecverify -f file -s signature.txt -p pub.txt\n", prog);
+    fprintf(stderr, "  measures exec until the first line with SUCCESS or FAILURE on stdout\n");
+}
+
+/**
+ * Run the command once
+ * @param argv
+ * @return microseconds from fork to the first verdict, -1 if there was none
+ */
+static double run_once(char *argv[])
+{
+    char buf[4096], line[4096];
+    size_t line_len = 0;
+    double start, verdict = -1;
+    int fds[2], status;
+    ssize_t n;
+    pid_t pid;
+
+    if (pipe(fds)) {
+        err(1, "pipe");
+    }
+
+    start = now_us();
+
+    if ((pid = fork()) < 0) {
+        err(1, "fork");
+    }
+
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n && verdict < 0; i++) {
+            if (buf[i] != '\n' && line_len < sizeof(line) - 1) {
+                line[line_len++] = buf[i];
+                continue;
+            }
+            line[line_len] = '\0';
+            line_len = 0;
+            if (strstr(line, "SUCCESS") || strstr(line, "FAILURE")) {
+                verdict = now_us() - start;
+            }
+        }
+    }
+
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+
+    return verdict;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = DEFAULT_RUNS, opt;
+    double *times, sum = 0;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind >= argc || runs < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if ((times = calloc(runs, sizeof(*times))) == NULL) {
+        err(1, "calloc");
+    }
+
+    // one untimed run to get the binary and libraries into the page cache
+    if (run_once(&argv[optind]) < 0) {
+        errx(1, "%s printed no verdict", argv[optind]);
+    }
+
+    for (int i = 0; i < runs; i++) {
+        if ((times[i] = run_once(&argv[optind])) < 0) {
+            errx(1, "%s printed no verdict", argv[optind]);
+        }
+        sum += times[i];
+    }
+
+    qsort(times, runs, sizeof(*times), compare_double);
+
+    printf("%d runs of %s, exec to first verdict [ms]\n", runs, argv[optind]);
+    printf("min %.3f  median %.3f  mean %.3f  max %.3f\n",
+           times[0] / 1e3, times[runs / 2] / 1e3, sum / runs / 1e3, times[runs - 1] / 1e3);
+
+    free(times);
+
+    return 0;
+}
@@ -0,0 +1,388 @@
+/**
+ * Parallel verification of a signed directory tree
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "sigverify.h"
+#include "treeverify.h"
+#include "wspool.h"
+
+#define TREE_SUCCESS        0
+#define TREE_FAILURE        1
+#define TREE_NO_SIGNATURE   2
+#define TREE_ERROR          3
+
+struct tree;
+
+struct tree_file {
+    struct tree *tree;
+    char *path;
+    off_t size;
+    int result;
+};
+
+// read ahead of one TREE_SPLIT_SIZE range of a large file
+struct tree_prefetch {
+    const char *path;
+    off_t offset;
+    off_t len;
+};
+
+struct tree {
+    struct tree_file *files;
+    size_t count;
+    size_t size;
+    struct tree_prefetch *prefetches;
+    size_t num_prefetches;
+    const uint8_t *pubkey;
+    struct vcache *cache;
+    pthread_mutex_t cache_lock;
+    // one verifier per worker, sigverify is not thread safe
+    struct sigverify **verifiers;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name), suffix_len = strlen(suffix);
+
+    return len >= suffix_len && !strcmp(name + len - suffix_len, suffix);
+}
+
+static int add_file(struct tree *tree, const char *path, off_t size)
+{
+    struct tree_file *file;
+
+    if (tree->count == tree->size) {
+        size_t size = tree->size ? 2 * tree->size : 256;
+        struct tree_file *files = realloc(tree->files, size * sizeof(*files));
+
+        if (!files) {
+            return -1;
+        }
+        tree->files = files;
+        tree->size = size;
+    }
+
+    file = &tree->files[tree->count];
+    if ((file->path = strdup(path)) == NULL) {
+        return -1;
+    }
+    file->tree = tree;
+    file->size = size;
+    file->result = TREE_ERROR;
+    tree->count++;
+
+    return 0;
+}
+
+/**
+ * Collect all regular files below path, symlinks are not followed and
+ * signature files are not verified themselves
+ * @return 0 on success, -1 on error
+ */
+static int walk(BIO *outbio, struct tree *tree, const char *path)
+{
+    struct dirent *entry;
+    struct stat st;
+    DIR *dir;
+    int ret = 0;
+
+    if ((dir = opendir(path)) == NULL) {
+        BIO_printf(outbio, "%s while opening %s\n", strerror(errno), path);
+        return -1;
+    }
+
+    while (ret == 0 && (entry = readdir(dir)) != NULL) {
+        char *child;
+
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        if ((child = malloc(strlen(path) + strlen(entry->d_name) + 2)) == NULL) {
+            ret = -1;
+            break;
+        }
+        sprintf(child, "%s/%s", path, entry->d_name);
+
+        if (lstat(child, &st)) {
+            BIO_printf(outbio, "%s while reading %s\n", strerror(errno), child);
+            ret = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            ret = walk(outbio, tree, child);
+        } else if (S_ISREG(st.st_mode) && !has_suffix(entry->d_name, TREE_SIGNATURE_SUFFIX)) {
+            ret = add_file(tree, child, st.st_size);
+        }
+
+        free(child);
+    }
+
+    closedir(dir);
+
+    return ret;
+}
+
+static void prefetch_job(void *arg, __attribute__((unused)) int worker)
+{
+    struct tree_prefetch *prefetch = arg;
+    off_t offset = prefetch->offset, end = prefetch->offset + prefetch->len;
+    char *buf;
+    ssize_t n;
+    int fd;
+
+    // pulls the range into the page cache while another worker hashes the head of the file
+    if ((buf = malloc(HASH_CHUNK_SIZE)) == NULL) {
+        return;
+    }
+    if ((fd = open(prefetch->path, O_RDONLY)) >= 0) {
+        while (offset < end && (n = pread(fd, buf, HASH_CHUNK_SIZE, offset)) > 0) {
+            offset += n;
+        }
+        close(fd);
+    }
+    free(buf);
+}
+
+/**
+ * Read the detached signature of a file
+ * @return TREE_SUCCESS, TREE_NO_SIGNATURE or TREE_ERROR
+ */
+static int read_signature(const char *path, uint8_t *signature)
+{
+    char *sig_path = malloc(strlen(path) + sizeof(TREE_SIGNATURE_SUFFIX));
+    ssize_t n;
+    int fd;
+
+    if (!sig_path) {
+        return TREE_ERROR;
+    }
+    sprintf(sig_path, "%s%s", path, TREE_SIGNATURE_SUFFIX);
+
+    fd = open(sig_path, O_RDONLY);
+    free(sig_path);
+
+    if (fd < 0) {
+        return errno == ENOENT ? TREE_NO_SIGNATURE : TREE_ERROR;
+    }
+
+    n = read(fd, signature, SIGVERIFY_SIGNATURE_SIZE);
+    close(fd);
+
+    return n == SIGVERIFY_SIGNATURE_SIZE ? TREE_SUCCESS : TREE_ERROR;
+}
+
+static void verify_job(void *arg, int worker)
+{
+    struct tree_file *file = arg;
+    struct tree *tree = file->tree;
+    uint8_t signature[SIGVERIFY_SIGNATURE_SIZE];
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    uint8_t key[VCACHE_KEY_SIZE];
+    int digestlen, ret = -1;
+    double start;
+
+    if ((file->result = read_signature(file->path, signature)) != TREE_SUCCESS) {
+        return;
+    }
+    file->result = TREE_ERROR;
+
+    if ((digestlen = calc_hash_file(hash_sha256(), file->path, digest)) == 0) {
+        return;
+    }
+
+    if (tree->cache) {
+        if (vcache_key(tree->pubkey, digest, digestlen, signature, key)) {
+            return;
+        }
+        pthread_mutex_lock(&tree->cache_lock);
+        ret = vcache_lookup(tree->cache, key);
+        pthread_mutex_unlock(&tree->cache_lock);
+    }
+
+    if (ret < 0) {
+        if (!tree->verifiers[worker] && (tree->verifiers[worker] = sigverify_new(1)) == NULL) {
+            return;
+        }
+
+        start = now_ms();
+        ret = sigverify_verify(tree->verifiers[worker], tree->pubkey, digest, digestlen, signature);
+
+        if (tree->cache) {
+            pthread_mutex_lock(&tree->cache_lock);
+            vcache_account(tree->cache, 1, (now_ms() - start) * 1e6);
+            vcache_store(tree->cache, key, ret);
+            pthread_mutex_unlock(&tree->cache_lock);
+        }
+    }
+
+    file->result = ret == 1 ? TREE_SUCCESS : ret == 0 ? TREE_FAILURE : TREE_ERROR;
+}
+
+static int compare_size(const void *a, const void *b)
+{
+    off_t x = ((const struct tree_file *)a)->size, y = ((const struct tree_file *)b)->size;
+
+    return (x > y) - (x < y);
+}
+
+static int compare_path(const void *a, const void *b)
+{
+    return strcmp(((const struct tree_file *)a)->path, ((const struct tree_file *)b)->path);
+}
+
+/**
+ * Queue all jobs. Files go in ascending size: a worker runs its newest
+ * job first, so every worker starts with its largest file while thieves
+ * take the small ones from the other end.
+ * @return 0 on success, -1 on error
+ */
+static int submit_jobs(struct tree *tree, struct wspool *pool)
+{
+    size_t num_prefetches = 0;
+
+    qsort(tree->files, tree->count, sizeof(*tree->files), compare_size);
+
+    for (size_t i = 0; i < tree->count; i++) {
+        if (tree->files[i].size > TREE_SPLIT_SIZE) {
+            num_prefetches += (tree->files[i].size - 1) / TREE_SPLIT_SIZE;
+        }
+    }
+    if (num_prefetches && (tree->prefetches = calloc(num_prefetches, sizeof(*tree->prefetches))) == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < tree->count; i++) {
+        struct tree_file *file = &tree->files[i];
+
+        // the hashing worker reads the first range itself
+        for (off_t offset = TREE_SPLIT_SIZE; offset < file->size; offset += TREE_SPLIT_SIZE) {
+            struct tree_prefetch *prefetch = &tree->prefetches[tree->num_prefetches++];
+
+            prefetch->path = file->path;
+            prefetch->offset = offset;
+            prefetch->len = file->size - offset < TREE_SPLIT_SIZE ? file->size - offset : TREE_SPLIT_SIZE;
+            if (wspool_submit(pool, prefetch_job, prefetch)) {
+                return -1;
+            }
+        }
+
+        if (wspool_submit(pool, verify_job, file)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int verify_tree(BIO *outbio, struct vcache *cache, const uint8_t *pubkey, const char *dir, int threads)
+{
+    static const char *results[] = { "SUCCESS", "FAILURE", "MISSING SIGNATURE", "ERROR" };
+    size_t counts[4] = { 0 };
+    struct tree tree;
+    struct wspool *pool = NULL;
+    double start = now_ms(), elapsed;
+    off_t bytes = 0;
+    int failed = -1;
+
+    memset(&tree, 0, sizeof(tree));
+    tree.pubkey = pubkey;
+    tree.cache = cache;
+    pthread_mutex_init(&tree.cache_lock, NULL);
+
+    if (walk(outbio, &tree, dir)) {
+        goto cleanup;
+    }
+
+    if ((tree.verifiers = calloc(threads, sizeof(*tree.verifiers))) == NULL ||
+        (pool = wspool_new(threads)) == NULL) {
+        BIO_printf(outbio, "starting %d threads failed\n", threads);
+        goto cleanup;
+    }
+
+    if (submit_jobs(&tree, pool)) {
+        BIO_printf(outbio, "queueing jobs failed\n");
+        wspool_wait(pool);
+        goto cleanup;
+    }
+    wspool_wait(pool);
+    elapsed = now_ms() - start;
+
+    qsort(tree.files, tree.count, sizeof(*tree.files), compare_path);
+
+    for (size_t i = 0; i < tree.count; i++) {
+        counts[tree.files[i].result]++;
+        if (tree.files[i].result != TREE_SUCCESS) {
+            BIO_printf(outbio, "%s: %s\n", tree.files[i].path, results[tree.files[i].result]);
+        } else {
+            bytes += tree.files[i].size;
+        }
+    }
+
+    failed = tree.count - counts[TREE_SUCCESS];
+
+    BIO_printf(outbio, "%zu files: %zu verified, %zu failed, %zu without signature, %zu errors\n",
+               tree.count, counts[TREE_SUCCESS], counts[TREE_FAILURE], counts[TREE_NO_SIGNATURE], counts[TREE_ERROR]);
+    BIO_printf(outbio, "%.1f MiB verified in %.1f ms (%.1f MiB/s, %d threads)\n",
+               bytes / 1048576.0, elapsed, elapsed > 0 ? bytes / 1048576.0 / (elapsed / 1e3) : 0.0, threads);
+
+cleanup:
+    wspool_free(pool);
+    if (tree.verifiers) {
+        for (int i = 0; i < threads; i++) {
+            sigverify_free(tree.verifiers[i]);
+        }
+        free(tree.verifiers);
+    }
+    for (size_t i = 0; i < tree.count; i++) {
+        free(tree.files[i].path);
+    }
+    free(tree.files);
+    free(tree.prefetches);
+    pthread_mutex_destroy(&tree.cache_lock);
+
+    return failed;
+}
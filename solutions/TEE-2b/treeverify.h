@@ -0,0 +1,56 @@
+/**
+ * Parallel verification of a signed directory tree
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TREEVERIFY_H__
+#define __TREEVERIFY_H__
+
+#include <openssl/bio.h>
+#include <stdint.h>
+
+#include "vcache.h"
+
+// detached signature of <file>, raw R || S as written by signer-tee
+#define TREE_SIGNATURE_SUFFIX   ".sig"
+// files larger than this get their tail read ahead by parallel jobs
+#define TREE_SPLIT_SIZE         (32 * 1024 * 1024)
+
+/**
+ * Verify every regular file below dir against its detached signature
+ * <file>.sig. Files are verified largest first on a work-stealing pool,
+ * failed files and a summary are printed once all files are done.
+ * @param outbio
+ * @param cache NULL without verification cache
+ * @param pubkey X || Y (64 bytes) of the signer
+ * @param dir
+ * @param threads
+ * @return number of files not verified successfully, -1 on error
+ */
+int verify_tree(BIO *outbio, struct vcache *cache, const uint8_t *pubkey, const char *dir, int threads);
+
+#endif /* __TREEVERIFY_H__ */
@@ -0,0 +1,301 @@
+/**
+ * Persistent cache of ECDSA verification verdicts
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <openssl/evp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "vcache.h"
+
+#define VCACHE_MAGIC        "ECVCACHE"
+#define VCACHE_VERSION      1
+
+#define SLOT_EMPTY          0
+#define SLOT_USED           1
+
+struct vcache_slot {
+    uint8_t key[VCACHE_KEY_SIZE];
+    uint8_t state;
+    uint8_t verdict;
+    uint8_t reserved[6];
+};
+
+// file layout: header followed by header.slots slots
+struct vcache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t slots;
+    // vcache_account() totals, kept across runs
+    uint64_t verified;
+    uint64_t verify_ns;
+    uint64_t reserved[3];
+};
+
+struct vcache {
+    struct vcache_header *header;
+    struct vcache_slot *slots;
+    size_t mask;
+    size_t map_size;
+    int fd;
+    struct vcache_stats stats;
+};
+
+static size_t round_slots(size_t slots)
+{
+    size_t n = VCACHE_MAX_PROBE;
+
+    while (n < slots) {
+        n <<= 1;
+    }
+
+    return n;
+}
+
+/**
+ * Check the header of an existing cache file
+ * @param header
+ * @param file_size
+ * @return 0 if the file can be used as is, -1 if it has to be reinitialized
+ */
+static int check_header(const struct vcache_header *header, off_t file_size)
+{
+    if (memcmp(header->magic, VCACHE_MAGIC, sizeof(header->magic)) ||
+        header->version != VCACHE_VERSION || header->slot_size != sizeof(struct vcache_slot) ||
+        header->slots < VCACHE_MAX_PROBE || (header->slots & (header->slots - 1))) {
+        return -1;
+    }
+
+    if ((uint64_t)file_size != sizeof(*header) + header->slots * sizeof(struct vcache_slot)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+struct vcache *vcache_open(const char *path, size_t slots)
+{
+    struct vcache *cache;
+    struct vcache_header header;
+    struct stat st;
+    int init = 1;
+    void *map;
+
+    if ((cache = calloc(1, sizeof(*cache))) == NULL) {
+        return NULL;
+    }
+    cache->fd = -1;
+    slots = round_slots(slots);
+
+    if (path) {
+        if ((cache->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+            fprintf(stderr, "%s while opening %s\n", strerror(errno), path);
+            goto err;
+        }
+
+        // one process at a time, a torn slot could hand out a wrong verdict
+        if (flock(cache->fd, LOCK_EX) || fstat(cache->fd, &st)) {
+            fprintf(stderr, "%s while locking %s\n", strerror(errno), path);
+            goto err;
+        }
+
+        if (pread(cache->fd, &header, sizeof(header), 0) == sizeof(header) &&
+            check_header(&header, st.st_size) == 0) {
+            slots = header.slots;
+            init = 0;
+        } else if (ftruncate(cache->fd, 0) ||
+                   ftruncate(cache->fd, sizeof(header) + slots * sizeof(struct vcache_slot))) {
+            fprintf(stderr, "%s while resizing %s\n", strerror(errno), path);
+            goto err;
+        }
+    }
+
+    cache->map_size = sizeof(header) + slots * sizeof(struct vcache_slot);
+    if (path) {
+        map = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    } else {
+        map = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s while mapping the verification cache\n", strerror(errno));
+        goto err;
+    }
+
+    // lookups jump around the table, read-ahead would only waste page cache
+    madvise(map, cache->map_size, MADV_RANDOM);
+
+    cache->header = map;
+    cache->slots = (struct vcache_slot *)(cache->header + 1);
+    cache->mask = slots - 1;
+
+    if (init) {
+        // new mappings are zero filled, every slot starts SLOT_EMPTY
+        memcpy(cache->header->magic, VCACHE_MAGIC, sizeof(cache->header->magic));
+        cache->header->version = VCACHE_VERSION;
+        cache->header->slot_size = sizeof(struct vcache_slot);
+        cache->header->slots = slots;
+    }
+
+    return cache;
+
+err:
+    if (cache->fd >= 0) {
+        close(cache->fd);
+    }
+    free(cache);
+    return NULL;
+}
+
+void vcache_close(struct vcache *cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    munmap(cache->header, cache->map_size);
+    // closing drops the lock
+    if (cache->fd >= 0) {
+        close(cache->fd);
+    }
+    free(cache);
+}
+
+int vcache_key(const uint8_t *pubkey, const void *digest, size_t digestlen,
+               const uint8_t *signature, uint8_t key[VCACHE_KEY_SIZE])
+{
+    uint8_t buf[64 + 1 + EVP_MAX_MD_SIZE + 64];
+    uint8_t *p = buf;
+
+    if (digestlen > EVP_MAX_MD_SIZE) {
+        return -1;
+    }
+
+    // the length byte keeps digests of different sizes apart
+    memcpy(p, pubkey, 64);
+    p += 64;
+    *p++ = digestlen;
+    memcpy(p, digest, digestlen);
+    p += digestlen;
+    memcpy(p, signature, 64);
+    p += 64;
+
+    return calc_hash(hash_sha256(), buf, p - buf, key) == VCACHE_KEY_SIZE ? 0 : -1;
+}
+
+static size_t home_slot(const struct vcache *cache, const uint8_t key[VCACHE_KEY_SIZE])
+{
+    uint64_t h;
+
+    memcpy(&h, key, sizeof(h));
+    return h & cache->mask;
+}
+
+int vcache_lookup(struct vcache *cache, const uint8_t key[VCACHE_KEY_SIZE])
+{
+    size_t home = home_slot(cache, key);
+
+    cache->stats.lookups++;
+
+    for (size_t i = 0; i < VCACHE_MAX_PROBE; i++) {
+        struct vcache_slot *slot = &cache->slots[(home + i) & cache->mask];
+
+        // entries are never removed, an empty slot ends the probe sequence
+        if (slot->state == SLOT_EMPTY) {
+            break;
+        }
+        if (!memcmp(slot->key, key, VCACHE_KEY_SIZE)) {
+            // anyone able to write the file may have left any byte here, only 0 and 1 are verdicts
+            if (slot->verdict != 0 && slot->verdict != 1) {
+                break;
+            }
+            cache->stats.hits++;
+            return slot->verdict;
+        }
+    }
+
+    return -1;
+}
+
+void vcache_store(struct vcache *cache, const uint8_t key[VCACHE_KEY_SIZE], int verdict)
+{
+    size_t home = home_slot(cache, key);
+    struct vcache_slot *slot = NULL;
+
+    if (verdict != 0 && verdict != 1) {
+        return;
+    }
+
+    for (size_t i = 0; i < VCACHE_MAX_PROBE; i++) {
+        struct vcache_slot *s = &cache->slots[(home + i) & cache->mask];
+
+        if (s->state == SLOT_EMPTY || !memcmp(s->key, key, VCACHE_KEY_SIZE)) {
+            slot = s;
+            break;
+        }
+    }
+
+    if (!slot) {
+        // probe sequence full, evict a pseudo random entry of it
+        slot = &cache->slots[(home + key[8] % VCACHE_MAX_PROBE) & cache->mask];
+        cache->stats.evictions++;
+    }
+
+    /*
+     * The slot is only marked used once key and verdict are complete, a
+     * process dying in between leaves an empty slot rather than a key with
+     * the verdict of another signature.
+     */
+    __atomic_store_n(&slot->state, SLOT_EMPTY, __ATOMIC_RELEASE);
+    memcpy(slot->key, key, VCACHE_KEY_SIZE);
+    slot->verdict = verdict;
+    __atomic_store_n(&slot->state, SLOT_USED, __ATOMIC_RELEASE);
+
+    cache->stats.stores++;
+}
+
+void vcache_account(struct vcache *cache, size_t count, uint64_t ns)
+{
+    cache->header->verified += count;
+    cache->header->verify_ns += ns;
+}
+
+void vcache_get_stats(const struct vcache *cache, struct vcache_stats *stats)
+{
+    *stats = cache->stats;
+    stats->verified = cache->header->verified;
+    stats->verify_ns = cache->header->verify_ns;
+}
@@ -0,0 +1,117 @@
+/**
+ * Persistent cache of ECDSA verification verdicts
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __VCACHE_H__
+#define __VCACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA256 over pubkey, digest and signature identifies a cache entry
+#define VCACHE_KEY_SIZE         32
+// default number of slots, always rounded up to a power of two
+#define VCACHE_DEFAULT_SLOTS    (1 << 16)
+// slots probed from the home slot before an entry gets evicted
+#define VCACHE_MAX_PROBE        8
+
+struct vcache;
+
+struct vcache_stats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stores;
+    uint64_t evictions;
+    // verifications accounted with vcache_account() over the lifetime of the file
+    uint64_t verified;
+    uint64_t verify_ns;
+};
+
+/**
+ * Open a verification cache. With a path the table lives in a memory
+ * mapped file which is created (or reinitialized if it is not a cache)
+ * and locked exclusively until vcache_close(). Anyone able to write the
+ * file can forge verdicts, it is created with mode 0600.
+ * @param path NULL for an in-memory cache
+ * @param slots number of slots for a new table, an existing file keeps its size
+ * @return cache or NULL on error
+ */
+struct vcache *vcache_open(const char *path, size_t slots);
+
+/**
+ * Flush and unmap the cache
+ * @param cache
+ */
+void vcache_close(struct vcache *cache);
+
+/**
+ * Calculate the cache key of a signature
+ * @param pubkey X || Y (64 bytes)
+ * @param digest
+ * @param digestlen at most EVP_MAX_MD_SIZE
+ * @param signature R || S (64 bytes)
+ * @param key [out]
+ * @return 0 on success, -1 on error
+ */
+int vcache_key(const uint8_t *pubkey, const void *digest, size_t digestlen,
+               const uint8_t *signature, uint8_t key[VCACHE_KEY_SIZE]);
+
+/**
+ * Look up a verdict
+ * @param cache
+ * @param key
+ * @return 1 verified, 0 signature mismatch, -1 not cached (or a corrupt verdict)
+ */
+int vcache_lookup(struct vcache *cache, const uint8_t key[VCACHE_KEY_SIZE]);
+
+/**
+ * Store a verdict, errors (anything but 0 and 1) are not cached
+ * @param cache
+ * @param key
+ * @param verdict
+ */
+void vcache_store(struct vcache *cache, const uint8_t key[VCACHE_KEY_SIZE], int verdict);
+
+/**
+ * Account time spent verifying signatures the cache did not know, used to
+ * estimate the time saved by hits
+ * @param cache
+ * @param count number of verifications
+ * @param ns time spent on them
+ */
+void vcache_account(struct vcache *cache, size_t count, uint64_t ns);
+
+/**
+ * Get the statistics, lookups, hits, stores and evictions count since
+ * vcache_open()
+ * @param cache
+ * @param stats [out]
+ */
+void vcache_get_stats(const struct vcache *cache, struct vcache_stats *stats);
+
+#endif /* __VCACHE_H__ */
@@ -0,0 +1,299 @@
+/**
+ * Work-stealing thread pool
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "wspool.h"
+
+#define DEQUE_INITIAL_SIZE  64
+
+struct wspool_job {
+    wspool_fn fn;
+    void *arg;
+};
+
+/*
+ * Ring buffer, the owner pushes and pops at the bottom, thieves take from
+ * the top. Jobs are coarse (whole files), a lock per deque is cheap enough.
+ */
+struct wspool_deque {
+    pthread_mutex_t lock;
+    struct wspool_job *jobs;
+    size_t size;
+    size_t top;
+    size_t bottom;
+};
+
+struct wspool {
+    int workers;
+    pthread_t *threads;
+    struct wspool_deque *deques;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    // jobs sitting in deques and jobs not finished yet
+    size_t queued;
+    size_t pending;
+    unsigned int next;
+    int stop;
+};
+
+struct worker_arg {
+    struct wspool *pool;
+    int index;
+};
+
+// pool and index of the current thread if it is a worker
+static __thread struct wspool *current_pool;
+static __thread int current_worker;
+
+static int deque_push(struct wspool_deque *deque, wspool_fn fn, void *arg)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom - deque->top == deque->size) {
+        size_t size = deque->size ? 2 * deque->size : DEQUE_INITIAL_SIZE;
+        struct wspool_job *jobs = malloc(size * sizeof(*jobs));
+
+        if (!jobs) {
+            pthread_mutex_unlock(&deque->lock);
+            return -1;
+        }
+        for (size_t i = deque->top; i < deque->bottom; i++) {
+            jobs[i - deque->top] = deque->jobs[i % deque->size];
+        }
+        free(deque->jobs);
+        deque->jobs = jobs;
+        deque->bottom -= deque->top;
+        deque->top = 0;
+        deque->size = size;
+    }
+
+    deque->jobs[deque->bottom++ % deque->size] = (struct wspool_job){ fn, arg };
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return 0;
+}
+
+static int deque_take(struct wspool_deque *deque, int steal, struct wspool_job *job)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom != deque->top) {
+        *job = steal ? deque->jobs[deque->top++ % deque->size] : deque->jobs[--deque->bottom % deque->size];
+        ret = 1;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return ret;
+}
+
+/**
+ * Own deque first, then the other deques starting with the right neighbour
+ * @return 1 if a job was found
+ */
+static int find_job(struct wspool *pool, int index, struct wspool_job *job)
+{
+    if (deque_take(&pool->deques[index], 0, job)) {
+        return 1;
+    }
+
+    for (int i = 1; i < pool->workers; i++) {
+        if (deque_take(&pool->deques[(index + i) % pool->workers], 1, job)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void *worker_main(void *p)
+{
+    struct worker_arg *arg = p;
+    struct wspool *pool = arg->pool;
+    int index = arg->index;
+    struct wspool_job job;
+
+    free(arg);
+    current_pool = pool;
+    current_worker = index;
+
+    for (;;) {
+        if (find_job(pool, index, &job)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->queued--;
+            pthread_mutex_unlock(&pool->lock);
+
+            job.fn(job.arg, index);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) {
+                pthread_cond_broadcast(&pool->done);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        // queued may be ahead of the deques while a submit is in flight, look again
+        while (!pool->queued && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->stop && !pool->queued) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+struct wspool *wspool_new(int workers)
+{
+    struct wspool *pool;
+
+    if (workers < 1 || (pool = calloc(1, sizeof(*pool))) == NULL) {
+        return NULL;
+    }
+
+    pool->workers = workers;
+    pool->threads = calloc(workers, sizeof(*pool->threads));
+    pool->deques = calloc(workers, sizeof(*pool->deques));
+    if (!pool->threads || !pool->deques) {
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        struct worker_arg *arg = malloc(sizeof(*arg));
+
+        if (!arg) {
+            pool->workers = i;
+            wspool_free(pool);
+            return NULL;
+        }
+        arg->pool = pool;
+        arg->index = i;
+
+        if (pthread_create(&pool->threads[i], NULL, worker_main, arg)) {
+            free(arg);
+            pool->workers = i;
+            wspool_free(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void wspool_free(struct wspool *pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pool->workers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].jobs);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+int wspool_submit(struct wspool *pool, wspool_fn fn, void *arg)
+{
+    int index;
+
+    // counted before the push so a fast worker never finishes a job not counted yet
+    pthread_mutex_lock(&pool->lock);
+    index = current_pool == pool ? current_worker : (int)(pool->next++ % pool->workers);
+    pool->pending++;
+    pool->queued++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (deque_push(&pool->deques[index], fn, arg)) {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+void wspool_wait(struct wspool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int wspool_workers(const struct wspool *pool)
+{
+    return pool->workers;
+}
@@ -0,0 +1,82 @@
+/**
+ * Work-stealing thread pool
+ *
+ * Copyright (c) 2020, Michael Schenk
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __WSPOOL_H__
+#define __WSPOOL_H__
+
+#include <stddef.h>
+
+struct wspool;
+
+/**
+ * Job function
+ * @param arg as passed to wspool_submit()
+ * @param worker index of the running worker, 0 .. workers - 1
+ */
+typedef void (*wspool_fn)(void *arg, int worker);
+
+/**
+ * Start a pool. Every worker has its own deque, it runs its newest job
+ * first and steals the oldest job of another worker once its deque is
+ * empty.
+ * @param workers
+ * @return pool or NULL on error
+ */
+struct wspool *wspool_new(int workers);
+
+/**
+ * Stop the workers after the queued jobs and release the pool
+ * @param pool
+ */
+void wspool_free(struct wspool *pool);
+
+/**
+ * Queue a job. Jobs submitted by a worker go to its own deque, jobs from
+ * other threads are spread round robin.
+ * @param pool
+ * @param fn
+ * @param arg
+ * @return 0 on success, -1 on error
+ */
+int wspool_submit(struct wspool *pool, wspool_fn fn, void *arg);
+
+/**
+ * Wait until all submitted jobs, including jobs they submitted, are done
+ * @param pool
+ */
+void wspool_wait(struct wspool *pool);
+
+/**
+ * Number of workers
+ * @param pool
+ * @return
+ */
+int wspool_workers(const struct wspool *pool);
+
+#endif /* __WSPOOL_H__ */